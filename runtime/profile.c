@@ -0,0 +1,20 @@
+// -fprofile-generate 生成的程序在 main 返回前调用 __prof_dump，把计数器写到 sysy.profdata
+// 和 SysY 运行时库一起链接。格式与 src/profile.hpp 中的 profileWrite 相同
+#include <stdio.h>
+#include <string.h>
+
+// names 中依次是每个计数器的名字，以换行结尾
+void __prof_dump(int *counters, int n, int *names){
+    const char *name = (const char *)names;
+    FILE *f = fopen("sysy.profdata", "w");
+    if(f == NULL){
+        return;
+    }
+    fprintf(f, "sysy-profile %d\n", n);
+    for(int i = 0; i < n; i++){
+        const char *end = strchr(name, '\n');
+        fprintf(f, "%u %.*s\n", (unsigned)counters[i], (int)(end - name), name);
+        name = end + 1;
+    }
+    fclose(f);
+}
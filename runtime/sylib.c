@@ -0,0 +1,205 @@
+// SysY 运行时库：getint、getch、getarray、putint、putch、putarray、starttime、stoptime
+// 输入输出各用一块 64KB 的缓冲区，整数的读入和输出手写，不经过 scanf/printf
+// 输出在缓冲区满、要从 stdin 读入新的一块之前和程序结束时（包括 exit）写出，
+// 交互运行时提示先于读入出现；输入缓冲区里还有字符时不刷新，输入输出重定向到文件时几乎没有额外的 write
+// __sysy_putchars、__sysy_putint_chars 是 -fbatch-io 时后端把连续的 putch/putint 合成的一次调用
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define SYSY_BUF_SIZE 65536
+
+static char inBuf[SYSY_BUF_SIZE];
+static int inPos = 0, inLen = 0;
+static char outBuf[SYSY_BUF_SIZE];
+static int outLen = 0;
+
+
+static void flushOutput(void){
+    int done = 0;
+    while(done < outLen){
+        ssize_t n = write(1, outBuf + done, outLen - done);
+        if(n <= 0){
+            break;
+        }
+        done += n;
+    }
+    outLen = 0;
+}
+
+static void finish(void);
+
+static void registerFinish(void){
+    static int registered = 0;
+    if(!registered){
+        registered = 1;
+        atexit(finish);
+    }
+}
+
+// 下一个字符，输入结束时返回 EOF。要 read 之前先把已经输出的内容写出去
+static int readChar(void){
+    if(inPos == inLen){
+        if(outLen > 0){
+            flushOutput();
+        }
+        ssize_t n = read(0, inBuf, SYSY_BUF_SIZE);
+        if(n <= 0){
+            return EOF;
+        }
+        inPos = 0;
+        inLen = n;
+    }
+    return (unsigned char)inBuf[inPos++];
+}
+
+// 保证缓冲区还能放下 n 个字符
+static void reserve(int n){
+    if(outLen + n > SYSY_BUF_SIZE){
+        flushOutput();
+    }
+    registerFinish();
+}
+
+
+int getch(void){
+    return readChar();
+}
+
+// 和 scanf("%d") 一样跳过空白、接受正负号，溢出时按 32 位回绕
+int getint(void){
+    int c = readChar();
+    while(c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f'){
+        c = readChar();
+    }
+    int neg = 0;
+    if(c == '-' || c == '+'){
+        neg = c == '-';
+        c = readChar();
+    }
+    unsigned v = 0;
+    while(c >= '0' && c <= '9'){
+        v = v * 10 + (c - '0');
+        c = readChar();
+    }
+    if(c != EOF){
+        inPos--; // 读多了的一个字符留给下次
+    }
+    return (int)(neg ? 0u - v : v);
+}
+
+int getarray(int a[]){
+    int n = getint();
+    for(int i = 0; i < n; i++){
+        a[i] = getint();
+    }
+    return n;
+}
+
+
+void putch(int c){
+    reserve(1);
+    outBuf[outLen++] = (char)c;
+}
+
+// 两位两位地转换，从后往前写进临时缓冲区
+static const char digitPairs[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+void putint(int x){
+    char tmp[12];
+    char *p = tmp + sizeof(tmp);
+    unsigned v = x < 0 ? 0u - (unsigned)x : (unsigned)x;
+    while(v >= 100){
+        unsigned r = v % 100;
+        v /= 100;
+        p -= 2;
+        memcpy(p, digitPairs + 2 * r, 2);
+    }
+    if(v >= 10){
+        p -= 2;
+        memcpy(p, digitPairs + 2 * v, 2);
+    }else{
+        *--p = (char)('0' + v);
+    }
+    if(x < 0){
+        *--p = '-';
+    }
+    int n = tmp + sizeof(tmp) - p;
+    reserve(n);
+    memcpy(outBuf + outLen, p, n);
+    outLen += n;
+}
+
+void putarray(int n, int a[]){
+    putint(n);
+    putch(':');
+    for(int i = 0; i < n; i++){
+        putch(' ');
+        putint(a[i]);
+    }
+    putch('\n');
+}
+
+
+// 每个 int 按小端装 4 个字符，共 n 个
+static void putPacked(const int *w, int n){
+    reserve(n);
+    for(int i = 0; i < n; i++){
+        outBuf[outLen++] = (char)((unsigned)w[i / 4] >> (8 * (i % 4)));
+    }
+}
+
+void __sysy_putchars(int n, int w0, int w1, int w2, int w3, int w4, int w5, int w6){
+    int w[7] = {w0, w1, w2, w3, w4, w5, w6};
+    putPacked(w, n);
+}
+
+void __sysy_putint_chars(int x, int n, int w0, int w1, int w2, int w3, int w4, int w5){
+    int w[6] = {w0, w1, w2, w3, w4, w5};
+    putint(x);
+    putPacked(w, n);
+}
+
+
+// 计时：starttime/stoptime 成对使用，结束时把总时间写到标准错误
+static struct timeval timerStart;
+static long long timerTotal = 0; // 微秒
+static int timerUsed = 0;
+
+void starttime(void){
+    gettimeofday(&timerStart, NULL);
+}
+
+void stoptime(void){
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    timerTotal += (now.tv_sec - timerStart.tv_sec) * 1000000LL + (now.tv_usec - timerStart.tv_usec);
+    timerUsed = 1;
+    registerFinish();
+}
+
+// 兼容 sylib.h 中的宏
+void _sysy_starttime(int lineno){
+    (void)lineno;
+    starttime();
+}
+
+void _sysy_stoptime(int lineno){
+    (void)lineno;
+    stoptime();
+}
+
+
+static void finish(void){
+    flushOutput();
+    if(timerUsed){
+        long long us = timerTotal;
+        fprintf(stderr, "TOTAL: %lldH-%lldM-%lldS-%lldus\n",
+                us / 3600000000LL, us / 60000000LL % 60, us / 1000000LL % 60, us % 1000000LL);
+    }
+}
@@ -1,12 +1,22 @@
 #pragma once
 #include <string>
+#include <string_view>
 #include <vector>
 #include <memory>
 #include <iostream>
+#include <sstream>
 #include <unordered_map>
+#include <map>
+#include <set>
 #include <stack>
 #include <deque>
 #include <unordered_set>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <climits>
+#include "profile.hpp"
+#include "vector.hpp"
 using namespace std;
 
 
@@ -16,26 +26,75 @@ struct entry{
     int number;
     string name;
     int level;
+    string koopaid; // 在 koopa 中的名字（不含 @）
+    vector<int> dims; // 数组各维长度，标量为空
+    bool isPointer; // 数组参数，此时 dims 不含第一维
+    shared_ptr<vector<int> > constValues; // 常量数组按行优先展开后的值
     entry(){
         isConst = false;
+        isPointer = false;
         level = 911;
     }
 };
 
 
-// 全局变量
-static int tempVarCount = 0; // 所有临时变量以数字命名，依次递增。根据这个变量获取上一个运算得到的临时变量名。
-static int blockCount = 0; // 块号也类似。不过小心“同步”问题。
-static bool haveBlock = true; // 要特别小心基本块的匹配问题，一定以ret、br、jump之一结尾，且不能为空。用这个全局布尔变量标记当前基本块是否结束
-static bool isBlockEnd = false;
+// 全局变量。这个头文件被 parser 和 main 两个翻译单元包含，两边的 inline 成员函数都会用到这些变量和下面的函数，
+// 所以一律用 inline，整个程序只有一份
+inline int tempVarCount = 0; // 所有临时变量以数字命名，依次递增。根据这个变量获取上一个运算得到的临时变量名。
+inline int blockCount = 0; // 块号也类似。不过小心“同步”问题。
+inline int unrollBlockCount = 0; // 部分展开的循环用的块不占块号，单独计数，-emit-stats 用
+inline bool haveBlock = true; // 要特别小心基本块的匹配问题，一定以ret、br、jump之一结尾，且不能为空。用这个全局布尔变量标记当前基本块是否结束
+inline bool isBlockEnd = false;
+
+inline unordered_map<string,entry> tempSymbolTable;
+inline deque<unordered_map<string,entry> > deq(1,tempSymbolTable); // 专门用于初始化符号表栈的两个全局变量，使这个栈一开始就压入一个符号表，可以用于记录全局变量的信息
+inline stack<unordered_map<string,entry> > symbolTableStack(deq); // 符号表栈，解决局部变量的作用域问题。
+// 每个名字在各层作用域中的定义，最内层的在最后。查找时不用逐层比较，几万层嵌套的块里也是常数时间
+inline unordered_map<string, vector<entry> > symbolIndex;
+inline unordered_set<string> symbolSet; // 判断每一个koopa中的变量名字是否被用过。
+inline unordered_map<string,string> koopaidType; // koopa 变量名对应的类型。同名同层但类型不同的数组不能复用同一个 alloc
+inline stack<int> continueStack; // 为了给continue语句记录下跳转到的基本块标号而设立。栈方便解决多重循环嵌套。
+inline stack<int> breakStack;    // 同上
+// SysY 运行时库的函数，koopa 中要先声明才能调用
+inline const char *runtimeDecls =
+    "decl @getint(): i32\n"
+    "decl @getch(): i32\n"
+    "decl @getarray(*i32): i32\n"
+    "decl @putint(i32)\n"
+    "decl @putch(i32)\n"
+    "decl @putarray(i32, *i32)\n"
+    "decl @starttime()\n"
+    "decl @stoptime()\n";
+inline unordered_map<string, bool> isFuncVoid = {
+    {"getint", false}, {"getch", false}, {"getarray", false},
+    {"putint", true}, {"putch", true}, {"putarray", true}, {"starttime", true}, {"stoptime", true}
+};
+inline string curFuncIdent;        // 正在输出的函数名
+inline vector<entry> curParams;    // 正在输出的函数的参数
+inline int tailEntryBlock = 0;     // 尾递归跳回的基本块号，紧跟在保存参数的指令之后
+inline bool tailEntryUsed = false; // 当前函数是否有被改写成跳转的尾递归
+// 每个函数输出 koopa 用掉的块号和临时变量数，-emit-stats 用
+struct FuncDumpCount{
+    string ident;
+    int blocks;
+    int temps;
+};
+inline vector<FuncDumpCount> funcDumpCounts;
+
+// 标识符的名字表。扫描器把标识符换成编号放在 yylval.sym_val 里，parser 用 lexNames[编号] 取名字，
+// 同一个名字只存一份。deque 追加时不搬动已有的名字，lexNameIds 的键直接指向它们
+inline deque<string> lexNames;
+inline unordered_map<string_view, int> lexNameIds;
 
-static unordered_map<string,entry> tempSymbolTable;
-static deque<unordered_map<string,entry> > deq(1,tempSymbolTable); // 专门用于初始化符号表栈的两个全局静态变量，使这个栈一开始就压入一个符号表，可以用于记录全局变量的信息
-static stack<unordered_map<string,entry> > symbolTableStack(deq); // 符号表栈，解决局部变量的作用域问题。
-static unordered_set<string> symbolSet; // 判断每一个koopa中的变量名字是否被用过。
-static stack<int> continueStack; // 为了给continue语句记录下跳转到的基本块标号而设立。栈方便解决多重循环嵌套。
-static stack<int> breakStack;    // 同上
-static unordered_map<string, bool> isFuncVoid;
+inline int lexIntern(string_view name){
+    auto it = lexNameIds.find(name);
+    if(it != lexNameIds.end()){
+        return it->second;
+    }
+    lexNames.emplace_back(name);
+    lexNameIds.emplace(lexNames.back(), (int)lexNames.size() - 1);
+    return lexNames.size() - 1;
+}
 
 // 声明
 class UnaryExpAST;
@@ -45,8 +104,19 @@ class LOrExpAST;
 class PrimaryExpAST;
 class ConstExpAST;
 class FuncDefAST;
+class BaseAST;
+class StmtAST;
 
-static entry searchSymbolTable(string);
+inline entry searchSymbolTable(string);
+inline void insertSymbol(const entry &);
+inline void pushScope();
+inline void popScope();
+inline bool dumpSelfTailCall(BaseAST *exp);
+inline bool dumpUnrolledWhile(StmtAST *loop);
+inline bool dumpVectorizedWhile(StmtAST *loop);
+inline void noteLoopInit(BaseAST *prev, BaseAST *item);
+inline void notePureFunc(FuncDefAST *func);
+inline bool constCallValue(BaseAST *call, const string &name, const vector<BaseAST*> &args, int &value);
 
 
 
@@ -56,17 +126,317 @@ class BaseAST {
 public:
     virtual ~BaseAST() = default;
     virtual void Dump()  = 0;
-    virtual int valueSpread(){ return 0;}
+    virtual int valueSpread();
+    virtual bool isConstExp(); // 能否在编译期用 valueSpread 求值
+
+    // 表达式和语句可以嵌套得很深（机器生成的输入里几万层括号或者 else if），递归会爆栈，
+    // 所以它们的 Dump、valueSpread、isConstExp 都用显式的栈遍历，见 dumpNode、spreadNode、constNode
+    // dumpStep(k) 做第 k 段输出，返回接下来要输出的子节点，输出完了返回 nullptr。默认整个 Dump 一次做完
+    virtual BaseAST* dumpStep(int step){
+        Dump();
+        return nullptr;
+    }
+    // 表达式的第 k 个操作数，没有了返回 nullptr
+    virtual BaseAST* expChild(int k){ return nullptr; }
+    // 各个操作数的值求出来之后算出表达式的值
+    virtual int spreadCombine(const int *vals){ return 0; }
+    // 不看操作数时，表达式本身能否在编译期求值
+    virtual bool constSelf(){ return false; }
 };
 
 
+inline void dumpNode(BaseAST *root){
+    vector<pair<BaseAST*, int> > work;
+    work.push_back(make_pair(root, 0));
+    while(!work.empty()){
+        BaseAST *node = work.back().first;
+        BaseAST *child = node->dumpStep(work.back().second++);
+        if(child == nullptr){
+            work.pop_back();
+        }else{
+            work.push_back(make_pair(child, 0));
+        }
+    }
+}
+
+inline int spreadNode(BaseAST *root){
+    struct Frame{
+        BaseAST *node;
+        int next;
+        size_t base; // 操作数的值在 vals 中的起始位置
+    };
+    vector<Frame> work;
+    vector<int> vals;
+    work.push_back({root, 0, 0});
+    while(!work.empty()){
+        Frame &f = work.back();
+        BaseAST *child = f.node->expChild(f.next);
+        if(child != nullptr){
+            f.next++;
+            work.push_back({child, 0, vals.size()});
+            continue;
+        }
+        int v = f.node->spreadCombine(vals.data() + f.base);
+        vals.resize(f.base);
+        vals.push_back(v);
+        work.pop_back();
+    }
+    return vals[0];
+}
+
+inline bool constNode(BaseAST *root){
+    vector<BaseAST*> work(1, root);
+    while(!work.empty()){
+        BaseAST *node = work.back();
+        work.pop_back();
+        if(!node->constSelf()){
+            return false;
+        }
+        for(int k = 0; BaseAST *child = node->expChild(k); k++){
+            work.push_back(child);
+        }
+    }
+    return true;
+}
+
+inline int BaseAST::valueSpread(){
+    return spreadNode(this);
+}
+inline bool BaseAST::isConstExp(){
+    return constNode(this);
+}
+
+
+// 释放 AST。很深的树递归析构也会爆栈，所以析构函数只把子节点摘下来交给 deleteNode，
+// 由最外层的 deleteNode 逐个 delete
+inline vector<BaseAST*> pendingDelete;
+inline bool deletingAST = false;
+
+inline void deleteNode(BaseAST *node){
+    if(node == nullptr){
+        return;
+    }
+    pendingDelete.push_back(node);
+    if(deletingAST){
+        return;
+    }
+    deletingAST = true;
+    while(!pendingDelete.empty()){
+        BaseAST *n = pendingDelete.back();
+        pendingDelete.pop_back();
+        delete n;
+    }
+    deletingAST = false;
+}
+
+inline void deleteChild(unique_ptr<BaseAST> &child){
+    deleteNode(child.release());
+}
+
+// 释放列表中的子节点。ArrayDimsAST 和 FuncRParamsAST 的列表会被 parser 拷给父节点，不在这里释放
+inline void deleteList(vector<BaseAST*> &list){
+    for(auto i : list){
+        deleteNode(i);
+    }
+    list.clear();
+}
+
+
+// 数组类型的 koopa 写法，例如 int a[2][3] 对应 [[i32, 3], 2]
+inline string arrayTypeStr(const vector<int> &dims, int from = 0){
+    string t = "i32";
+    for(int i = dims.size() - 1; i >= from; i--){
+        t = "[" + t + ", " + to_string(dims[i]) + "]";
+    }
+    return t;
+}
+
+
+// 为局部变量确定 koopa 中的名字。同名同层的变量类型一致时复用同一个 alloc，否则加后缀区分
+// needAlloc 返回是否需要输出新的 alloc
+inline string allocKoopaid(const string &id, int level, const string &type, bool &needAlloc){
+    string koopaid = id + "__" + to_string(level);
+    int suffix = 0;
+    while(symbolSet.count(koopaid) && koopaidType[koopaid] != type){
+        suffix++;
+        koopaid = id + "__" + to_string(level) + "_" + to_string(suffix);
+    }
+    needAlloc = !symbolSet.count(koopaid);
+    if(needAlloc){
+        symbolSet.emplace(koopaid);
+        koopaidType[koopaid] = type;
+    }
+    return koopaid;
+}
+
+
+// 按 SysY 的规则把（可能嵌套的）初始化列表展开成行优先的稀疏列表 (下标, 表达式)
+// T 是 InitialAST 或 ConstInitialAST，未出现在列表里的元素都为 0
+template<class T>
+inline void flattenInitial(T *init, const vector<int> &dims, int dimIndex, int base, vector<pair<int, BaseAST*> > &out){
+    int n = dims.size();
+    vector<int> sizes(n + 1, 1); // sizes[k] 为第 k 维及之后各维所占元素个数
+    for(int k = n - 1; k >= 0; k--){
+        sizes[k] = sizes[k + 1] * dims[k];
+    }
+    if(!init->isList){
+        out.push_back(make_pair(base, init->expr()));
+        return;
+    }
+    int pos = base, end = base + sizes[dimIndex];
+    for(auto i : init->initList){
+        if(pos >= end){
+            break;
+        }
+        T *item = dynamic_cast<T*>(i);
+        if(!item->isList){
+            out.push_back(make_pair(pos, item->expr()));
+            pos++;
+            continue;
+        }
+        // 子列表对齐到能整除当前位置的最大的子数组
+        int k = dimIndex + 1;
+        while(k < n && (pos - base) % sizes[k] != 0){
+            k++;
+        }
+        if(k >= n){ // 标量外面套了大括号
+            if(!item->initList.empty()){
+                flattenInitial(dynamic_cast<T*>(item->initList[0]), dims, n, pos, out);
+            }
+            pos++;
+        }else{
+            flattenInitial(item, dims, k, pos, out);
+            pos += sizes[k];
+        }
+    }
+}
+
+
+// 当前是否在全局作用域（符号表栈中只有最外层的表）
+inline bool isGlobalScope(){
+    return symbolTableStack.size() == 1;
+}
+
+
+// 全局数组初值的 koopa 写法，values 为行优先展开的全部元素。全为 0 的子数组写成 zeroinit
+inline void dumpAggregate(const vector<int> &dims, int dimIndex, int base, const vector<int> &values){
+    int size = 1;
+    for(int k = dimIndex; k < (int)dims.size(); k++){
+        size *= dims[k];
+    }
+    bool allZero = true;
+    for(int i = base; i < base + size && allZero; i++){
+        allZero = values[i] == 0;
+    }
+    if(allZero){
+        cout << "zeroinit";
+        return;
+    }
+    if(dimIndex == (int)dims.size()){
+        cout << values[base];
+        return;
+    }
+    int sub = size / dims[dimIndex];
+    cout << "{";
+    for(int i = 0; i < dims[dimIndex]; i++){
+        if(i != 0){
+            cout << ", ";
+        }
+        dumpAggregate(dims, dimIndex + 1, base + i * sub, values);
+    }
+    cout << "}";
+}
+
+
+// 全局变量（或需要分配内存的全局常量数组）的定义。初值必须是常量，全为 0 时用 zeroinit，后端放进 .bss
+inline void dumpGlobalAlloc(const string &koopaid, const vector<int> &dims, const vector<int> &values){
+    cout << "global @" << koopaid << " = alloc " << arrayTypeStr(dims) << ", ";
+    dumpAggregate(dims, 0, 0, values);
+    cout << endl;
+}
+
+
+// 局部数组的初始化：为 0 的元素（未给出或者是常量 0）比要写的非零元素多得多时，先 store zeroinit
+// （后端展开为批量清零），再逐个写入非零元素；否则不清零，每个元素都写一次，包括为 0 的
+// values 非空时为常量数组，元素直接取其中的值
+inline void dumpLocalArrayInit(const string &koopaid, const vector<int> &dims, const vector<pair<int, BaseAST*> > &elems, const vector<int> *values){
+    int total = 1;
+    for(int d : dims){
+        total *= d;
+    }
+    int nonzero = 0;
+    for(auto &p : elems){
+        bool isZero = values != nullptr ? (*values)[p.first] == 0 : (p.second->isConstExp() && p.second->valueSpread() == 0);
+        if(!isZero){
+            nonzero++;
+        }
+    }
+    int zeros = total - nonzero;
+    bool cleared = zeros > 0 && zeros >= 2 * nonzero;
+    if(cleared){
+        cout << "   store zeroinit, @" << koopaid << endl;
+    }
+    // 不清零时补上没有给出的元素，按下标排好，node 为空表示 0
+    vector<pair<int, BaseAST*> > filled;
+    if(!cleared && (int)elems.size() < total){
+        filled.assign(total, make_pair(0, (BaseAST*)nullptr));
+        for(int i = 0; i < total; i++){
+            filled[i].first = i;
+        }
+        for(auto &p : elems){
+            filled[p.first].second = p.second;
+        }
+    }
+    const vector<pair<int, BaseAST*> > &list = filled.empty() ? elems : filled;
+    int first = -1; // 指向首元素的 *i32 指针
+    for(auto &p : list){
+        int value = 0;
+        bool isConst = values != nullptr || p.second == nullptr || p.second->isConstExp();
+        if(isConst){
+            value = values != nullptr ? (*values)[p.first] : p.second == nullptr ? 0 : p.second->valueSpread();
+            if(cleared && value == 0){
+                continue;
+            }
+        }else{
+            p.second->Dump();
+        }
+        int v = tempVarCount - 1;
+        if(first < 0){
+            string ptr = "@" + koopaid;
+            for(size_t i = 0; i < dims.size(); i++){
+                cout << "   %" << tempVarCount << " = getelemptr " << ptr << ", 0" << endl;
+                ptr = "%" + to_string(tempVarCount);
+                tempVarCount++;
+            }
+            first = tempVarCount - 1;
+        }
+        string dest = "%" + to_string(first);
+        if(p.first != 0){
+            cout << "   %" << tempVarCount << " = getptr %" << first << ", " << p.first << endl;
+            dest = "%" + to_string(tempVarCount);
+            tempVarCount++;
+        }
+        if(isConst){
+            cout << "   store " << value << ", " << dest << endl;
+        }else{
+            cout << "   store %" << v << ", " << dest << endl;
+        }
+    }
+}
+
+
 // CompUnit 是 BaseAST
 class CompUnitAST : public BaseAST {
 public:
     // 用智能指针管理对象
     unique_ptr<BaseAST> func_defs;
 
+    ~CompUnitAST(){
+        deleteChild(func_defs);
+    }
+
     void Dump() {
+        cout << runtimeDecls << endl;
         func_defs->Dump();
     }
 };
@@ -87,6 +457,67 @@ public:
 };
 
 
+// FuncFParam ::= BType IDENT ["[" "]" {"[" ConstExp "]"}];
+class FuncFParamAST : public BaseAST{
+public:
+    string id;
+    bool isArray = false;
+    vector<BaseAST*> dimList; // 第一维之后的各维
+
+    ~FuncFParamAST(){
+        deleteList(dimList);
+    }
+
+    // 参数在 koopa 中的类型，数组参数是指向第二维的指针
+    string typeStr(){
+        if(!isArray){
+            return "i32";
+        }
+        vector<int> dims;
+        for(auto i : dimList){
+            dims.push_back(i->valueSpread());
+        }
+        return "*" + arrayTypeStr(dims);
+    }
+    void Dump(){
+        entry e;
+        e.name = id;
+        e.level = symbolTableStack.size();
+        e.isPointer = isArray;
+        for(auto i : dimList){
+            e.dims.push_back(i->valueSpread());
+        }
+        string type = typeStr();
+        bool needAlloc;
+        e.koopaid = allocKoopaid(id, e.level, type, needAlloc);
+        insertSymbol(e);
+        curParams.push_back(e);
+        cout << "   @" << e.koopaid << " = alloc " << type << endl;
+        cout << "   store %p_" << id << ", @" << e.koopaid << endl;
+    }
+};
+
+
+class FuncFParamsAST : public BaseAST{
+public:
+    vector<BaseAST*> paramList;
+
+    ~FuncFParamsAST(){
+        deleteList(paramList);
+    }
+
+    void Dump(){}
+};
+
+
+class FuncRParamsAST : public BaseAST{
+public:
+    vector<BaseAST*> expList;
+
+    void Dump(){}
+};
+
+
 // FuncDef 也是 BaseAST
 // FuncDef   ::= FuncType IDENT "(" ")" Block;
 class FuncDefAST : public BaseAST {
@@ -94,21 +525,61 @@ public:
     //unique_ptr<BaseAST> func_type;
     BaseAST* func_type;
     string ident;
+    unique_ptr<BaseAST> params;
     unique_ptr<BaseAST> block;
 
+    ~FuncDefAST(){
+        deleteChild(params);
+        deleteChild(block);
+        delete func_type;
+    }
+
     void Dump() {
+        vector<BaseAST*> paramList;
+        if(params){
+            paramList = dynamic_cast<FuncFParamsAST*>(params.get())->paramList;
+        }
         cout << "fun ";
-        cout << "@" << ident << "()";
+        cout << "@" << ident << "(";
+        for(int i = 0; i < (int)paramList.size(); i++){
+            auto p = dynamic_cast<FuncFParamAST*>(paramList[i]);
+            if(i != 0){
+                cout << ", ";
+            }
+            cout << "%p_" << p->id << ": " << p->typeStr();
+        }
+        cout << ")";
         func_type->Dump();
         
         bool isVoid = dynamic_cast<FuncTypeAST*>(func_type)->type; // !
         isFuncVoid.emplace(ident, isVoid);
+        notePureFunc(this);
+        symbolSet.clear(); // alloc 的名字只在函数内有效
+        koopaidType.clear();
+        blockCount = 0; // 块号在每个函数内从 0 开始，修改别的函数不影响这个函数的块号，profile 才能对得上
+        unrollBlockCount = 0;
+        int tempStart = tempVarCount;
 
         cout << "{" << endl;
         cout << "%entry:" << endl;
 
+        // 参数单独一层作用域，入口处把参数存进 alloc 出来的变量中
+        pushScope();
+        curFuncIdent = ident;
+        curParams.clear();
+        for(auto i : paramList){
+            dynamic_cast<FuncFParamAST*>(i)->Dump();
+        }
+
+        // 函数体先输出到缓冲区，有尾递归时才在参数保存之后插入跳回的入口块
+        tailEntryBlock = blockCount++;
+        tailEntryUsed = false;
+        stringstream body;
+        streambuf *coutBuf = cout.rdbuf(body.rdbuf());
+
         haveBlock = true;
         block->Dump();
+        popScope();
 
         if(isVoid){
             if(haveBlock){
@@ -118,9 +589,33 @@ public:
                 blockCount++;
                 cout << "   ret" << endl;
             }
+        }else if(haveBlock){ // 没有 return 就走到了函数末尾
+            cout << "   ret 0" << endl;
         }
-        
+
+        cout.rdbuf(coutBuf);
+        if(tailEntryUsed){
+            cout << "   jump %block_" << tailEntryBlock << endl;
+            cout << "%block_" << tailEntryBlock << ":" << endl;
+        }
+        cout << body.str();
         cout << "}" << endl;
+        funcDumpCounts.push_back({ident, blockCount + unrollBlockCount, tempVarCount - tempStart});
+    }
+    // 函数的 koopa 声明。-fstream 时函数输出完就被释放，后面的函数通过声明调用它
+    string declStr(){
+        string d = "decl @" + ident + "(";
+        if(params){
+            auto &paramList = dynamic_cast<FuncFParamsAST*>(params.get())->paramList;
+            for(int i = 0; i < (int)paramList.size(); i++){
+                d += (i == 0 ? "" : ", ") + dynamic_cast<FuncFParamAST*>(paramList[i])->typeStr();
+            }
+        }
+        d += ")";
+        if(dynamic_cast<FuncTypeAST*>(func_type)->type == 0){
+            d += ": i32";
+        }
+        return d;
     }
 };
 
@@ -129,9 +624,13 @@ class FuncDefinesAST : public BaseAST{
 public:
     vector<BaseAST*> funcdefList;
 
+    ~FuncDefinesAST(){
+        deleteList(funcdefList);
+    }
+
     void Dump(){
-        for(auto i : funcdefList){
-            dynamic_cast<FuncDefAST*>(i)->Dump();
+        for(auto i : funcdefList){ // FuncDefAST 或者全局的 DeclAST
+            i->Dump();
         }
     }
 };
@@ -143,16 +642,78 @@ class BlockAST : public BaseAST{
 public:
     unique_ptr<BaseAST> items;
 
+    ~BlockAST(){
+        deleteChild(items);
+    }
+
     void Dump() {
-        unordered_map<string,entry> st;
-        symbolTableStack.push(st);
+        dumpNode(this);
+    }
+    BaseAST* dumpStep(int step){
+        if(step == 0){
+            pushScope();
+            return items.get();
+        }
+        popScope();
+        return nullptr;
+    }
+};
+
+
+// ArrayDims ::= "[" ConstExp "]" {"[" ConstExp "]"};
+class ArrayDimsAST : public BaseAST{
+public:
+    vector<BaseAST*> dimList;
 
-        //cout << "{" << endl;
-        //cout << "%entry:" << endl;
-        items->Dump();
-        //cout << "}" << endl;
+    void Dump(){}
+};
+
+
+// LVal ::= IDENT {"[" Exp "]"};
+class LValAST : public BaseAST{
+public:
+    string id;
+    vector<BaseAST*> indexList;
+
+    ~LValAST(){
+        deleteList(indexList);
+    }
 
-        symbolTableStack.pop();
+    void Dump(){}
+    // 输出计算数组元素地址的 getelemptr 序列，返回保存该地址的符号
+    // 数组参数先 load 出指针，第一个下标用 getptr
+    string DumpAddress(const entry &e){
+        string ptr = "@" + e.koopaid;
+        if(e.isPointer){
+            cout << "   %" << tempVarCount << " = load " << ptr << endl;
+            ptr = "%" + to_string(tempVarCount);
+            tempVarCount++;
+        }
+        for(int i = 0; i < (int)indexList.size(); i++){
+            indexList[i]->Dump();
+            int idx = tempVarCount - 1;
+            string op = (e.isPointer && i == 0) ? "getptr " : "getelemptr ";
+            cout << "   %" << tempVarCount << " = " << op << ptr << ", %" << idx << endl;
+            ptr = "%" + to_string(tempVarCount);
+            tempVarCount++;
+        }
+        return ptr;
+    }
+    // 常量数组下标全为常量时，求出行优先展开后的下标
+    int flatIndex(const entry &e){
+        int idx = 0;
+        for(int i = 0; i < (int)e.dims.size(); i++){
+            idx = idx * e.dims[i] + indexList[i]->valueSpread();
+        }
+        return idx;
+    }
+    bool isConstExp(){
+        for(auto i : indexList){
+            if(!i->isConstExp()){
+                return false;
+            }
+        }
+        return true;
     }
 };
 
@@ -165,9 +726,35 @@ public:
     unique_ptr<BaseAST> exp;
     unique_ptr<BaseAST> block;
     string id;
+    unique_ptr<BaseAST> lval;
     unique_ptr<BaseAST> ifstmt;
+    int loopHead = 0; // while 条件所在的块号，循环体和出口的块号依次加一
+
+    ~StmtAST(){
+        deleteChild(exp);
+        deleteChild(block);
+        deleteChild(lval);
+        deleteChild(ifstmt);
+    }
     
     void Dump(){
+        dumpNode(this);
+    }
+    BaseAST* dumpStep(int step){
+        if(step == 1){
+            if(condition == 5){ // 循环体输出完了
+                if(!haveBlock ){
+                    cout << "%block_" << blockCount << ":" << endl;
+                    blockCount++;
+                    haveBlock = true;
+                }
+
+                cout << "   jump %block_" << loopHead << endl;
+                cout << "%block_" << loopHead + 2 << ":" << endl;
+                continueStack.pop(); breakStack.pop();
+            }
+            return nullptr;
+        }
         if(!haveBlock ){
             cout << "%block_" << blockCount << ":" << endl;
             blockCount++;
@@ -178,32 +765,27 @@ public:
             isBlockEnd = true;
             haveBlock = false;
         }else if(condition == 2){ // block
-            block->Dump();
+            return block.get();
         }else if(condition == 3){// exp;
             exp->Dump();
         }else if(condition == 4){
             // do nothing
         }else if(condition == 5){ // WHILE '(' exp ')' IfStmt
+            // 向量化了的循环后面照常输出，处理剩下的元素，不再展开
+            if(!dumpVectorizedWhile(this) && dumpUnrolledWhile(this)){ // 完全展开了
+                return nullptr;
+            }
             // 一定是有block标号的，但是不一定有语句。
             int b0 = blockCount, b1 = b0 + 1, b2 = b0 + 2;
             blockCount += 3;
+            loopHead = b0;
             cout << "   jump %block_" << b0 << endl;
             cout << "%block_" << b0 << ":" << endl;
             exp->Dump();
             cout << "   br %" << tempVarCount - 1 << ", %block_" << b1 << ", %block_" << b2 << endl;
             cout << "%block_" << b1 << ":" << endl;
             continueStack.push(b0); breakStack.push(b2);
-            ifstmt->Dump();
-
-            if(!haveBlock ){
-                cout << "%block_" << blockCount << ":" << endl;
-                blockCount++;
-                haveBlock = true;
-            }
-
-            cout << "   jump %block_" << b0 << endl;
-            cout << "%block_" << b2 << ":" << endl;
-            continueStack.pop(); breakStack.pop();
+            return ifstmt.get();
         }else if(condition == 6){ // continue;
             cout << "   jump %block_" << continueStack.top() << endl;
             haveBlock = false;
@@ -211,17 +793,21 @@ public:
             cout << "   jump %block_" << breakStack.top() << endl;
             haveBlock = false;
         }else if(isReturn){
-            exp->Dump();
-            cout << "   ret %" << tempVarCount-1;
-            cout << endl;
+            if(!dumpSelfTailCall(exp.get())){
+                exp->Dump();
+                cout << "   ret %" << tempVarCount-1;
+                cout << endl;
+            }
             isBlockEnd = true;
             haveBlock = false;
         }else{// lval = exp;
             exp->Dump();
+            int v = tempVarCount - 1;
             entry e = searchSymbolTable(id);
-            string koopaid = id + "__" + to_string(e.level);
-            cout << "   store %" << tempVarCount - 1 << ", @" << koopaid << endl;
+            string dest = dynamic_cast<LValAST*>(lval.get())->DumpAddress(e);
+            cout << "   store %" << v << ", " << dest << endl;
         }
+        return nullptr;
     }
 };
 
@@ -230,11 +816,24 @@ class ExpAST : public BaseAST{
 public:
     unique_ptr<BaseAST> lorexp;
 
+    ~ExpAST(){
+        deleteChild(lorexp);
+    }
+
     void Dump() {
-        lorexp->Dump();
+        dumpNode(this);
     }
-    int valueSpread(){
-        return (lorexp)->valueSpread();
+    BaseAST* dumpStep(int step){
+        return expChild(step);
+    }
+    BaseAST* expChild(int k){
+        return k == 0 ? lorexp.get() : nullptr;
+    }
+    int spreadCombine(const int *vals){
+        return vals[0];
+    }
+    bool constSelf(){
+        return true;
     }
 };
 
@@ -246,16 +845,37 @@ public:
     unique_ptr<BaseAST> primaryexp;
     vector<char> unaryopList;
     string callName;
+    vector<BaseAST*> argList;
+    string callArgs; // 输出调用时已经算出来的实参
+
+    ~UnaryExpAST(){
+        deleteChild(primaryexp);
+        deleteList(argList);
+    }
 
     void Dump() {
-        if(callName == ""){
-            primaryexp->Dump();
-        }else{ // function call
+        dumpNode(this);
+    }
+    BaseAST* dumpStep(int step){
+        int value;
+        if(step == 0 && callName != "" && constCallValue(this, callName, argList, value)){ // 在编译期算出了结果
+            cout << "   %" << tempVarCount << " = add 0, " << value << endl;
+            tempVarCount++;
+            step = argList.size() + 1;
+        }else if(step == 0){
+            callArgs = "";
+        }else if(callName != ""){ // 第 step - 1 个实参算完了
+            callArgs += (step == 1 ? "%" : ", %") + to_string(tempVarCount - 1);
+        }
+        if(BaseAST *child = expChild(step)){
+            return child;
+        }
+        if(callName != "" && step <= (int)argList.size()){ // function call
             bool isVoid = isFuncVoid[callName];
             if(isVoid){
-                cout << "   call @" << callName << "()" << endl;
+                cout << "   call @" << callName << "(" << callArgs << ")" << endl;
             }else{
-                cout << "   %" << tempVarCount << " = call @" << callName << "()" << endl;
+                cout << "   %" << tempVarCount << " = call @" << callName << "(" << callArgs << ")" << endl;
                 tempVarCount++;
             }
         }
@@ -272,9 +892,21 @@ public:
             }
         }
         varNumber = tempVarCount - 1;
+        return nullptr;
     }
-    int valueSpread(){
-        int ans = (primaryexp)->valueSpread();
+    BaseAST* expChild(int k){
+        if(callName == ""){
+            return k == 0 ? primaryexp.get() : nullptr;
+        }
+        return k < (int)argList.size() ? argList[k] : nullptr;
+    }
+    int spreadCombine(const int *vals){
+        int ans = 0;
+        if(callName != ""){
+            constCallValue(this, callName, argList, ans);
+        }else{
+            ans = vals[0];
+        }
         for(char c : unaryopList){
             if(c == '!'){
                 ans = !ans;
@@ -284,6 +916,10 @@ public:
         }
         return ans;
     }
+    bool constSelf(){
+        int value;
+        return callName == "" || constCallValue(this, callName, argList, value);
+    }
 };
 
 
@@ -294,11 +930,19 @@ public:
     vector<char> opList;
     vector<BaseAST*> unaryexpList;
 
-    void Dump() {
-        dynamic_cast<UnaryExpAST*>(unaryexpList[0])->Dump();
-        varNumber = tempVarCount - 1;
-        for(int i=0;i<opList.size();i++){
-            unaryexpList[i+1]->Dump();
+    ~MulExpAST(){
+        deleteList(unaryexpList);
+    }
+
+    void Dump(){
+        dumpNode(this);
+    }
+    // 第 step - 1 个操作数算完了，和前面的结果做运算
+    BaseAST* dumpStep(int step){
+        if(step == 1){
+            varNumber = tempVarCount - 1;
+        }else if(step > 1){
+            int i = step - 2;
             int tr = dynamic_cast<UnaryExpAST*>(unaryexpList[i+1])->varNumber;
             if(opList[i] == '*'){
                 cout << "   %" << tempVarCount << " = mul %" << varNumber << ", %" << tr << endl;
@@ -312,11 +956,15 @@ public:
             }
             varNumber = tempVarCount - 1;
         }
+        return expChild(step);
     }
-    int valueSpread(){
-        int ans = dynamic_cast<UnaryExpAST*>(unaryexpList[0])->valueSpread();
-        for(int i=1;i<unaryexpList.size();i++){
-            int t = dynamic_cast<UnaryExpAST*>(unaryexpList[i])->valueSpread();
+    BaseAST* expChild(int k){
+        return k < (int)unaryexpList.size() ? unaryexpList[k] : nullptr;
+    }
+    int spreadCombine(const int *vals){
+        int ans = vals[0];
+        for(int i=1;i<(int)unaryexpList.size();i++){
+            int t = vals[i];
             if(opList[i-1] == '*'){
                 ans = ans * t;
             }else if(opList[i-1] == '/'){
@@ -326,6 +974,9 @@ public:
         }
         return ans;
     }
+    bool constSelf(){
+        return true;
+    }
 };
 
 
@@ -336,11 +987,19 @@ public:
     vector<char> opList;
     vector<BaseAST*> mulexpList;
 
+    ~AddExpAST(){
+        deleteList(mulexpList);
+    }
+
     void Dump(){
-        dynamic_cast<MulExpAST*>(mulexpList[0])->Dump();
-        varNumber = tempVarCount - 1;
-        for(int i=0;i<opList.size();i++){
-            mulexpList[i+1]->Dump();
+        dumpNode(this);
+    }
+    // 第 step - 1 个操作数算完了，和前面的结果做运算
+    BaseAST* dumpStep(int step){
+        if(step == 1){
+            varNumber = tempVarCount - 1;
+        }else if(step > 1){
+            int i = step - 2;
             int tr = dynamic_cast<MulExpAST*>(mulexpList[i+1])->varNumber;
             if(opList[i] == '+'){
                 cout << "   %" << tempVarCount << " = add %" << varNumber << ", %" << tr << endl;
@@ -351,11 +1010,15 @@ public:
             }
             varNumber = tempVarCount - 1;
         }
+        return expChild(step);
     }
-    int valueSpread(){
-        int ans = dynamic_cast<MulExpAST*>(mulexpList[0])->valueSpread();
-        for(int i=1;i<mulexpList.size();i++){
-            int t = dynamic_cast<MulExpAST*>(mulexpList[i])->valueSpread();
+    BaseAST* expChild(int k){
+        return k < (int)mulexpList.size() ? mulexpList[k] : nullptr;
+    }
+    int spreadCombine(const int *vals){
+        int ans = vals[0];
+        for(int i=1;i<(int)mulexpList.size();i++){
+            int t = vals[i];
             if(opList[i-1] == '+'){
                 ans = ans + t;
             }else{
@@ -364,6 +1027,9 @@ public:
         }
         return ans;
     }
+    bool constSelf(){
+        return true;
+    }
 };
 
 
@@ -375,35 +1041,69 @@ public:
     int number;
     unique_ptr<BaseAST> exp;
     string id;
+    unique_ptr<BaseAST> lval;
 //
+    ~PrimaryExpAST(){
+        deleteChild(exp);
+        deleteChild(lval);
+    }
+
     void Dump(){
+        dumpNode(this);
+    }
+    BaseAST* dumpStep(int step){
         if(isNum){
             cout << "   %" << tempVarCount << " = add 0, " << number << endl;
             tempVarCount++;
         }else if(isVar){
             entry e = searchSymbolTable(id);
-            if(!e.isConst){
-                string koopaid = id + "__" + to_string(e.level);
-                cout << "   %" << tempVarCount << " = load @" << koopaid << endl;
-                tempVarCount++;
-            }else{
-                number = e.number;
+            LValAST *l = dynamic_cast<LValAST*>(lval.get());
+            if(e.isConst && isConstExp()){
+                number = valueSpread();
                 cout << "   %" << tempVarCount << " = add 0, " << number << endl;
                 tempVarCount++;
+            }else if(l->indexList.size() == e.dims.size() + e.isPointer){
+                string ptr = l->DumpAddress(e);
+                cout << "   %" << tempVarCount << " = load " << ptr << endl;
+                tempVarCount++;
+            }else if(e.isPointer && l->indexList.empty()){ // 数组参数本身就是指针, 已经 load 出来了
+                l->DumpAddress(e);
+            }else{ // 数组没有取到元素, 退化为指向下一维首元素的指针
+                string ptr = l->DumpAddress(e);
+                cout << "   %" << tempVarCount << " = getelemptr " << ptr << ", 0" << endl;
+                tempVarCount++;
             }
             
         }else{ // (exp)
-            exp->Dump();
+            return expChild(step);
         }
+        return nullptr;
     }
-    int valueSpread(){
+    BaseAST* expChild(int k){
+        return !isNum && !isVar && k == 0 ? exp.get() : nullptr;
+    }
+    int spreadCombine(const int *vals){
         if(isNum){
             return number;
         }else if(isVar){
             entry e = searchSymbolTable(id);
+            if(!e.dims.empty()){
+                return (*e.constValues)[dynamic_cast<LValAST*>(lval.get())->flatIndex(e)];
+            }
             return e.number;
         }else{
-            return (exp)->valueSpread();
+            return vals[0];
+        }
+    }
+    bool constSelf(){
+        if(isNum){
+            return true;
+        }else if(isVar){
+            entry e = searchSymbolTable(id);
+            LValAST *l = dynamic_cast<LValAST*>(lval.get());
+            return e.isConst && l->indexList.size() == e.dims.size() && l->isConstExp();
+        }else{
+            return true;
         }
     }
 };
@@ -441,11 +1141,19 @@ public:
     vector<BaseAST*> addexpList;
     vector<char> opList;
 
+    ~RelExpAST(){
+        deleteList(addexpList);
+    }
+
     void Dump(){
-        dynamic_cast<AddExpAST*>(addexpList[0])->Dump();
-        varNumber = tempVarCount - 1;
-        for(int i=0;i<opList.size();i++){
-            addexpList[i+1]->Dump();
+        dumpNode(this);
+    }
+    // 第 step - 1 个操作数算完了，和前面的结果做运算
+    BaseAST* dumpStep(int step){
+        if(step == 1){
+            varNumber = tempVarCount - 1;
+        }else if(step > 1){
+            int i = step - 2;
             int tr = dynamic_cast<AddExpAST*>(addexpList[i+1])->varNumber;
             if(opList[i] == '>'){
                 cout << "   %" << tempVarCount << " = gt %" << varNumber << ", %" << tr << endl;
@@ -462,11 +1170,15 @@ public:
             }
             varNumber = tempVarCount - 1;
         }
+        return expChild(step);
     }
-    int valueSpread(){
-        int ans = dynamic_cast<AddExpAST*>(addexpList[0])->valueSpread();
-        for(int i=1;i<addexpList.size();i++){
-            int t = dynamic_cast<AddExpAST*>(addexpList[i])->valueSpread();
+    BaseAST* expChild(int k){
+        return k < (int)addexpList.size() ? addexpList[k] : nullptr;
+    }
+    int spreadCombine(const int *vals){
+        int ans = vals[0];
+        for(int i=1;i<(int)addexpList.size();i++){
+            int t = vals[i];
             if(opList[i-1] == '>'){
                 ans = (ans > t);
             }else if(opList[i-1] == '<'){
@@ -479,6 +1191,9 @@ public:
         }
         return ans;
     }
+    bool constSelf(){
+        return true;
+    }
 };
 
 
@@ -489,11 +1204,19 @@ public:
     vector<BaseAST*> relexpList;
     vector<bool> opList;
 
+    ~EqExpAST(){
+        deleteList(relexpList);
+    }
+
     void Dump(){
-        dynamic_cast<RelExpAST*>(relexpList[0])->Dump();
-        varNumber = tempVarCount - 1;
-        for(int i=0;i<opList.size();i++){
-            relexpList[i+1]->Dump();
+        dumpNode(this);
+    }
+    // 第 step - 1 个操作数算完了，和前面的结果做运算
+    BaseAST* dumpStep(int step){
+        if(step == 1){
+            varNumber = tempVarCount - 1;
+        }else if(step > 1){
+            int i = step - 2;
             int tr = dynamic_cast<RelExpAST*>(relexpList[i+1])->varNumber;
             if(opList[i] == true){
                 cout << "   %" << tempVarCount << " = eq %" << varNumber << ", %" << tr << endl;
@@ -504,11 +1227,15 @@ public:
             }
             varNumber = tempVarCount - 1;
         }
+        return expChild(step);
     }
-    int valueSpread(){
-        int ans = dynamic_cast<RelExpAST*>(relexpList[0])->valueSpread();
-        for(int i=1;i<relexpList.size();i++){
-            int t = dynamic_cast<RelExpAST*>(relexpList[i])->valueSpread();
+    BaseAST* expChild(int k){
+        return k < (int)relexpList.size() ? relexpList[k] : nullptr;
+    }
+    int spreadCombine(const int *vals){
+        int ans = vals[0];
+        for(int i=1;i<(int)relexpList.size();i++){
+            int t = vals[i];
             if(opList[i-1])
                 ans = (ans == t);
             else
@@ -516,6 +1243,9 @@ public:
         }
         return ans;
     }
+    bool constSelf(){
+        return true;
+    }
 };
 
 
@@ -525,13 +1255,20 @@ public:
     int varNumber;
     vector<BaseAST*> eqexpList;
 
-    void Dump(){
-        dynamic_cast<EqExpAST*>(eqexpList[0])->Dump();
-        varNumber = tempVarCount - 1;
-        for(int i=1;i<eqexpList.size();i++){
-            eqexpList[i]->Dump();
-            int tr = dynamic_cast<EqExpAST*>(eqexpList[i])->varNumber;
+    ~LAndExpAST(){
+        deleteList(eqexpList);
+    }
 
+    void Dump(){
+        dumpNode(this);
+    }
+    // 第 step - 1 个操作数算完了，和前面的结果做运算
+    BaseAST* dumpStep(int step){
+        if(step == 1){
+            varNumber = tempVarCount - 1;
+        }else if(step > 1){
+            int i = step - 2;
+            int tr = dynamic_cast<EqExpAST*>(eqexpList[i+1])->varNumber;
             cout << "   %" << tempVarCount << " = ne 0, %" << varNumber << endl;
             tempVarCount++;
             cout << "   %" << tempVarCount << " = ne 0, %" << tr << endl;
@@ -540,15 +1277,22 @@ public:
             tempVarCount++;
             varNumber = tempVarCount - 1;
         }
+        return expChild(step);
     }
-    int valueSpread(){
-        int ans = dynamic_cast<EqExpAST*>(eqexpList[0])->valueSpread();
-        for(int i=1;i<eqexpList.size();i++){
-            int t = dynamic_cast<EqExpAST*>(eqexpList[i])->valueSpread();
+    BaseAST* expChild(int k){
+        return k < (int)eqexpList.size() ? eqexpList[k] : nullptr;
+    }
+    int spreadCombine(const int *vals){
+        int ans = vals[0];
+        for(int i=1;i<(int)eqexpList.size();i++){
+            int t = vals[i];
             ans = ans && t;
         }
         return ans;
     }
+    bool constSelf(){
+        return true;
+    }
 };
 
 
@@ -558,13 +1302,20 @@ public:
     int varNumber;
     vector<BaseAST*> landexpList;
 
-    void Dump(){
-        dynamic_cast<LAndExpAST*>(landexpList[0])->Dump();
-        varNumber = tempVarCount - 1;
-        for(int i=1;i<landexpList.size();i++){
-            landexpList[i]->Dump();
-            int tr = dynamic_cast<LAndExpAST*>(landexpList[i])->varNumber;
+    ~LOrExpAST(){
+        deleteList(landexpList);
+    }
 
+    void Dump(){
+        dumpNode(this);
+    }
+    // 第 step - 1 个操作数算完了，和前面的结果做运算
+    BaseAST* dumpStep(int step){
+        if(step == 1){
+            varNumber = tempVarCount - 1;
+        }else if(step > 1){
+            int i = step - 2;
+            int tr = dynamic_cast<LAndExpAST*>(landexpList[i+1])->varNumber;
             cout << "   %" << tempVarCount << " = ne 0, %" << varNumber << endl;
             tempVarCount++;
             cout << "   %" << tempVarCount << " = ne 0, %" << tr << endl;
@@ -573,27 +1324,113 @@ public:
             tempVarCount++;
             varNumber = tempVarCount - 1;
         }
+        return expChild(step);
     }
-    int valueSpread(){
-        int ans = dynamic_cast<LAndExpAST*>(landexpList[0])->valueSpread();
-        for(int i=1;i<landexpList.size();i++){
-            int t = dynamic_cast<LAndExpAST*>(landexpList[i])->valueSpread();
+    BaseAST* expChild(int k){
+        return k < (int)landexpList.size() ? landexpList[k] : nullptr;
+    }
+    int spreadCombine(const int *vals){
+        int ans = vals[0];
+        for(int i=1;i<(int)landexpList.size();i++){
+            int t = vals[i];
             ans = ans || t;
         }
         return ans;
     }
+    bool constSelf(){
+        return true;
+    }
 };
 
+// 表达式只是一个不带单目运算符的 UnaryExp 时返回它，否则返回 nullptr
+inline UnaryExpAST* asUnaryExp(BaseAST *exp){
+    auto lor = dynamic_cast<LOrExpAST*>(dynamic_cast<ExpAST*>(exp)->lorexp.get());
+    if(lor->landexpList.size() != 1){
+        return nullptr;
+    }
+    auto land = dynamic_cast<LAndExpAST*>(lor->landexpList[0]);
+    if(land->eqexpList.size() != 1){
+        return nullptr;
+    }
+    auto eq = dynamic_cast<EqExpAST*>(land->eqexpList[0]);
+    if(eq->relexpList.size() != 1){
+        return nullptr;
+    }
+    auto rel = dynamic_cast<RelExpAST*>(eq->relexpList[0]);
+    if(rel->addexpList.size() != 1){
+        return nullptr;
+    }
+    auto add = dynamic_cast<AddExpAST*>(rel->addexpList[0]);
+    if(add->mulexpList.size() != 1){
+        return nullptr;
+    }
+    auto mul = dynamic_cast<MulExpAST*>(add->mulexpList[0]);
+    if(mul->unaryexpList.size() != 1){
+        return nullptr;
+    }
+    auto unary = dynamic_cast<UnaryExpAST*>(mul->unaryexpList[0]);
+    if(!unary->unaryopList.empty()){
+        return nullptr;
+    }
+    return unary;
+}
+
+
+// return 调用自身时，把实参存进参数变量后跳回函数开头，不再真正调用。改写了就返回 true
+inline bool dumpSelfTailCall(BaseAST *exp){
+    UnaryExpAST *call = asUnaryExp(exp);
+    if(call == nullptr || call->callName != curFuncIdent || call->argList.size() != curParams.size()){
+        return false;
+    }
+    // 跳回开头后局部数组会被重新初始化，所以数组实参只能是参数或者全局数组
+    for(int i = 0; i < (int)curParams.size(); i++){
+        if(!curParams[i].isPointer){
+            continue;
+        }
+        UnaryExpAST *arg = asUnaryExp(call->argList[i]);
+        auto primary = arg == nullptr ? nullptr : dynamic_cast<PrimaryExpAST*>(arg->primaryexp.get());
+        if(primary == nullptr || !primary->isVar){
+            return false;
+        }
+        entry e = searchSymbolTable(primary->id);
+        if(!e.isPointer && e.level != 1){
+            return false;
+        }
+    }
+    // 先算出所有实参再赋值，实参中可能用到参数的旧值
+    vector<int> args;
+    for(auto i : call->argList){
+        i->Dump();
+        args.push_back(tempVarCount - 1);
+    }
+    for(int i = 0; i < (int)curParams.size(); i++){
+        cout << "   store %" << args[i] << ", @" << curParams[i].koopaid << endl;
+    }
+    cout << "   jump %block_" << tailEntryBlock << endl;
+    tailEntryUsed = true;
+    return true;
+}
+
+
 
 
 class ItemsAST : public BaseAST{
 public:
     vector<BaseAST*> itemsList;
 
+    ~ItemsAST(){
+        deleteList(itemsList);
+    }
+
     void Dump(){
-        for(auto i : itemsList){
-            i->Dump();
+        dumpNode(this);
+    }
+    BaseAST* dumpStep(int i){
+        if(i == (int)itemsList.size()){
+            return nullptr;
         }
+        noteLoopInit(i > 0 ? itemsList[i - 1] : nullptr, itemsList[i]);
+        return itemsList[i];
     }
 };
 
@@ -604,13 +1441,20 @@ public:
     bool isDecl;
     unique_ptr<BaseAST> stmt;
     unique_ptr<BaseAST> decl;
+
+    ~BlockItemAST(){
+        deleteChild(stmt);
+        deleteChild(decl);
+    }
     
     void Dump(){
-        if(isDecl){
-            decl->Dump();
-        }else{
-            stmt->Dump();
+        dumpNode(this);
+    }
+    BaseAST* dumpStep(int step){
+        if(step != 0){
+            return nullptr;
         }
+        return isDecl ? decl.get() : stmt.get();
     }
 };
 
@@ -622,6 +1466,11 @@ public:
     unique_ptr<BaseAST> varDecl;
     bool isConst;
 
+    ~DeclAST(){
+        deleteChild(constDecl);
+        deleteChild(varDecl);
+    }
+
     void Dump(){
         if(!isConst){
             varDecl->Dump();
@@ -638,7 +1487,18 @@ public:
     //vector<BaseAST> constdefList;
     unique_ptr<BaseAST> constDefines;
 
+    ~ConstDeclAST(){
+        deleteChild(constDefines);
+    }
+
     void Dump(){
+        if(!haveBlock && !isGlobalScope()){ // 常量数组也需要输出指令
+            cout << "%block_" << blockCount << ":" << endl;
+            blockCount++;
+            haveBlock = true;
+        }
+        isBlockEnd = false;
+
         constDefines->Dump();
     }
 };
@@ -648,6 +1508,10 @@ class ConstDefinesAST : public BaseAST{
 public:
     vector<BaseAST*> constdefList;
 
+    ~ConstDefinesAST(){
+        deleteList(constdefList);
+    }
+
     void Dump(){
         for(auto i : constdefList){
             i->Dump();
@@ -656,45 +1520,37 @@ public:
 };
 
 
-class ConstDefAST : public BaseAST{
-public:
-    string id;
-    int value;
-    unique_ptr<BaseAST> constInitial;
-
-    void Dump(){
-        value = constInitial->valueSpread();
-        struct entry e;
-        e.isConst = true;
-        e.level = symbolTableStack.size();
-        e.name = id;
-        e.number = value;
-
-        unordered_map<string,entry> st = symbolTableStack.top();
-        st.emplace(id, e);
-        symbolTableStack.pop();
-        symbolTableStack.push(st);
-
-    }
-};
-
-
 class ConstExpAST : public BaseAST{
 public:
     unique_ptr<BaseAST> exp;
 
+    ~ConstExpAST(){
+        deleteChild(exp);
+    }
+
     void Dump(){
 
     }
     int valueSpread(){
         return (exp)->valueSpread();
     }
+    bool isConstExp(){
+        return exp->isConstExp();
+    }
 };
 
 
+// ConstInitVal ::= ConstExp | "{" [ConstInitVal {"," ConstInitVal}] "}";
 class ConstInitialAST : public BaseAST{
 public:
+    bool isList = false;
     unique_ptr<BaseAST> constExp;
+    vector<BaseAST*> initList;
+
+    ~ConstInitialAST(){
+        deleteChild(constExp);
+        deleteList(initList);
+    }
 
     void Dump(){
 
@@ -702,16 +1558,96 @@ public:
     int valueSpread(){
         return (constExp)->valueSpread();
     }
+    BaseAST* expr(){
+        return constExp.get();
+    }
 };
 
 
+// InitVal ::= Exp | "{" [InitVal {"," InitVal}] "}";
 class InitialAST : public BaseAST{
 public:
+    bool isList = false;
     unique_ptr<BaseAST> exp;
+    vector<BaseAST*> initList;
+
+    ~InitialAST(){
+        deleteChild(exp);
+        deleteList(initList);
+    }
 
     void Dump(){
         exp->Dump();
     }
+    BaseAST* expr(){
+        return exp.get();
+    }
+};
+
+
+// 常量的初值必须能在编译期求出（可以调用纯函数，见 notePureFunc）
+inline void requireConstExp(BaseAST *exp, const string &id){
+    if(!exp->isConstExp()){
+        cerr << "error: initializer of const " << id << " is not a constant expression" << endl;
+        exit(1);
+    }
+}
+
+class ConstDefAST : public BaseAST{
+public:
+    string id;
+    int value;
+    vector<BaseAST*> dimList;
+    unique_ptr<BaseAST> constInitial;
+
+    ~ConstDefAST(){
+        deleteChild(constInitial);
+        deleteList(dimList);
+    }
+
+    void Dump(){
+        struct entry e;
+        e.isConst = true;
+        e.level = symbolTableStack.size();
+        e.name = id;
+
+        if(dimList.empty()){
+            requireConstExp(dynamic_cast<ConstInitialAST*>(constInitial.get())->expr(), id);
+            value = constInitial->valueSpread();
+            e.number = value;
+            insertSymbol(e);
+            return;
+        }
+
+        // 常量数组：记下所有元素的值以便常量下标折叠，同时也要分配内存以支持变量下标
+        int total = 1;
+        for(auto i : dimList){
+            e.dims.push_back(i->valueSpread());
+            total *= e.dims.back();
+        }
+        vector<pair<int, BaseAST*> > elems;
+        flattenInitial(dynamic_cast<ConstInitialAST*>(constInitial.get()), e.dims, 0, 0, elems);
+        e.constValues = make_shared<vector<int> >(total, 0);
+        for(auto &p : elems){
+            requireConstExp(p.second, id);
+            (*e.constValues)[p.first] = p.second->valueSpread();
+        }
+
+        string type = arrayTypeStr(e.dims);
+        if(isGlobalScope()){
+            e.koopaid = id + "__" + to_string(e.level);
+            insertSymbol(e);
+            dumpGlobalAlloc(e.koopaid, e.dims, *e.constValues);
+            return;
+        }
+        bool needAlloc;
+        e.koopaid = allocKoopaid(id, e.level, type, needAlloc);
+        if(needAlloc){
+            cout << "   @" << e.koopaid << " = alloc " << type << endl;
+        }
+        insertSymbol(e);
+        dumpLocalArrayInit(e.koopaid, e.dims, elems, e.constValues.get());
+    }
 };
 
 
@@ -721,32 +1657,64 @@ public:
     unique_ptr<BaseAST> initial;
     string id;
     int level;
-    
+    vector<BaseAST*> dimList;
+
+    ~VarDefAST(){
+        deleteChild(initial);
+        deleteList(dimList);
+    }
 
     void Dump(){
         
         level = symbolTableStack.size();
         entry e;
         e.isConst = false; e.name = id;e.level = symbolTableStack.size();
-        unordered_map<string,entry> st = symbolTableStack.top();
-        st.emplace(id,e);
-        symbolTableStack.pop();
-        symbolTableStack.push(st);
-        
-
-        string koopaid = id + "__" + to_string(level);
-        int isKoopaidUsed = symbolSet.count(koopaid);
-        if(isInitial){
+        for(auto i : dimList){
+            e.dims.push_back(i->valueSpread());
+        }
+        string type = dimList.empty() ? "i32" : arrayTypeStr(e.dims);
+        if(isGlobalScope()){
+            // 全局变量的初值在编译期求出
+            int total = 1;
+            for(int d : e.dims){
+                total *= d;
+            }
+            vector<int> values(total, 0);
+            if(isInitial){
+                vector<pair<int, BaseAST*> > elems;
+                flattenInitial(dynamic_cast<InitialAST*>(initial.get()), e.dims, 0, 0, elems);
+                for(auto &p : elems){
+                    values[p.first] = p.second->valueSpread();
+                }
+            }
+            e.koopaid = id + "__" + to_string(level);
+            insertSymbol(e);
+            dumpGlobalAlloc(e.koopaid, e.dims, values);
+            return;
+        }
+        bool needAlloc;
+        string koopaid = allocKoopaid(id, level, type, needAlloc);
+        e.koopaid = koopaid;
+        insertSymbol(e);
+
+        if(!dimList.empty()){
+            if(needAlloc){
+                cout << "   @" << koopaid << " = alloc " << type << endl;
+            }
+            if(isInitial){
+                vector<pair<int, BaseAST*> > elems;
+                flattenInitial(dynamic_cast<InitialAST*>(initial.get()), e.dims, 0, 0, elems);
+                dumpLocalArrayInit(koopaid, e.dims, elems, nullptr);
+            }
+        }else if(isInitial){
             initial->Dump();
-            if(isKoopaidUsed == 0){
+            if(needAlloc){
                 cout << "   @" << koopaid << " = alloc i32" << endl;
-                symbolSet.emplace(koopaid);
             }
             cout << "   store %" << tempVarCount - 1 << ", @" << koopaid << endl;
         }else{
-            if(isKoopaidUsed == 0){
+            if(needAlloc){
                 cout << "   @" << koopaid << " = alloc i32" << endl;
-                symbolSet.emplace(koopaid);
             }
         }
     }
@@ -757,6 +1725,10 @@ class VarDefinesAST : public BaseAST{
 public:
     vector<BaseAST*> vardefList;
 
+    ~VarDefinesAST(){
+        deleteList(vardefList);
+    }
+
     void Dump(){
         for(auto i : vardefList){
             i->Dump();
@@ -769,8 +1741,12 @@ class VarDeclAST : public BaseAST{
 public:
     unique_ptr<BaseAST> varDefines;
 
+    ~VarDeclAST(){
+        deleteChild(varDefines);
+    }
+
     void Dump(){
-        if(!haveBlock){
+        if(!haveBlock && !isGlobalScope()){
             cout << "%block_" << blockCount << ":" << endl;
             blockCount++;
             haveBlock = true;
@@ -782,6 +1758,42 @@ public:
 };
 
 
+// if-else 分三段输出：条件和 then 的入口，then 之后跳到出口、else 的入口，else 之后跳到出口和出口块
+// ifBlock 是 then 的块号，else 和出口的块号依次加一；thenEnd 记下 then 是否以 return 结尾
+inline BaseAST* dumpIfElseStep(int step, BaseAST *exp, BaseAST *thenstmt, BaseAST *elsestmt, int &ifBlock, bool &thenEnd){
+    if(step == 0){
+        exp->Dump();
+        ifBlock = blockCount;
+        blockCount += 3;
+        cout << "   br %" << tempVarCount - 1 << ", %block_" << ifBlock << ", %block_" << ifBlock + 1 << endl;
+        cout << "%block_" << ifBlock << ":" << endl;
+        haveBlock = true;
+        return thenstmt;
+    }
+    bool flag = isBlockEnd;
+    if(!flag){
+        if(!haveBlock ){
+            cout << "%block_" << blockCount << ":" << endl;
+            blockCount++;
+            haveBlock = true;
+        }
+        cout << "   jump %block_" << ifBlock + 2 << endl;
+    }
+    if(step == 1){
+        thenEnd = flag;
+        cout << "%block_" << ifBlock + 1 << ":" << endl;
+        haveBlock = true;
+        return elsestmt;
+    }
+    haveBlock = false;
+    if(!thenEnd || !flag){
+        cout << "%block_" << ifBlock + 2 << ":" << endl;
+        haveBlock = true;
+    }
+    return nullptr;
+}
+
+
 class MatchedStmtAST : public BaseAST{
 public:
     bool isIf;
@@ -790,47 +1802,24 @@ public:
     unique_ptr<BaseAST> thenstmt;
     unique_ptr<BaseAST> elsestmt;
 
+    ~MatchedStmtAST(){
+        deleteChild(stmt);
+        deleteChild(exp);
+        deleteChild(thenstmt);
+        deleteChild(elsestmt);
+    }
+    int ifBlock = 0;
+    bool thenEnd = false;
+
     void Dump(){
+        dumpNode(this);
+    }
+    BaseAST* dumpStep(int step){
         if(!isIf){
-            stmt->Dump();
-        }else{ // IF '(' Exp ')' Matched_stmt ELSE Matched_stmt
-            exp->Dump();
-            int b1 = blockCount, b2 = b1 + 1, b3 = b1 + 2;
-            blockCount += 3;
-            cout << "   br %" << tempVarCount - 1 << ", %block_" << b1 << ", %block_" << b2 << endl;
-            cout << "%block_" << b1 << ":" << endl;
-            haveBlock = true;
-            thenstmt->Dump();
-            bool flag1 = isBlockEnd;
-            if(!flag1){
-                if(!haveBlock ){
-                    cout << "%block_" << blockCount << ":" << endl;
-                    blockCount++;
-                    haveBlock = true;
-                }
-                cout << "   jump %block_" << b3 << endl;
-            }
-            
-            cout << "%block_" << b2 << ":" << endl;
-            haveBlock = true;
-            elsestmt->Dump();
-            bool flag2 = isBlockEnd;
-            if(!flag2){
-                if(!haveBlock ){
-                    cout << "%block_" << blockCount << ":" << endl;
-                    blockCount++;
-                    haveBlock = true;
-                }
-                cout << "   jump %block_" << b3 << endl;
-            }
-            
-            haveBlock = false;
-            if(!flag1 || !flag2){
-                cout << "%block_" << b3 << ":" << endl;
-                haveBlock = true;
-            }
-
+            return step == 0 ? stmt.get() : nullptr;
         }
+        // IF '(' Exp ')' Matched_stmt ELSE Matched_stmt
+        return dumpIfElseStep(step, exp.get(), thenstmt.get(), elsestmt.get(), ifBlock, thenEnd);
     }
 };
 
@@ -842,63 +1831,42 @@ public:
     unique_ptr<BaseAST> thenstmt;
     unique_ptr<BaseAST> elsestmt;
 
+    ~OpenStmtAST(){
+        deleteChild(exp);
+        deleteChild(thenstmt);
+        deleteChild(elsestmt);
+    }
+    int ifBlock = 0;
+    bool thenEnd = false;
+
     void Dump(){
+        dumpNode(this);
+    }
+    BaseAST* dumpStep(int step){
         if(isElse){ // IF '(' Exp ')' Matched_stmt ELSE Open_stmt
+            return dumpIfElseStep(step, exp.get(), thenstmt.get(), elsestmt.get(), ifBlock, thenEnd);
+        }
+        // IF '(' Exp ')' IfStmt
+        if(step == 0){
             exp->Dump();
-            int b1 = blockCount, b2 = b1 + 1, b3 = b1 + 2;
-            blockCount += 3;
-            cout << "   br %" << tempVarCount - 1 << ", %block_" << b1 << ", %block_" << b2 << endl;
-            cout << "%block_" << b1 << ":" << endl;
-            haveBlock = true;
-            thenstmt->Dump();
-            bool flag1 = isBlockEnd;
-            if(!flag1){
-                if(!haveBlock ){
-                    cout << "%block_" << blockCount << ":" << endl;
-                    blockCount++;
-                    haveBlock = true;
-                }
-                cout << "   jump %block_" << b3 << endl;
-            }
-            
-            cout << "%block_" << b2 << ":" << endl;
-            haveBlock = true;
-            elsestmt->Dump();
-            bool flag2 = isBlockEnd;
-            if(!flag2){
-                if(!haveBlock ){
-                    cout << "%block_" << blockCount << ":" << endl;
-                    blockCount++;
-                    haveBlock = true;
-                }
-                cout << "   jump %block_" << b3 << endl;
-            }
-            
-            haveBlock = false;
-            if(!flag1 || !flag2){
-                cout << "%block_" << b3 << ":" << endl;
-                haveBlock = true;
-            }
-        }else{ // IF '(' Exp ')' IfStmt
-            exp->Dump();
-            int b0 = blockCount, b1 = b0 + 1;
+            ifBlock = blockCount;
             blockCount += 2;
-            cout << "   br %" << tempVarCount - 1 << ", %block_" << b0 << ", %block_" << b1 << endl;
-            cout << "%block_" << b0 << ":" << endl;
+            cout << "   br %" << tempVarCount - 1 << ", %block_" << ifBlock << ", %block_" << ifBlock + 1 << endl;
+            cout << "%block_" << ifBlock << ":" << endl;
             haveBlock = true;
-            thenstmt->Dump();
-            if(!isBlockEnd){
-                if(!haveBlock ){
-                    cout << "%block_" << blockCount << ":" << endl;
-                    blockCount++;
-                    haveBlock = true;
-                }
-                cout << "   jump %block_" << b1 << endl;
+            return thenstmt.get();
+        }
+        if(!isBlockEnd){
+            if(!haveBlock ){
+                cout << "%block_" << blockCount << ":" << endl;
+                blockCount++;
+                haveBlock = true;
             }
-            cout << "%block_" << b1 << ":" << endl;
-            haveBlock = true;
-            
+            cout << "   jump %block_" << ifBlock + 1 << endl;
         }
+        cout << "%block_" << ifBlock + 1 << ":" << endl;
+        haveBlock = true;
+        return nullptr;
     }
 };
 
@@ -908,7 +1876,17 @@ public:
     bool isMatched;
     unique_ptr<BaseAST> stmt;
 
+    ~IfStmtAST(){
+        deleteChild(stmt);
+    }
+
     void Dump(){
+        dumpNode(this);
+    }
+    BaseAST* dumpStep(int step){
+        if(step != 0){
+            return nullptr;
+        }
         if(!haveBlock){
             cout << "%block_" << blockCount << ":" << endl;
             blockCount++;
@@ -916,7 +1894,7 @@ public:
         }
         isBlockEnd = false;
 
-        stmt->Dump();
+        return stmt.get();
     }
 };
 
@@ -926,39 +1904,1279 @@ public:
 
 
 
-static entry searchSymbolTable(string name){
-    //cout << "hello?" << endl;
-    unordered_map<string,entry>::iterator it;
-    unordered_map<string,entry> st;
-    stack<unordered_map<string,entry> > garbageSatck;
-    entry e;
-    bool isFind = false;
-    while(!symbolTableStack.empty()){
-      st = symbolTableStack.top();
-      it = st.find(name);
-      if(it != st.end()){
-        e = it->second;
-        isFind = true;
-        break;
-      }
-      garbageSatck.push(st);
-      symbolTableStack.pop();
-    }
-
-    if(!isFind){
-        e.isConst = false;
-        e.level = 404;
-        e.name = "not found";
-    }
-
-    while(!garbageSatck.empty()){
-      unordered_map<string, entry> temp = garbageSatck.top();
-      garbageSatck.pop();
-      symbolTableStack.push(temp);
+// 进入和离开一层作用域
+inline void pushScope(){
+    symbolTableStack.push(unordered_map<string,entry>());
+}
+inline void popScope(){
+    for(auto &it : symbolTableStack.top()){
+        auto &defs = symbolIndex[it.first];
+        defs.pop_back();
+        if(defs.empty()){
+            symbolIndex.erase(it.first);
+        }
+    }
+    symbolTableStack.pop();
+}
+
+// 在当前作用域的符号表中加入一项，同一层已经有这个名字时不变
+inline void insertSymbol(const entry &e){
+    if(symbolTableStack.top().emplace(e.name, e).second){
+        symbolIndex[e.name].push_back(e);
+    }
+}
+
+
+inline entry searchSymbolTable(string name){
+    auto it = symbolIndex.find(name);
+    if(it != symbolIndex.end()){
+        return it->second.back();
     }
+    entry e;
+    e.isConst = false;
+    e.level = 404;
+    e.name = "not found";
     return e;
 }
 
 
 
 
+
+
+// 循环展开
+// 识别 i = c0; while(i < N){ ...; i = i + c; } 这样的循环：i 是局部标量，循环体中只有最后一句修改 i，
+// N 是常量或者循环中不被修改的局部标量，循环体中没有 break、continue、return 和内层循环
+// 次数已知且不多时完全展开；否则按循环体的大小每次走 4 或 2 轮，剩下不足的轮数交给原来的循环
+
+inline const int unrollFullTrips = 16;  // 完全展开的最多次数
+inline const int unrollFullCost = 200;  // 完全展开后循环体总的大小上限
+inline const int unrollCost4 = 12;      // 循环体不超过这个大小时展开 4 次
+inline const int unrollCost2 = 40;      // 不超过这个大小时展开 2 次
+inline bool unrollLoops = true;         // -fno-unroll-loops 时不展开，main 设置
+
+// 部分展开时展开的代码中的块不占块号，改名为 %unroll_<展开前的块号>_<序号>。
+// 这样是否展开不影响后面的块号，-fprofile-use 时不展开的循环后面的块和生成 profile 时的块仍然对得上，
+// 展开的循环体在 profile 中的名字也只由它前面的代码决定
+
+// 循环体中被赋值和声明的变量，以及是否有 break 等跳出的语句
+struct LoopBodyInfo{
+    unordered_map<string, int> assigned;
+    unordered_set<string> declared;
+    bool hasJump = false;
+    int cost = 0; // 大致的指令条数
+};
+
+// 表达式或语句的大致指令条数，顺便收集 LoopBodyInfo。各节点的条数直接相加，用显式的栈遍历
+inline int astCost(BaseAST *root, LoopBodyInfo &info){
+    int cost = 0;
+    vector<BaseAST*> work(1, root);
+    auto pushList = [&](const vector<BaseAST*> &list){
+        work.insert(work.end(), list.begin(), list.end());
+    };
+    while(!work.empty()){
+        BaseAST *node = work.back();
+        work.pop_back();
+        if(node == nullptr){
+            continue;
+        }
+        if(auto p = dynamic_cast<ExpAST*>(node)){
+            work.push_back(p->lorexp.get());
+        }else if(auto p = dynamic_cast<LOrExpAST*>(node)){
+            pushList(p->landexpList);
+            cost += 3 * (p->landexpList.size() - 1);
+        }else if(auto p = dynamic_cast<LAndExpAST*>(node)){
+            pushList(p->eqexpList);
+            cost += 3 * (p->eqexpList.size() - 1);
+        }else if(auto p = dynamic_cast<EqExpAST*>(node)){
+            pushList(p->relexpList);
+            cost += p->opList.size();
+        }else if(auto p = dynamic_cast<RelExpAST*>(node)){
+            pushList(p->addexpList);
+            cost += p->opList.size();
+        }else if(auto p = dynamic_cast<AddExpAST*>(node)){
+            pushList(p->mulexpList);
+            cost += p->opList.size();
+        }else if(auto p = dynamic_cast<MulExpAST*>(node)){
+            pushList(p->unaryexpList);
+            cost += p->opList.size();
+        }else if(auto p = dynamic_cast<UnaryExpAST*>(node)){
+            if(p->callName != ""){
+                pushList(p->argList);
+                cost += 1 + p->argList.size();
+            }else{
+                work.push_back(p->primaryexp.get());
+            }
+            cost += p->unaryopList.size();
+        }else if(auto p = dynamic_cast<PrimaryExpAST*>(node)){
+            if(p->isVar){
+                cost += 1;
+                work.push_back(p->lval.get());
+            }else if(p->isNum){
+                cost += 1;
+            }else{
+                work.push_back(p->exp.get());
+            }
+        }else if(auto p = dynamic_cast<LValAST*>(node)){
+            pushList(p->indexList);
+            cost += p->indexList.size();
+        }else if(auto p = dynamic_cast<IfStmtAST*>(node)){
+            work.push_back(p->stmt.get());
+        }else if(auto p = dynamic_cast<MatchedStmtAST*>(node)){
+            if(!p->isIf){
+                work.push_back(p->stmt.get());
+            }else{
+                cost += 2;
+                work.push_back(p->exp.get());
+                work.push_back(p->thenstmt.get());
+                work.push_back(p->elsestmt.get());
+            }
+        }else if(auto p = dynamic_cast<OpenStmtAST*>(node)){
+            cost += 2;
+            work.push_back(p->exp.get());
+            work.push_back(p->thenstmt.get());
+            if(p->isElse){
+                work.push_back(p->elsestmt.get());
+            }
+        }else if(auto p = dynamic_cast<StmtAST*>(node)){
+            switch(p->condition){
+                case 1: case 5: case 6: case 7:
+                    info.hasJump = true; // 内层循环也不展开
+                    continue;
+                case 2: work.push_back(p->block.get()); continue;
+                case 3: work.push_back(p->exp.get()); continue;
+                case 4: continue;
+            }
+            if(p->isReturn){
+                info.hasJump = true;
+                continue;
+            }
+            info.assigned[p->id]++;
+            cost += 1;
+            work.push_back(p->exp.get());
+            work.push_back(p->lval.get());
+        }else if(auto p = dynamic_cast<BlockAST*>(node)){
+            work.push_back(p->items.get());
+        }else if(auto p = dynamic_cast<ItemsAST*>(node)){
+            pushList(p->itemsList);
+        }else if(auto p = dynamic_cast<BlockItemAST*>(node)){
+            work.push_back(p->isDecl ? p->decl.get() : p->stmt.get());
+        }else if(auto p = dynamic_cast<DeclAST*>(node)){
+            work.push_back(p->isConst ? p->constDecl.get() : p->varDecl.get());
+        }else if(auto p = dynamic_cast<ConstDeclAST*>(node)){
+            for(auto i : dynamic_cast<ConstDefinesAST*>(p->constDefines.get())->constdefList){
+                auto def = dynamic_cast<ConstDefAST*>(i);
+                info.declared.insert(def->id);
+                cost += def->dimList.empty() ? 0 : 4; // 常量数组要初始化，粗略算一下
+            }
+        }else if(auto p = dynamic_cast<VarDeclAST*>(node)){
+            for(auto i : dynamic_cast<VarDefinesAST*>(p->varDefines.get())->vardefList){
+                auto def = dynamic_cast<VarDefAST*>(i);
+                info.declared.insert(def->id);
+                if(def->isInitial){
+                    auto init = dynamic_cast<InitialAST*>(def->initial.get());
+                    if(init->isList){
+                        cost += 4;
+                    }else{
+                        cost += 1;
+                        work.push_back(init->exp.get());
+                    }
+                }
+            }
+        }else{
+            cost += 1;
+        }
+    }
+    return cost;
+}
+
+// 表达式只是一个 AddExp（没有比较和逻辑运算）时返回它
+inline AddExpAST* asAddExp(BaseAST *exp){
+    auto lor = dynamic_cast<LOrExpAST*>(dynamic_cast<ExpAST*>(exp)->lorexp.get());
+    if(lor->landexpList.size() != 1){
+        return nullptr;
+    }
+    auto land = dynamic_cast<LAndExpAST*>(lor->landexpList[0]);
+    if(land->eqexpList.size() != 1){
+        return nullptr;
+    }
+    auto eq = dynamic_cast<EqExpAST*>(land->eqexpList[0]);
+    if(eq->relexpList.size() != 1){
+        return nullptr;
+    }
+    auto rel = dynamic_cast<RelExpAST*>(eq->relexpList[0]);
+    if(rel->addexpList.size() != 1){
+        return nullptr;
+    }
+    return dynamic_cast<AddExpAST*>(rel->addexpList[0]);
+}
+
+// 表达式只是一次比较（a < b 之类，没有逻辑运算）时返回它
+inline RelExpAST* singleCompareOf(BaseAST *exp){
+    auto lor = dynamic_cast<LOrExpAST*>(dynamic_cast<ExpAST*>(exp)->lorexp.get());
+    if(lor->landexpList.size() != 1){
+        return nullptr;
+    }
+    auto land = dynamic_cast<LAndExpAST*>(lor->landexpList[0]);
+    if(land->eqexpList.size() != 1){
+        return nullptr;
+    }
+    auto eq = dynamic_cast<EqExpAST*>(land->eqexpList[0]);
+    if(eq->relexpList.size() != 1){
+        return nullptr;
+    }
+    auto rel = dynamic_cast<RelExpAST*>(eq->relexpList[0]);
+    if(rel->opList.size() != 1){
+        return nullptr;
+    }
+    return rel;
+}
+
+// MulExp 是单独一个标量变量（没有下标）时返回它的名字
+inline string scalarVarOfMul(BaseAST *mul){
+    auto m = dynamic_cast<MulExpAST*>(mul);
+    if(m->unaryexpList.size() != 1){
+        return "";
+    }
+    auto u = dynamic_cast<UnaryExpAST*>(m->unaryexpList[0]);
+    if(u->callName != "" || !u->unaryopList.empty()){
+        return "";
+    }
+    auto p = dynamic_cast<PrimaryExpAST*>(u->primaryexp.get());
+    if(!p->isVar || !dynamic_cast<LValAST*>(p->lval.get())->indexList.empty()){
+        return "";
+    }
+    return p->id;
+}
+inline string scalarVarOf(BaseAST *add){
+    auto a = dynamic_cast<AddExpAST*>(add);
+    if(a == nullptr || a->mulexpList.size() != 1){
+        return "";
+    }
+    return scalarVarOfMul(a->mulexpList[0]);
+}
+
+// 可以作为归纳变量或者循环上界的局部标量
+inline bool isLocalScalar(const string &id){
+    entry e = searchSymbolTable(id);
+    return e.level != 404 && e.level > 1 && !e.isConst && e.dims.empty() && !e.isPointer;
+}
+
+// 单独一条语句的 IfStmt 里面的 StmtAST
+inline StmtAST* plainStmtOf(BaseAST *ifstmt){
+    auto s = dynamic_cast<IfStmtAST*>(ifstmt);
+    auto m = s == nullptr ? nullptr : dynamic_cast<MatchedStmtAST*>(s->stmt.get());
+    if(m == nullptr || m->isIf){
+        return nullptr;
+    }
+    return dynamic_cast<StmtAST*>(m->stmt.get());
+}
+
+// ItemsAST 在输出每一项之前记下紧挨着的前一句给出的常量初值，完全展开时用来求次数
+inline StmtAST *loopInitFor = nullptr;
+inline string loopInitId;
+inline int loopInitValue = 0;
+
+inline void noteLoopInit(BaseAST *prev, BaseAST *item){
+    loopInitFor = nullptr;
+    auto cur = dynamic_cast<BlockItemAST*>(item);
+    auto p = dynamic_cast<BlockItemAST*>(prev);
+    if(cur == nullptr || p == nullptr || cur->isDecl){
+        return;
+    }
+    StmtAST *loop = plainStmtOf(cur->stmt.get());
+    if(loop == nullptr || loop->condition != 5){
+        return;
+    }
+    if(p->isDecl){
+        auto decl = dynamic_cast<DeclAST*>(p->decl.get());
+        if(decl->isConst){
+            return;
+        }
+        auto defs = dynamic_cast<VarDefinesAST*>(dynamic_cast<VarDeclAST*>(decl->varDecl.get())->varDefines.get());
+        auto def = dynamic_cast<VarDefAST*>(defs->vardefList.back());
+        if(!def->dimList.empty() || !def->isInitial){
+            return;
+        }
+        auto init = dynamic_cast<InitialAST*>(def->initial.get());
+        if(init->isList || !init->exp->isConstExp()){
+            return;
+        }
+        loopInitId = def->id;
+        loopInitValue = init->exp->valueSpread();
+        loopInitFor = loop;
+    }else{
+        StmtAST *s = plainStmtOf(p->stmt.get());
+        if(s == nullptr || s->condition != 0 || s->isReturn || !dynamic_cast<LValAST*>(s->lval.get())->indexList.empty() || !s->exp->isConstExp()){
+            return;
+        }
+        loopInitId = s->id;
+        loopInitValue = s->exp->valueSpread();
+        loopInitFor = loop;
+    }
+}
+
+// 尝试展开 while 循环。完全展开时返回 true；
+// 部分展开时先输出每次走多轮的循环，然后返回 false，由调用者照常输出原来的循环处理剩下的轮数
+inline bool dumpUnrolledWhile(StmtAST *loop){
+    if(!unrollLoops){
+        return false;
+    }
+    // 条件：i < N、i <= N、i > N 或 i >= N
+    RelExpAST *rel = singleCompareOf(loop->exp.get());
+    if(rel == nullptr){
+        return false;
+    }
+    char op = rel->opList[0];
+    bool up = op == '<' || op == ',';
+    string iv = scalarVarOf(rel->addexpList[0]);
+    BaseAST *bound = rel->addexpList[1];
+    string boundId = scalarVarOf(bound);
+    bool constBound = bound->isConstExp();
+    if(iv == "" || !isLocalScalar(iv) || (!constBound && (boundId == "" || !isLocalScalar(boundId)))){
+        return false;
+    }
+
+    // 循环体是一个语句块，最后一句是 i = i + c 或 i = i - c
+    LoopBodyInfo info;
+    int cost = astCost(loop->ifstmt.get(), info);
+    StmtAST *body = plainStmtOf(loop->ifstmt.get());
+    if(info.hasJump || info.declared.count(iv) || info.declared.count(boundId) || info.assigned[iv] != 1 || info.assigned.count(boundId)){
+        return false;
+    }
+    if(body == nullptr || body->condition != 2){
+        return false;
+    }
+    auto &items = dynamic_cast<ItemsAST*>(dynamic_cast<BlockAST*>(body->block.get())->items.get())->itemsList;
+    auto last = items.empty() ? nullptr : dynamic_cast<BlockItemAST*>(items.back());
+    StmtAST *inc = (last == nullptr || last->isDecl) ? nullptr : plainStmtOf(last->stmt.get());
+    if(inc == nullptr || inc->condition != 0 || inc->isReturn || inc->id != iv){
+        return false;
+    }
+    AddExpAST *add = asAddExp(inc->exp.get());
+    if(add == nullptr || add->mulexpList.size() != 2 || scalarVarOfMul(add->mulexpList[0]) != iv || !add->mulexpList[1]->isConstExp()){
+        return false;
+    }
+    long long step = add->mulexpList[1]->valueSpread();
+    if(add->opList[0] == '-'){
+        step = -step;
+    }
+    if(step == 0 || (step > 0) != up){
+        return false;
+    }
+
+    // 初值和上界都是常数时求出次数，不多就完全展开
+    if(loopInitFor == loop && loopInitId == iv && constBound){
+        long long init = loopInitValue, n = bound->valueSpread(), s = up ? step : -step, trips = 0;
+        long long dist = up ? n - init : init - n;
+        if(op == '<' || op == '>'){
+            trips = dist > 0 ? (dist + s - 1) / s : 0;
+        }else{
+            trips = dist >= 0 ? dist / s + 1 : 0;
+        }
+        long long final = init + trips * step;
+        if(trips > 0 && trips <= unrollFullTrips && trips * cost <= unrollFullCost && final >= INT32_MIN && final <= INT32_MAX){
+            for(int k = 0; k < trips; k++){
+                loop->ifstmt->Dump();
+            }
+            return true;
+        }
+    }
+
+    int factor = cost <= unrollCost4 ? 4 : cost <= unrollCost2 ? 2 : 1;
+    long long span = (factor - 1) * step; // 一次走 factor 轮时 i 最后一轮的增量
+    if(factor == 1 || span < INT32_MIN || span > INT32_MAX){
+        return false;
+    }
+
+    // -fprofile-use：生成 profile 时展开的循环体很少执行，展开只是增大代码，全部交给原来的循环
+    int base = blockCount;
+    string prefix = "%unroll_" + to_string(base) + "_";
+    auto it = profileCount.find(profileBlockKey("@" + curFuncIdent, prefix + "1"));
+    if(it != profileCount.end() && profileIsCold(it->second * factor)){
+        return false;
+    }
+
+    // 展开的代码先输出到缓冲区，块号改名后再输出
+    stringstream code;
+    streambuf *coutBuf = cout.rdbuf(code.rdbuf());
+
+    // 上界只在进入循环前算一次。i + span op N 等价于 i op N - span，N - span 溢出时不走展开的循环
+    bound->Dump();
+    int n = tempVarCount - 1;
+    int lim = tempVarCount++;
+    if(span > 0){
+        cout << "   %" << lim << " = sub %" << n << ", " << span << endl;
+    }else{
+        cout << "   %" << lim << " = add %" << n << ", " << -span << endl;
+    }
+    int ok = tempVarCount++;
+    cout << "   %" << ok << " = " << (span > 0 ? "lt" : "gt") << " %" << lim << ", %" << n << endl;
+
+    int b0 = blockCount, b1 = b0 + 1, b2 = b0 + 2;
+    blockCount += 3;
+    cout << "   jump %block_" << b0 << endl;
+    cout << "%block_" << b0 << ":" << endl;
+    int i = tempVarCount++;
+    cout << "   %" << i << " = load @" << searchSymbolTable(iv).koopaid << endl;
+    const char *cmp = op == '<' ? "lt" : op == ',' ? "le" : op == '>' ? "gt" : "ge";
+    int c = tempVarCount++;
+    cout << "   %" << c << " = " << cmp << " %" << i << ", %" << lim << endl;
+    cout << "   %" << tempVarCount << " = and %" << c << ", %" << ok << endl;
+    cout << "   br %" << tempVarCount << ", %block_" << b1 << ", %block_" << b2 << endl;
+    tempVarCount++;
+    cout << "%block_" << b1 << ":" << endl;
+    haveBlock = true;
+    for(int k = 0; k < factor; k++){
+        loop->ifstmt->Dump();
+    }
+    if(!haveBlock){
+        cout << "%block_" << blockCount << ":" << endl;
+        blockCount++;
+        haveBlock = true;
+    }
+    cout << "   jump %block_" << b0 << endl;
+    cout << "%block_" << b2 << ":" << endl;
+    cout.rdbuf(coutBuf);
+
+    // 循环体中没有 break、continue 和 return，展开的代码只用到 base 以后的块号
+    string text = code.str();
+    string out;
+    size_t from = 0;
+    for(size_t at = text.find("%block_"); at != string::npos; at = text.find("%block_", from)){
+        size_t end = at + 7;
+        while(end < text.size() && isdigit((unsigned char)text[end])){
+            end++;
+        }
+        out.append(text, from, at - from);
+        out += prefix + to_string(stoi(text.substr(at + 7, end - at - 7)) - base);
+        from = end;
+    }
+    out.append(text, from, string::npos);
+    cout << out;
+    unrollBlockCount += blockCount - base;
+    blockCount = base;
+    return false;
+}
+
+
+
+// 向量化，见 vector.hpp
+// 表达式转成后缀式，数组和标量按第一次出现的顺序编号，常数也当作标量参数
+struct VecBuilder{
+    string iv;
+    vector<string> arrays;  // 数组名
+    vector<string> scalars; // 标量变量名，或者常数的字面值
+    vector<VecNode> expr;
+};
+
+inline int vecIndexOf(vector<string> &list, const string &s){
+    for(int i = 0; i < (int)list.size(); i++){
+        if(list[i] == s){
+            return i;
+        }
+    }
+    list.push_back(s);
+    return list.size() - 1;
+}
+
+// 能整段读写的数组：一维数组，或者 int a[] 参数
+inline bool isVecArray(const entry &e){
+    return e.level != 404 && !e.isConst && ((e.dims.size() == 1 && !e.isPointer) || (e.isPointer && e.dims.empty()));
+}
+
+// a[i] 这样下标恰好是 iv 的数组元素返回数组名，否则返回空串
+inline string vecElementOf(BaseAST *lval, const string &id, const string &iv){
+    auto l = dynamic_cast<LValAST*>(lval);
+    if(l->indexList.size() != 1 || scalarVarOf(asAddExp(l->indexList[0])) != iv){
+        return "";
+    }
+    return isVecArray(searchSymbolTable(id)) ? id : "";
+}
+
+// 只接受 + - * / %、比较、一元的 + - !，操作数是 a[i]、不是 i 的标量变量和常数。嵌套太深时放弃
+inline bool vecExp(BaseAST *node, VecBuilder &b, int depth){
+    if(depth > 64){
+        return false;
+    }
+    if(node->isConstExp()){
+        b.expr.push_back({VEC_SPLAT, vecIndexOf(b.scalars, to_string(node->valueSpread()))});
+        return true;
+    }
+    // 左结合的一串二元运算
+    auto chain = [&](const vector<BaseAST*> &list, auto opName){
+        for(int i = 0; i < (int)list.size(); i++){
+            if(!vecExp(list[i], b, depth + 1)){
+                return false;
+            }
+            if(i > 0){
+                b.expr.push_back({VEC_OP, 0, opName(i - 1)});
+            }
+        }
+        return true;
+    };
+    if(auto p = dynamic_cast<ExpAST*>(node)){
+        return vecExp(p->lorexp.get(), b, depth + 1);
+    }else if(auto p = dynamic_cast<LOrExpAST*>(node)){
+        return p->landexpList.size() == 1 && vecExp(p->landexpList[0], b, depth + 1);
+    }else if(auto p = dynamic_cast<LAndExpAST*>(node)){
+        return p->eqexpList.size() == 1 && vecExp(p->eqexpList[0], b, depth + 1);
+    }else if(auto p = dynamic_cast<EqExpAST*>(node)){
+        return chain(p->relexpList, [&](int i){ return string(p->opList[i] ? "==" : "!="); });
+    }else if(auto p = dynamic_cast<RelExpAST*>(node)){
+        return chain(p->addexpList, [&](int i){
+            char c = p->opList[i];
+            return string(c == '<' ? "<" : c == '>' ? ">" : c == ',' ? "<=" : ">=");
+        });
+    }else if(auto p = dynamic_cast<AddExpAST*>(node)){
+        return chain(p->mulexpList, [&](int i){ return string(1, p->opList[i]); });
+    }else if(auto p = dynamic_cast<MulExpAST*>(node)){
+        return chain(p->unaryexpList, [&](int i){ return string(1, p->opList[i]); });
+    }else if(auto p = dynamic_cast<UnaryExpAST*>(node)){
+        if(p->callName != "" || !vecExp(p->primaryexp.get(), b, depth + 1)){
+            return false;
+        }
+        for(char c : p->unaryopList){
+            if(c != '+'){
+                b.expr.push_back({VEC_OP, 0, c == '-' ? "neg" : "!"});
+            }
+        }
+        return true;
+    }else if(auto p = dynamic_cast<PrimaryExpAST*>(node)){
+        if(!p->isVar){
+            return vecExp(p->exp.get(), b, depth + 1);
+        }
+        if(dynamic_cast<LValAST*>(p->lval.get())->indexList.empty()){
+            entry e = searchSymbolTable(p->id);
+            if(p->id == b.iv || e.level == 404 || !e.dims.empty() || e.isPointer){
+                return false;
+            }
+            b.expr.push_back({VEC_SPLAT, vecIndexOf(b.scalars, p->id)});
+            return true;
+        }
+        string array = vecElementOf(p->lval.get(), p->id, b.iv);
+        if(array == ""){
+            return false;
+        }
+        b.expr.push_back({VEC_LOAD, vecIndexOf(b.arrays, array)});
+        return true;
+    }
+    return false;
+}
+
+// 识别 while(i < N){ a[i] = ...; b[i] = ...; i = i + 1; }，成功时输出对向量循环的调用，i 更新为处理到的下标
+// N 是常数或者标量变量，循环体中除了最后一句都是给 a[i] 赋值。循环体里只写数组，i 和所有标量在循环中都不变
+inline bool dumpVectorizedWhile(StmtAST *loop){
+    if(!vectorizeLoops){
+        return false;
+    }
+    RelExpAST *rel = singleCompareOf(loop->exp.get());
+    if(rel == nullptr || rel->opList[0] != '<'){
+        return false;
+    }
+    VecBuilder b;
+    b.iv = scalarVarOf(rel->addexpList[0]);
+    BaseAST *bound = rel->addexpList[1];
+    string boundId = scalarVarOf(bound);
+    if(b.iv == "" || !isLocalScalar(b.iv) || (!bound->isConstExp() && (boundId == "" || boundId == b.iv))){
+        return false;
+    }
+    if(boundId != ""){
+        entry e = searchSymbolTable(boundId);
+        if(e.level == 404 || !e.dims.empty() || e.isPointer){
+            return false;
+        }
+    }
+
+    StmtAST *body = plainStmtOf(loop->ifstmt.get());
+    if(body == nullptr || body->condition != 2){
+        return false;
+    }
+    auto &items = dynamic_cast<ItemsAST*>(dynamic_cast<BlockAST*>(body->block.get())->items.get())->itemsList;
+    if(items.size() < 2){
+        return false;
+    }
+    VecKernel kernel;
+    for(int i = 0; i < (int)items.size(); i++){
+        auto item = dynamic_cast<BlockItemAST*>(items[i]);
+        StmtAST *s = item->isDecl ? nullptr : plainStmtOf(item->stmt.get());
+        if(s == nullptr || s->condition != 0 || s->isReturn){
+            return false;
+        }
+        if(i == (int)items.size() - 1){
+            // i = i + 1
+            AddExpAST *add = asAddExp(s->exp.get());
+            if(s->id != b.iv || add == nullptr || add->mulexpList.size() != 2 || add->opList[0] != '+' ||
+               scalarVarOfMul(add->mulexpList[0]) != b.iv || !add->mulexpList[1]->isConstExp() || add->mulexpList[1]->valueSpread() != 1){
+                return false;
+            }
+            break;
+        }
+        string array = vecElementOf(s->lval.get(), s->id, b.iv);
+        if(array == ""){
+            return false;
+        }
+        b.expr.clear();
+        if(!vecExp(s->exp.get(), b, 0)){
+            return false;
+        }
+        // 后缀式求值时栈的深度不能超过 v1~v31
+        int top = 0;
+        for(auto &node : b.expr){
+            top += node.kind != VEC_OP ? 1 : (node.op == "neg" || node.op == "!") ? 0 : -1;
+            if(top > 31){
+                return false;
+            }
+        }
+        kernel.stores.push_back({vecIndexOf(b.arrays, array), b.expr});
+    }
+    kernel.arrays = b.arrays.size();
+    kernel.scalars = b.scalars.size();
+    // 不同名字的数组只有在其中之一是参数时才可能重叠
+    for(auto &st : kernel.stores){
+        for(int x = 0; x < kernel.arrays; x++){
+            auto check = make_pair(min(st.array, x), max(st.array, x));
+            if(x != st.array && (searchSymbolTable(b.arrays[st.array]).isPointer || searchSymbolTable(b.arrays[x]).isPointer) &&
+               find(kernel.aliasChecks.begin(), kernel.aliasChecks.end(), check) == kernel.aliasChecks.end()){
+                kernel.aliasChecks.push_back(check);
+            }
+        }
+    }
+
+    vector<string> args;
+    for(auto &name : b.arrays){
+        entry e = searchSymbolTable(name);
+        if(e.isPointer){
+            cout << "   %" << tempVarCount << " = load @" << e.koopaid << endl;
+        }else{
+            cout << "   %" << tempVarCount << " = getelemptr @" << e.koopaid << ", 0" << endl;
+        }
+        args.push_back("%" + to_string(tempVarCount++));
+    }
+    for(auto &name : b.scalars){
+        if(isdigit((unsigned char)name[0]) || name[0] == '-'){
+            args.push_back(name);
+        }else{
+            cout << "   %" << tempVarCount << " = load @" << searchSymbolTable(name).koopaid << endl;
+            args.push_back("%" + to_string(tempVarCount++));
+        }
+    }
+    string ivId = searchSymbolTable(b.iv).koopaid;
+    cout << "   %" << tempVarCount << " = load @" << ivId << endl;
+    args.push_back("%" + to_string(tempVarCount++));
+    bound->Dump();
+    args.push_back("%" + to_string(tempVarCount - 1));
+
+    int id = vecKernels.size();
+    vecKernels.push_back(kernel);
+    cout << "   %" << tempVarCount << " = call @" << vecKernelName(id) << "(";
+    for(int i = 0; i < (int)args.size(); i++){
+        cout << (i == 0 ? "" : ", ") << args[i];
+    }
+    cout << ")" << endl;
+    cout << "   store %" << tempVarCount << ", @" << ivId << endl;
+    tempVarCount++;
+    return true;
+}
+
+
+// 纯函数的编译期求值
+// 返回 int、参数都是标量、不读写全局变量（全局常量除外）、不做输入输出、只调用纯函数（包括自己）的函数是纯函数，
+// 输出函数定义时记下。实参都是常量的调用直接在语法树上解释执行，得到结果就换成常数，也可以用在 const 的初值中
+// 执行有步数、调用深度和局部数组大小的限制，遇到除以零、越界、读未初始化的变量或者超出限制就放弃，照常生成调用
+// 解释器是递归的，所以函数体的语法树太深时不算纯函数；结果按 (函数, 实参) 缓存，递归的 fib 这样的函数也很快
+// -fstream 时纯函数的语法树不释放，后面的函数还要用
+
+inline const int pureMaxDepth = 64;        // 函数体语法树的最大深度
+inline const int pureMaxCalls = 100;       // 解释执行时最深的调用层数
+inline const int pureMaxSteps = 1000000;   // 一次编译期调用最多执行的步数
+inline const long long pureTotalSteps = 50000000; // 整个编译过程最多执行的步数
+inline const int pureMaxArray = 65536;     // 局部数组最多的元素个数
+inline const int pureMaxNest = 32;         // 实参中嵌套的常量调用最多的层数，判断实参是否是常量时会递归
+
+struct PureFunc{
+    FuncDefAST *def;
+    vector<string> params;
+    unordered_map<string, entry> globals; // 函数体中可能用到的全局常量
+};
+inline unordered_map<string, PureFunc> pureFuncs;
+inline map<pair<string, vector<int> >, int> pureCache; // 求值成功的调用
+inline set<pair<string, vector<int> > > pureFailed;     // 求值失败的调用，不再重试
+inline long long pureStepsUsed = 0;
+inline long long pureStepLimit = 0;  // 这次调用的步数用到这里就放弃
+inline int pureNest = 0;
+inline unordered_map<BaseAST*, pair<bool, int> > pureNodeMemo; // 一次判断中已经算过的调用，符号表不会变，避免嵌套的调用被反复求值
+
+// 判断是否是纯函数，是就记下。在全局作用域调用，此时符号表中只有全局变量
+inline void notePureFunc(FuncDefAST *func){
+    if(dynamic_cast<FuncTypeAST*>(func->func_type)->type != 0){
+        return;
+    }
+    PureFunc pf;
+    pf.def = func;
+    unordered_set<string> locals;
+    if(func->params){
+        for(auto i : dynamic_cast<FuncFParamsAST*>(func->params.get())->paramList){
+            auto p = dynamic_cast<FuncFParamAST*>(i);
+            if(p->isArray){
+                return;
+            }
+            pf.params.push_back(p->id);
+            locals.insert(p->id);
+        }
+    }
+    // 先收集所有局部变量的名字，变量引用不是局部变量时必须是全局常量
+    // 局部变量可能和全局常量同名，两个都记下，执行时按作用域找
+    vector<pair<BaseAST*, int> > work(1, make_pair(func->block.get(), 0));
+    vector<BaseAST*> lvals;
+    vector<string> assigned;
+    while(!work.empty()){
+        BaseAST *node = work.back().first;
+        int depth = work.back().second;
+        work.pop_back();
+        if(node == nullptr){
+            continue;
+        }
+        if(depth > pureMaxDepth){
+            return;
+        }
+        auto push = [&](BaseAST *child){
+            work.push_back(make_pair(child, depth + 1));
+        };
+        auto pushList = [&](const vector<BaseAST*> &list){
+            for(auto i : list){
+                push(i);
+            }
+        };
+        if(auto p = dynamic_cast<ExpAST*>(node)){
+            push(p->lorexp.get());
+        }else if(auto p = dynamic_cast<LOrExpAST*>(node)){
+            pushList(p->landexpList);
+        }else if(auto p = dynamic_cast<LAndExpAST*>(node)){
+            pushList(p->eqexpList);
+        }else if(auto p = dynamic_cast<EqExpAST*>(node)){
+            pushList(p->relexpList);
+        }else if(auto p = dynamic_cast<RelExpAST*>(node)){
+            pushList(p->addexpList);
+        }else if(auto p = dynamic_cast<AddExpAST*>(node)){
+            pushList(p->mulexpList);
+        }else if(auto p = dynamic_cast<MulExpAST*>(node)){
+            pushList(p->unaryexpList);
+        }else if(auto p = dynamic_cast<UnaryExpAST*>(node)){
+            if(p->callName == ""){
+                push(p->primaryexp.get());
+            }else if(p->callName == func->ident || pureFuncs.count(p->callName)){
+                pushList(p->argList);
+            }else{
+                return; // 运行时库或者不纯的函数
+            }
+        }else if(auto p = dynamic_cast<PrimaryExpAST*>(node)){
+            if(p->isVar){
+                lvals.push_back(p->lval.get());
+                push(p->lval.get());
+            }else if(!p->isNum){
+                push(p->exp.get());
+            }
+        }else if(auto p = dynamic_cast<LValAST*>(node)){
+            pushList(p->indexList);
+        }else if(auto p = dynamic_cast<ConstExpAST*>(node)){
+            push(p->exp.get());
+        }else if(auto p = dynamic_cast<IfStmtAST*>(node)){
+            push(p->stmt.get());
+        }else if(auto p = dynamic_cast<MatchedStmtAST*>(node)){
+            push(p->stmt.get());
+            push(p->exp.get());
+            push(p->thenstmt.get());
+            push(p->elsestmt.get());
+        }else if(auto p = dynamic_cast<OpenStmtAST*>(node)){
+            push(p->exp.get());
+            push(p->thenstmt.get());
+            push(p->elsestmt.get());
+        }else if(auto p = dynamic_cast<StmtAST*>(node)){
+            push(p->exp.get());
+            push(p->block.get());
+            push(p->ifstmt.get());
+            if(p->condition == 0 && !p->isReturn){
+                assigned.push_back(p->id);
+                push(p->lval.get());
+            }
+        }else if(auto p = dynamic_cast<BlockAST*>(node)){
+            push(p->items.get());
+        }else if(auto p = dynamic_cast<ItemsAST*>(node)){
+            pushList(p->itemsList);
+        }else if(auto p = dynamic_cast<BlockItemAST*>(node)){
+            push(p->isDecl ? p->decl.get() : p->stmt.get());
+        }else if(auto p = dynamic_cast<DeclAST*>(node)){
+            push(p->isConst ? p->constDecl.get() : p->varDecl.get());
+        }else if(auto p = dynamic_cast<ConstDeclAST*>(node)){
+            for(auto i : dynamic_cast<ConstDefinesAST*>(p->constDefines.get())->constdefList){
+                auto def = dynamic_cast<ConstDefAST*>(i);
+                locals.insert(def->id);
+                pushList(def->dimList);
+                vector<BaseAST*> inits(1, def->constInitial.get());
+                while(!inits.empty()){
+                    auto init = dynamic_cast<ConstInitialAST*>(inits.back());
+                    inits.pop_back();
+                    if(init->isList){
+                        inits.insert(inits.end(), init->initList.begin(), init->initList.end());
+                    }else{
+                        push(init->expr());
+                    }
+                }
+            }
+        }else if(auto p = dynamic_cast<VarDeclAST*>(node)){
+            for(auto i : dynamic_cast<VarDefinesAST*>(p->varDefines.get())->vardefList){
+                auto def = dynamic_cast<VarDefAST*>(i);
+                locals.insert(def->id);
+                pushList(def->dimList);
+                vector<BaseAST*> inits;
+                if(def->isInitial){
+                    inits.push_back(def->initial.get());
+                }
+                while(!inits.empty()){
+                    auto init = dynamic_cast<InitialAST*>(inits.back());
+                    inits.pop_back();
+                    if(init->isList){
+                        inits.insert(inits.end(), init->initList.begin(), init->initList.end());
+                    }else{
+                        push(init->expr());
+                    }
+                }
+            }
+        }else{
+            return;
+        }
+    }
+    for(auto &id : assigned){
+        if(!locals.count(id)){
+            return; // 写全局变量
+        }
+    }
+    for(auto i : lvals){
+        const string &id = dynamic_cast<LValAST*>(i)->id;
+        entry e = searchSymbolTable(id);
+        if(e.isConst && !e.isPointer){
+            pf.globals[id] = e;
+        }else if(!locals.count(id)){
+            return; // 读全局变量
+        }
+    }
+    pureFuncs[func->ident] = pf;
+}
+
+
+// 解释执行时的变量：标量的 dims 为空。known 记下每个元素是否已经赋过值
+struct PureVar{
+    vector<int> dims;
+    vector<int> values;
+    vector<char> known;
+};
+
+struct PureFrame{
+    PureFunc *func;
+    vector<unordered_map<string, PureVar> > scopes;
+    int ret = 0;
+};
+
+enum PureResult { PURE_NEXT, PURE_BREAK, PURE_CONTINUE, PURE_RETURN, PURE_FAIL };
+
+inline bool pureCall(const string &name, const vector<int> &args, int &value, int depth);
+
+inline bool pureStep(){
+    pureStepsUsed++;
+    return pureStepsUsed <= pureStepLimit;
+}
+
+inline PureVar* pureFind(PureFrame &f, const string &id){
+    for(int i = f.scopes.size() - 1; i >= 0; i--){
+        auto it = f.scopes[i].find(id);
+        if(it != f.scopes[i].end()){
+            return &it->second;
+        }
+    }
+    return nullptr;
+}
+
+inline bool pureExp(BaseAST *node, PureFrame &f, int depth, int &value);
+
+// 数组元素在行优先展开后的下标，越界返回 -1
+inline int pureIndex(const vector<BaseAST*> &indexList, const vector<int> &dims, PureFrame &f, int depth){
+    if(indexList.size() != dims.size()){
+        return -1;
+    }
+    int idx = 0;
+    for(int i = 0; i < (int)dims.size(); i++){
+        int v;
+        if(!pureExp(indexList[i], f, depth, v) || v < 0 || v >= dims[i]){
+            return -1;
+        }
+        idx = idx * dims[i] + v;
+    }
+    return idx;
+}
+
+inline bool pureLoad(LValAST *lval, PureFrame &f, int depth, int &value){
+    if(PureVar *var = pureFind(f, lval->id)){
+        int idx = pureIndex(lval->indexList, var->dims, f, depth);
+        if(idx < 0 || !var->known[idx]){
+            return false;
+        }
+        value = var->values[idx];
+        return true;
+    }
+    auto it = f.func->globals.find(lval->id);
+    if(it == f.func->globals.end()){
+        return false;
+    }
+    const entry &e = it->second;
+    if(e.dims.empty()){
+        if(!lval->indexList.empty()){
+            return false;
+        }
+        value = e.number;
+        return true;
+    }
+    int idx = pureIndex(lval->indexList, e.dims, f, depth);
+    if(idx < 0){
+        return false;
+    }
+    value = (*e.constValues)[idx];
+    return true;
+}
+
+// 二元运算按 32 位补码回绕，除以零和 INT_MIN / -1 放弃
+inline bool pureBinary(char op, int l, int r, int &value){
+    uint32_t a = l, b = r;
+    switch(op){
+        case '+': value = (int)(a + b); return true;
+        case '-': value = (int)(a - b); return true;
+        case '*': value = (int)(a * b); return true;
+        case '/':
+        case '%':
+            if(r == 0 || (l == INT_MIN && r == -1)){
+                return false;
+            }
+            value = op == '/' ? l / r : l % r;
+            return true;
+        case '<': value = l < r; return true;
+        case '>': value = l > r; return true;
+        case ',': value = l <= r; return true; // RelExpAST 中 "<=" 记作 ','
+        case '.': value = l >= r; return true; // ">=" 记作 '.'
+    }
+    return false;
+}
+
+inline bool pureExp(BaseAST *node, PureFrame &f, int depth, int &value){
+    if(!pureStep()){
+        return false;
+    }
+    // 左结合的一串二元运算
+    auto fold = [&](const vector<BaseAST*> &list, auto opOf){
+        if(!pureExp(list[0], f, depth, value)){
+            return false;
+        }
+        for(int i = 1; i < (int)list.size(); i++){
+            int r;
+            if(!pureExp(list[i], f, depth, r) || !pureBinary(opOf(i - 1), value, r, value)){
+                return false;
+            }
+        }
+        return true;
+    };
+    if(auto p = dynamic_cast<ExpAST*>(node)){
+        return pureExp(p->lorexp.get(), f, depth, value);
+    }else if(auto p = dynamic_cast<ConstExpAST*>(node)){
+        return pureExp(p->exp.get(), f, depth, value);
+    }else if(auto p = dynamic_cast<LOrExpAST*>(node)){
+        if(p->landexpList.size() == 1){
+            return pureExp(p->landexpList[0], f, depth, value);
+        }
+        for(auto i : p->landexpList){
+            if(!pureExp(i, f, depth, value)){
+                return false;
+            }
+            if(value != 0){
+                value = 1;
+                return true;
+            }
+        }
+        value = 0;
+        return true;
+    }else if(auto p = dynamic_cast<LAndExpAST*>(node)){
+        if(p->eqexpList.size() == 1){
+            return pureExp(p->eqexpList[0], f, depth, value);
+        }
+        for(auto i : p->eqexpList){
+            if(!pureExp(i, f, depth, value)){
+                return false;
+            }
+            if(value == 0){
+                return true;
+            }
+        }
+        value = 1;
+        return true;
+    }else if(auto p = dynamic_cast<EqExpAST*>(node)){
+        if(!pureExp(p->relexpList[0], f, depth, value)){
+            return false;
+        }
+        for(int i = 1; i < (int)p->relexpList.size(); i++){
+            int r;
+            if(!pureExp(p->relexpList[i], f, depth, r)){
+                return false;
+            }
+            value = p->opList[i - 1] ? value == r : value != r;
+        }
+        return true;
+    }else if(auto p = dynamic_cast<RelExpAST*>(node)){
+        return fold(p->addexpList, [&](int i){ return p->opList[i]; });
+    }else if(auto p = dynamic_cast<AddExpAST*>(node)){
+        return fold(p->mulexpList, [&](int i){ return p->opList[i]; });
+    }else if(auto p = dynamic_cast<MulExpAST*>(node)){
+        return fold(p->unaryexpList, [&](int i){ return p->opList[i]; });
+    }else if(auto p = dynamic_cast<UnaryExpAST*>(node)){
+        if(p->callName != ""){
+            vector<int> args;
+            for(auto i : p->argList){
+                int v;
+                if(!pureExp(i, f, depth, v)){
+                    return false;
+                }
+                args.push_back(v);
+            }
+            if(!pureCall(p->callName, args, value, depth + 1)){
+                return false;
+            }
+        }else if(!pureExp(p->primaryexp.get(), f, depth, value)){
+            return false;
+        }
+        for(char c : p->unaryopList){
+            if(c == '!'){
+                value = !value;
+            }else if(c == '-'){
+                value = (int)(0u - (uint32_t)value);
+            }
+        }
+        return true;
+    }else if(auto p = dynamic_cast<PrimaryExpAST*>(node)){
+        if(p->isNum){
+            value = p->number;
+            return true;
+        }
+        if(p->isVar){
+            return pureLoad(dynamic_cast<LValAST*>(p->lval.get()), f, depth, value);
+        }
+        return pureExp(p->exp.get(), f, depth, value);
+    }
+    return false;
+}
+
+// 在当前作用域定义一个变量。T 是 InitialAST 或 ConstInitialAST
+template<class T>
+inline bool pureDefine(PureFrame &f, int depth, const string &id, const vector<BaseAST*> &dimList, T *init){
+    PureVar var;
+    long long total = 1;
+    for(auto i : dimList){
+        int d;
+        if(!pureExp(i, f, depth, d) || d <= 0){
+            return false;
+        }
+        var.dims.push_back(d);
+        total *= d;
+        if(total > pureMaxArray){
+            return false;
+        }
+    }
+    var.values.assign(total, 0);
+    var.known.assign(total, init != nullptr && !var.dims.empty()); // 有初值的数组没写到的元素为 0
+    if(init != nullptr){
+        vector<pair<int, BaseAST*> > elems;
+        flattenInitial(init, var.dims, 0, 0, elems);
+        for(auto &p : elems){
+            if(!pureExp(p.second, f, depth, var.values[p.first])){
+                return false;
+            }
+            var.known[p.first] = true;
+        }
+    }
+    f.scopes.back()[id] = var;
+    return true;
+}
+
+inline PureResult pureStmt(BaseAST *node, PureFrame &f, int depth){
+    if(node == nullptr){
+        return PURE_NEXT;
+    }
+    if(!pureStep()){
+        return PURE_FAIL;
+    }
+    if(auto p = dynamic_cast<BlockAST*>(node)){
+        f.scopes.emplace_back();
+        PureResult r = pureStmt(p->items.get(), f, depth);
+        f.scopes.pop_back();
+        return r;
+    }else if(auto p = dynamic_cast<ItemsAST*>(node)){
+        for(auto i : p->itemsList){
+            PureResult r = pureStmt(i, f, depth);
+            if(r != PURE_NEXT){
+                return r;
+            }
+        }
+        return PURE_NEXT;
+    }else if(auto p = dynamic_cast<BlockItemAST*>(node)){
+        return pureStmt(p->isDecl ? p->decl.get() : p->stmt.get(), f, depth);
+    }else if(auto p = dynamic_cast<DeclAST*>(node)){
+        return pureStmt(p->isConst ? p->constDecl.get() : p->varDecl.get(), f, depth);
+    }else if(auto p = dynamic_cast<ConstDeclAST*>(node)){
+        for(auto i : dynamic_cast<ConstDefinesAST*>(p->constDefines.get())->constdefList){
+            auto def = dynamic_cast<ConstDefAST*>(i);
+            if(!pureDefine(f, depth, def->id, def->dimList, dynamic_cast<ConstInitialAST*>(def->constInitial.get()))){
+                return PURE_FAIL;
+            }
+        }
+        return PURE_NEXT;
+    }else if(auto p = dynamic_cast<VarDeclAST*>(node)){
+        for(auto i : dynamic_cast<VarDefinesAST*>(p->varDefines.get())->vardefList){
+            auto def = dynamic_cast<VarDefAST*>(i);
+            auto init = def->isInitial ? dynamic_cast<InitialAST*>(def->initial.get()) : nullptr;
+            if(!pureDefine(f, depth, def->id, def->dimList, init)){
+                return PURE_FAIL;
+            }
+        }
+        return PURE_NEXT;
+    }else if(auto p = dynamic_cast<IfStmtAST*>(node)){
+        return pureStmt(p->stmt.get(), f, depth);
+    }else if(auto p = dynamic_cast<MatchedStmtAST*>(node)){
+        if(!p->isIf){
+            return pureStmt(p->stmt.get(), f, depth);
+        }
+        int cond;
+        if(!pureExp(p->exp.get(), f, depth, cond)){
+            return PURE_FAIL;
+        }
+        return pureStmt(cond ? p->thenstmt.get() : p->elsestmt.get(), f, depth);
+    }else if(auto p = dynamic_cast<OpenStmtAST*>(node)){
+        int cond;
+        if(!pureExp(p->exp.get(), f, depth, cond)){
+            return PURE_FAIL;
+        }
+        if(cond){
+            return pureStmt(p->thenstmt.get(), f, depth);
+        }
+        return p->isElse ? pureStmt(p->elsestmt.get(), f, depth) : PURE_NEXT;
+    }else if(auto p = dynamic_cast<StmtAST*>(node)){
+        switch(p->condition){
+            case 1: return PURE_FAIL; // int 函数中的 return; 返回值不确定
+            case 2: return pureStmt(p->block.get(), f, depth);
+            case 3:{
+                int v;
+                return pureExp(p->exp.get(), f, depth, v) ? PURE_NEXT : PURE_FAIL;
+            }
+            case 4: return PURE_NEXT;
+            case 5:
+                while(true){
+                    int cond;
+                    if(!pureExp(p->exp.get(), f, depth, cond)){
+                        return PURE_FAIL;
+                    }
+                    if(!cond){
+                        return PURE_NEXT;
+                    }
+                    PureResult r = pureStmt(p->ifstmt.get(), f, depth);
+                    if(r == PURE_BREAK){
+                        return PURE_NEXT;
+                    }
+                    if(r == PURE_RETURN || r == PURE_FAIL){
+                        return r;
+                    }
+                }
+            case 6: return PURE_CONTINUE;
+            case 7: return PURE_BREAK;
+        }
+        if(p->isReturn){
+            return pureExp(p->exp.get(), f, depth, f.ret) ? PURE_RETURN : PURE_FAIL;
+        }
+        int v;
+        auto lval = dynamic_cast<LValAST*>(p->lval.get());
+        PureVar *var = pureFind(f, p->id);
+        if(var == nullptr || !pureExp(p->exp.get(), f, depth, v)){
+            return PURE_FAIL;
+        }
+        int idx = pureIndex(lval->indexList, var->dims, f, depth);
+        if(idx < 0){
+            return PURE_FAIL;
+        }
+        var->values[idx] = v;
+        var->known[idx] = true;
+        return PURE_NEXT;
+    }
+    return PURE_FAIL;
+}
+
+inline bool pureCall(const string &name, const vector<int> &args, int &value, int depth){
+    auto key = make_pair(name, args);
+    auto cached = pureCache.find(key);
+    if(cached != pureCache.end()){
+        value = cached->second;
+        return true;
+    }
+    auto it = pureFuncs.find(name);
+    if(it == pureFuncs.end() || it->second.params.size() != args.size() || depth > pureMaxCalls){
+        return false;
+    }
+    PureFrame f;
+    f.func = &it->second;
+    f.scopes.emplace_back();
+    for(int i = 0; i < (int)args.size(); i++){
+        PureVar var;
+        var.values.push_back(args[i]);
+        var.known.push_back(true);
+        f.scopes.back()[f.func->params[i]] = var;
+    }
+    PureResult r = pureStmt(f.func->def->block.get(), f, depth);
+    if(r == PURE_FAIL){
+        return false;
+    }
+    value = r == PURE_RETURN ? f.ret : 0; // 没有 return 就走到末尾时和生成的代码一样返回 0
+    pureCache[key] = value;
+    return true;
+}
+
+// 调用的实参都是常量、函数是纯函数并且在限制内算出了结果时返回 true
+inline bool constCallValue(BaseAST *call, const string &name, const vector<BaseAST*> &args, int &value){
+    if(!pureFuncs.count(name) || pureNest >= pureMaxNest){
+        return false;
+    }
+    auto memo = pureNodeMemo.find(call);
+    if(memo != pureNodeMemo.end()){
+        value = memo->second.second;
+        return memo->second.first;
+    }
+    vector<int> vals;
+    bool ok = true;
+    pureNest++;
+    for(auto i : args){
+        if(!i->isConstExp()){
+            ok = false;
+            break;
+        }
+        vals.push_back(i->valueSpread());
+    }
+    pureNest--;
+    auto key = make_pair(name, vals);
+    if(ok && !pureFailed.count(key)){
+        pureStepLimit = min(pureStepsUsed + pureMaxSteps, pureTotalSteps);
+        ok = pureCall(name, vals, value, 0);
+        if(!ok){
+            pureFailed.insert(key);
+        }
+    }else{
+        ok = false;
+    }
+    if(pureNest == 0){
+        pureNodeMemo.clear();
+    }else{
+        pureNodeMemo[call] = make_pair(ok, value);
+    }
+    return ok;
+}
@@ -0,0 +1,554 @@
+#pragma once
+#include <iostream>
+#include <cassert>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+// 把 riscv.hpp 生成的 asmLines 直接编码成 RV32IM 的 ELF 可重定位目标文件（-obj 模式）
+// 节、符号表、字符串表和重定位的排布与汇编器处理 -riscv 输出的结果一致，输出逐字节相同：
+// 节按出现顺序排列（.text 总在最前），每个节的 .rela 紧跟其后；符号按第一次出现的顺序，局部符号在前；
+// 字符串表按反转后的字符串降序排列，并合并相同的后缀
+
+
+// ELF 中用到的常量
+static const int SHT_PROGBITS = 1, SHT_SYMTAB = 2, SHT_STRTAB = 3, SHT_RELA = 4, SHT_NOBITS = 8;
+static const int SHF_WRITE = 1, SHF_ALLOC = 2, SHF_EXECINSTR = 4, SHF_INFO_LINK = 0x40;
+static const int R_RISCV_CALL = 18, R_RISCV_PCREL_HI20 = 23, R_RISCV_PCREL_LO12_I = 24;
+
+
+struct ElfReloc{
+    uint32_t offset;
+    string symbol;
+    int type;
+};
+
+struct ElfSection{
+    string name;
+    int type, flags;
+    uint32_t align = 1;
+    vector<uint8_t> data;
+    uint32_t size = 0; // .bss 没有数据，只记录大小
+    vector<ElfReloc> relocs;
+};
+
+struct ElfSymbol{
+    string name;
+    bool global = false;
+    int section = -1; // 所在节在 elfSections 中的下标，-1 表示未定义
+    uint32_t value = 0;
+};
+
+static vector<ElfSection> elfSections;
+static vector<ElfSymbol> elfSymbols;
+static unordered_map<string, int> elfSymbolIndex;
+
+
+// 以 .L 开头的是汇编器的临时标号，除非被重定位引用，否则不进入符号表
+static bool isTempLabel(const string &name){
+    return name.size() >= 2 && name[0] == '.' && name[1] == 'L';
+}
+
+// 第一次提到一个符号时登记它，符号表的顺序就是登记的顺序
+static ElfSymbol& elfSymbol(const string &name){
+    if(!elfSymbolIndex.count(name)){
+        elfSymbolIndex[name] = elfSymbols.size();
+        ElfSymbol sym;
+        sym.name = name;
+        elfSymbols.push_back(sym);
+    }
+    return elfSymbols[elfSymbolIndex[name]];
+}
+
+static int sectionIndex(const string &name){
+    for(int i = 0; i < (int)elfSections.size(); i++){
+        if(elfSections[i].name == name){
+            return i;
+        }
+    }
+    ElfSection sec;
+    sec.name = name;
+    if(name == ".text"){
+        sec.type = SHT_PROGBITS;
+        sec.flags = SHF_ALLOC | SHF_EXECINSTR;
+        sec.align = 4;
+    }else if(name == ".bss"){
+        sec.type = SHT_NOBITS;
+        sec.flags = SHF_ALLOC | SHF_WRITE;
+    }else{
+        sec.type = SHT_PROGBITS;
+        sec.flags = SHF_ALLOC | SHF_WRITE;
+    }
+    elfSections.push_back(sec);
+    return elfSections.size() - 1;
+}
+
+
+static int regNum(const string &reg){
+    static const unordered_map<string, int> abi = {
+        {"zero", 0}, {"ra", 1}, {"sp", 2}, {"gp", 3}, {"tp", 4}, {"t0", 5}, {"t1", 6}, {"t2", 7},
+        {"s0", 8}, {"fp", 8}, {"s1", 9}, {"a0", 10}, {"a1", 11}, {"a2", 12}, {"a3", 13}, {"a4", 14},
+        {"a5", 15}, {"a6", 16}, {"a7", 17}, {"s2", 18}, {"s3", 19}, {"s4", 20}, {"s5", 21}, {"s6", 22},
+        {"s7", 23}, {"s8", 24}, {"s9", 25}, {"s10", 26}, {"s11", 27}, {"t3", 28}, {"t4", 29}, {"t5", 30}, {"t6", 31}
+    };
+    if(abi.count(reg)){
+        return abi.at(reg);
+    }
+    assert(reg[0] == 'x');
+    return stoi(reg.substr(1));
+}
+
+// "imm(reg)" 形式的地址
+static void memOperand(const string &s, int &imm, int &reg){
+    size_t l = s.find('(');
+    imm = stoi(s.substr(0, l));
+    reg = regNum(s.substr(l + 1, s.size() - l - 2));
+}
+
+
+static uint32_t rType(int funct7, int rs2, int rs1, int funct3, int rd, int opcode){
+    return (funct7 << 25) | (rs2 << 20) | (rs1 << 15) | (funct3 << 12) | (rd << 7) | opcode;
+}
+
+static uint32_t iType(int imm, int rs1, int funct3, int rd, int opcode){
+    return ((imm & 0xfff) << 20) | (rs1 << 15) | (funct3 << 12) | (rd << 7) | opcode;
+}
+
+static uint32_t sType(int imm, int rs2, int rs1, int funct3, int opcode){
+    return (((imm >> 5) & 0x7f) << 25) | (rs2 << 20) | (rs1 << 15) | (funct3 << 12) | ((imm & 0x1f) << 7) | opcode;
+}
+
+static uint32_t bType(int imm, int rs2, int rs1, int funct3){
+    return (((imm >> 12) & 1) << 31) | (((imm >> 5) & 0x3f) << 25) | (rs2 << 20) | (rs1 << 15) | (funct3 << 12)
+         | (((imm >> 1) & 0xf) << 8) | (((imm >> 11) & 1) << 7) | 0x63;
+}
+
+static uint32_t uType(int imm20, int rd, int opcode){
+    return ((imm20 & 0xfffff) << 12) | (rd << 7) | opcode;
+}
+
+static uint32_t jType(int imm, int rd){
+    return (((imm >> 20) & 1) << 31) | (((imm >> 1) & 0x3ff) << 21) | (((imm >> 11) & 1) << 20)
+         | (((imm >> 12) & 0xff) << 12) | (rd << 7) | 0x6f;
+}
+
+
+// 编码一条指令（伪指令按汇编器的方式展开），pc 是它在 .text 中的偏移
+static vector<uint32_t> encodeInst(const AsmLine &line, uint32_t pc, const unordered_map<string, uint32_t> &labels, vector<ElfReloc> &relocs){
+    static const unordered_map<string, pair<int, int> > rOps = { // funct7, funct3
+        {"add", {0, 0}}, {"sub", {0x20, 0}}, {"sll", {0, 1}}, {"slt", {0, 2}}, {"sltu", {0, 3}},
+        {"xor", {0, 4}}, {"srl", {0, 5}}, {"sra", {0x20, 5}}, {"or", {0, 6}}, {"and", {0, 7}},
+        {"mul", {1, 0}}, {"mulh", {1, 1}}, {"mulhsu", {1, 2}}, {"mulhu", {1, 3}},
+        {"div", {1, 4}}, {"divu", {1, 5}}, {"rem", {1, 6}}, {"remu", {1, 7}}
+    };
+    static const unordered_map<string, int> iOps = {
+        {"addi", 0}, {"slti", 2}, {"sltiu", 3}, {"xori", 4}, {"ori", 6}, {"andi", 7}
+    };
+    static const unordered_map<string, int> shiftOps = {{"slli", 1}, {"srli", 5}, {"srai", 5}};
+    static const unordered_map<string, int> branchOps = {
+        {"beq", 0}, {"bne", 1}, {"blt", 4}, {"bge", 5}, {"bltu", 6}, {"bgeu", 7}
+    };
+    const string &op = line.op;
+    const vector<string> &a = line.args;
+    auto target = [&](const string &label){
+        assert(labels.count(label));
+        return (int)(labels.at(label) - pc);
+    };
+
+    if(rOps.count(op)){
+        return {rType(rOps.at(op).first, regNum(a[2]), regNum(a[1]), rOps.at(op).second, regNum(a[0]), 0x33)};
+    }
+    if(iOps.count(op)){
+        return {iType(stoi(a[2]), regNum(a[1]), iOps.at(op), regNum(a[0]), 0x13)};
+    }
+    if(shiftOps.count(op)){
+        int imm = stoi(a[2]) | (op == "srai" ? 0x400 : 0);
+        return {iType(imm, regNum(a[1]), shiftOps.at(op), regNum(a[0]), 0x13)};
+    }
+    if(branchOps.count(op)){
+        return {bType(target(a[2]), regNum(a[1]), regNum(a[0]), branchOps.at(op))};
+    }
+    // 和 0 比较或者交换操作数的分支伪指令
+    if(op == "beqz" || op == "bnez" || op == "bltz" || op == "bgez"){
+        int funct3 = op == "beqz" ? 0 : op == "bnez" ? 1 : op == "bltz" ? 4 : 5;
+        return {bType(target(a[1]), 0, regNum(a[0]), funct3)};
+    }
+    if(op == "blez" || op == "bgtz"){
+        return {bType(target(a[1]), regNum(a[0]), 0, op == "blez" ? 5 : 4)};
+    }
+    if(op == "bgt" || op == "ble" || op == "bgtu" || op == "bleu"){
+        int funct3 = op == "bgt" ? 4 : op == "ble" ? 5 : op == "bgtu" ? 6 : 7;
+        return {bType(target(a[2]), regNum(a[0]), regNum(a[1]), funct3)};
+    }
+    if(op == "lw" || op == "lh" || op == "lb" || op == "lhu" || op == "lbu"){
+        int imm, base;
+        memOperand(a[1], imm, base);
+        int funct3 = op == "lb" ? 0 : op == "lh" ? 1 : op == "lw" ? 2 : op == "lbu" ? 4 : 5;
+        return {iType(imm, base, funct3, regNum(a[0]), 0x03)};
+    }
+    if(op == "sw" || op == "sh" || op == "sb"){
+        int imm, base;
+        memOperand(a[1], imm, base);
+        int funct3 = op == "sb" ? 0 : op == "sh" ? 1 : 2;
+        return {sType(imm, regNum(a[0]), base, funct3, 0x23)};
+    }
+    if(op == "lui" || op == "auipc"){
+        return {uType(stoi(a[1]), regNum(a[0]), op == "lui" ? 0x37 : 0x17)};
+    }
+    if(op == "li"){
+        int imm = stoi(a[1]), rd = regNum(a[0]);
+        if(imm >= -2048 && imm < 2048){
+            return {iType(imm, 0, 0, rd, 0x13)};
+        }
+        int lo = (imm << 20) >> 20; // 低 12 位符号扩展
+        int hi = (int)(((uint32_t)imm - (uint32_t)lo) >> 12);
+        if(lo == 0){
+            return {uType(hi, rd, 0x37)};
+        }
+        return {uType(hi, rd, 0x37), iType(lo, rd, 0, rd, 0x13)};
+    }
+    if(op == "mv"){
+        return {iType(0, regNum(a[1]), 0, regNum(a[0]), 0x13)};
+    }
+    if(op == "not"){
+        return {iType(-1, regNum(a[1]), 4, regNum(a[0]), 0x13)};
+    }
+    if(op == "neg"){
+        return {rType(0x20, regNum(a[1]), 0, 0, regNum(a[0]), 0x33)};
+    }
+    if(op == "seqz"){
+        return {iType(1, regNum(a[1]), 3, regNum(a[0]), 0x13)};
+    }
+    if(op == "snez"){
+        return {rType(0, regNum(a[1]), 0, 3, regNum(a[0]), 0x33)};
+    }
+    if(op == "sltz"){
+        return {rType(0, 0, regNum(a[1]), 2, regNum(a[0]), 0x33)};
+    }
+    if(op == "sgtz"){
+        return {rType(0, regNum(a[1]), 0, 2, regNum(a[0]), 0x33)};
+    }
+    if(op == "sgt" || op == "sgtu"){
+        return {rType(0, regNum(a[1]), regNum(a[2]), op == "sgt" ? 2 : 3, regNum(a[0]), 0x33)};
+    }
+    if(op == "nop"){
+        return {iType(0, 0, 0, 0, 0x13)};
+    }
+    if(op == "j"){
+        return {jType(target(a[0]), 0)};
+    }
+    if(op == "jal"){
+        return a.size() == 1 ? vector<uint32_t>{jType(target(a[0]), 1)} : vector<uint32_t>{jType(target(a[1]), regNum(a[0]))};
+    }
+    if(op == "jr"){
+        return {iType(0, regNum(a[0]), 0, 0, 0x67)};
+    }
+    if(op == "jalr"){
+        int imm, base;
+        memOperand(a[1], imm, base);
+        return {iType(imm, base, 0, regNum(a[0]), 0x67)};
+    }
+    if(op == "ret"){
+        return {iType(0, 1, 0, 0, 0x67)};
+    }
+    if(op == "call" || op == "tail"){
+        // auipc + jalr，用 ra（call）或 t1（tail）做中转，地址由链接器填
+        int rd = op == "call" ? 1 : 6;
+        elfSymbol(a[0]);
+        relocs.push_back({pc, a[0], R_RISCV_CALL});
+        return {uType(0, rd, 0x17), iType(0, rd, 0, op == "call" ? 1 : 0, 0x67)};
+    }
+    if(op == "la"){
+        // auipc 处放一个临时标号，addi 的低 12 位重定位引用这个标号
+        static int pcrelCount = 0;
+        string hiLabel = ".Lpcrel_hi" + to_string(pcrelCount++);
+        ElfSymbol &hi = elfSymbol(hiLabel);
+        hi.section = sectionIndex(".text");
+        hi.value = pc;
+        elfSymbol(a[1]);
+        relocs.push_back({pc, a[1], R_RISCV_PCREL_HI20});
+        relocs.push_back({pc + 4, hiLabel, R_RISCV_PCREL_LO12_I});
+        int rd = regNum(a[0]);
+        return {uType(0, rd, 0x17), iType(0, rd, 0, rd, 0x13)};
+    }
+    // RVV（-march=rv32imv）：vsetvli、单位步长的 32 位访存和几条整数运算，只有 vmerge 用 v0 做掩码
+    static const unordered_map<string, pair<int, int> > vOps = { // funct6, funct3
+        {"vadd.vv", {0x00, 0}}, {"vsub.vv", {0x02, 0}}, {"vmseq.vv", {0x18, 0}}, {"vmsne.vv", {0x19, 0}},
+        {"vmslt.vv", {0x1b, 0}}, {"vmsle.vv", {0x1d, 0}}, {"vmul.vv", {0x25, 2}}, {"vdiv.vv", {0x21, 2}},
+        {"vrem.vv", {0x23, 2}}, {"vrsub.vi", {0x03, 3}}, {"vmseq.vi", {0x18, 3}}, {"vmerge.vim", {0x17, 3}}
+    };
+    auto vreg = [](const string &r){
+        return stoi(r.substr(1));
+    };
+    if(vOps.count(op)){
+        int funct3 = vOps.at(op).second;
+        int src1 = funct3 == 3 ? stoi(a[2]) & 0x1f : vreg(a[2]);
+        int vm = op == "vmerge.vim" ? 0 : 1;
+        return {rType((vOps.at(op).first << 1) | vm, vreg(a[1]), src1, funct3, vreg(a[0]), 0x57)};
+    }
+    if(op == "vmv.v.x" || op == "vmv.v.i"){
+        int src1 = op == "vmv.v.x" ? regNum(a[1]) : stoi(a[1]) & 0x1f;
+        return {rType((0x17 << 1) | 1, 0, src1, op == "vmv.v.x" ? 4 : 3, vreg(a[0]), 0x57)};
+    }
+    if(op == "vsetvli"){
+        // vtype：sew 在 [5:3]，lmul 在 [2:0]，ta、ma 分别是第 6、7 位
+        static const unordered_map<string, int> vtype = {
+            {"e8", 0 << 3}, {"e16", 1 << 3}, {"e32", 2 << 3}, {"m1", 0}, {"m2", 1}, {"m4", 2}, {"m8", 3},
+            {"ta", 1 << 6}, {"tu", 0}, {"ma", 1 << 7}, {"mu", 0}
+        };
+        int zimm = 0;
+        for(int i = 2; i < (int)a.size(); i++){
+            zimm |= vtype.at(a[i]);
+        }
+        return {iType(zimm, regNum(a[1]), 7, regNum(a[0]), 0x57)};
+    }
+    if(op == "vle32.v" || op == "vse32.v"){
+        int base = regNum(a[1].substr(1, a[1].size() - 2));
+        return {rType(1, 0, base, 6, vreg(a[0]), op == "vle32.v" ? 0x07 : 0x27)};
+    }
+    cerr << "cannot encode instruction " << op << endl;
+    assert(false);
+    return {};
+}
+
+
+static void put32(vector<uint8_t> &out, uint32_t v){
+    for(int i = 0; i < 4; i++){
+        out.push_back((v >> (8 * i)) & 0xff);
+    }
+}
+
+static void put16(vector<uint8_t> &out, uint16_t v){
+    out.push_back(v & 0xff);
+    out.push_back(v >> 8);
+}
+
+
+// 字符串表：按反转后的字符串降序排列，后一个字符串是前一个的后缀时直接复用
+static vector<uint8_t> buildStrtab(vector<string> names, unordered_map<string, uint32_t> &offset){
+    sort(names.begin(), names.end());
+    names.erase(unique(names.begin(), names.end()), names.end());
+    sort(names.begin(), names.end(), [](const string &a, const string &b){
+        return string(a.rbegin(), a.rend()) > string(b.rbegin(), b.rend());
+    });
+    vector<uint8_t> table(1, 0);
+    string previous;
+    for(auto &s : names){
+        if(previous.size() >= s.size() && previous.compare(previous.size() - s.size(), s.size(), s) == 0){
+            offset[s] = table.size() - 1 - s.size();
+            continue;
+        }
+        offset[s] = table.size();
+        table.insert(table.end(), s.begin(), s.end());
+        table.push_back(0);
+        previous = s;
+    }
+    return table;
+}
+
+
+// 输出目标文件
+static void dumpObject(){
+    elfSections.clear();
+    elfSymbols.clear();
+    elfSymbolIndex.clear();
+
+    // 第一遍：确定所有标号在各自节中的偏移
+    unordered_map<string, uint32_t> labels;
+    {
+        unordered_map<string, uint32_t> sizes;
+        string cur = ".text";
+        for(auto &line : asmLines){
+            if(line.kind == AsmLine::LABEL){
+                labels[line.op] = sizes[cur];
+            }else if(line.kind == AsmLine::INST){
+                sizes[cur] += instSize(line);
+            }else if(line.op == ".text" || line.op == ".data" || line.op == ".bss"){
+                cur = line.op;
+            }else if(line.op == ".word"){
+                sizes[cur] += 4;
+            }else if(line.op == ".zero"){
+                sizes[cur] += stoi(line.args[0]);
+            }else if(line.op == ".align"){
+                uint32_t align = 1u << stoi(line.args[0]);
+                sizes[cur] = (sizes[cur] + align - 1) / align * align;
+            }
+        }
+    }
+
+    // 第二遍：编码指令和数据，按出现顺序登记符号
+    int cur = sectionIndex(".text");
+    for(auto &line : asmLines){
+        ElfSection &sec = elfSections[cur];
+        uint32_t pos = sec.type == SHT_NOBITS ? sec.size : sec.data.size();
+        if(line.kind == AsmLine::LABEL){
+            if(!isTempLabel(line.op)){
+                ElfSymbol &sym = elfSymbol(line.op);
+                sym.section = cur;
+                sym.value = pos;
+            }
+        }else if(line.kind == AsmLine::INST){
+            vector<ElfReloc> relocs;
+            vector<uint32_t> words = encodeInst(line, pos, labels, relocs);
+            for(auto w : words){
+                put32(elfSections[cur].data, w);
+            }
+            for(auto &r : relocs){
+                elfSections[cur].relocs.push_back(r);
+            }
+        }else if(line.op == ".text" || line.op == ".data" || line.op == ".bss"){
+            cur = sectionIndex(line.op);
+        }else if(line.op == ".globl"){
+            elfSymbol(line.args[0]).global = true;
+        }else if(line.op == ".word"){
+            put32(sec.data, stoi(line.args[0]));
+        }else if(line.op == ".zero" || line.op == ".align"){
+            uint32_t n = stoi(line.args[0]);
+            if(line.op == ".align"){
+                uint32_t align = 1u << n;
+                sec.align = max(sec.align, align);
+                n = (align - pos % align) % align;
+            }
+            if(sec.type == SHT_NOBITS){
+                sec.size += n;
+            }else{
+                sec.data.insert(sec.data.end(), n, 0);
+            }
+        }
+    }
+
+    // 节表：空节、.strtab、各个节及其重定位节、.symtab
+    struct Header{
+        string name;
+        uint32_t type, flags, offset, size, link, info, align, entsize;
+    };
+    vector<Header> headers(1);
+    headers.push_back({".strtab", SHT_STRTAB, 0, 0, 0, 0, 0, 1, 0});
+    vector<int> secHeader(elfSections.size()), relaHeader(elfSections.size(), -1);
+    for(int i = 0; i < (int)elfSections.size(); i++){
+        auto &sec = elfSections[i];
+        secHeader[i] = headers.size();
+        uint32_t size = sec.type == SHT_NOBITS ? sec.size : sec.data.size();
+        headers.push_back({sec.name, (uint32_t)sec.type, (uint32_t)sec.flags, 0, size, 0, 0, sec.align, 0});
+        if(!sec.relocs.empty()){
+            relaHeader[i] = headers.size();
+            headers.push_back({".rela" + sec.name, SHT_RELA, SHF_INFO_LINK, 0, 12 * (uint32_t)sec.relocs.size(), 0, (uint32_t)secHeader[i], 4, 12});
+        }
+    }
+    int symtabHeader = headers.size();
+    headers.push_back({".symtab", SHT_SYMTAB, 0, 0, 0, 1, 0, 4, 16});
+    for(int i = 0; i < (int)elfSections.size(); i++){
+        if(relaHeader[i] != -1){
+            headers[relaHeader[i]].link = symtabHeader;
+        }
+    }
+
+    // 符号表：未定义的符号都是全局的；临时标号只保留被重定位引用的（la 的 .Lpcrel_hi）
+    vector<int> order;
+    for(int pass = 0; pass < 2; pass++){
+        for(int i = 0; i < (int)elfSymbols.size(); i++){
+            bool global = elfSymbols[i].global || elfSymbols[i].section == -1;
+            if(global == (pass == 1)){
+                order.push_back(i);
+            }
+        }
+    }
+    unordered_map<string, int> symIndex;
+    int firstGlobal = 1; // 第一个全局符号的下标，前面是空符号和局部符号
+    for(int i = 0; i < (int)order.size(); i++){
+        auto &sym = elfSymbols[order[i]];
+        symIndex[sym.name] = i + 1;
+        if(!sym.global && sym.section != -1){
+            firstGlobal++;
+        }
+    }
+    headers[symtabHeader].info = firstGlobal;
+    headers[symtabHeader].size = 16 * (order.size() + 1);
+
+    vector<string> names;
+    for(int i = 1; i < (int)headers.size(); i++){
+        names.push_back(headers[i].name);
+    }
+    for(auto &sym : elfSymbols){
+        names.push_back(sym.name);
+    }
+    unordered_map<string, uint32_t> strOffset;
+    vector<uint8_t> strtab = buildStrtab(names, strOffset);
+    headers[1].size = strtab.size();
+
+    // 写文件：ELF 头、各节数据、.symtab、重定位节、.strtab、节头表
+    vector<uint8_t> out(52, 0);
+    auto alignTo = [&](uint32_t align){
+        while(out.size() % align != 0){
+            out.push_back(0);
+        }
+    };
+    for(int i = 0; i < (int)elfSections.size(); i++){
+        alignTo(elfSections[i].align);
+        headers[secHeader[i]].offset = out.size();
+        out.insert(out.end(), elfSections[i].data.begin(), elfSections[i].data.end());
+    }
+    alignTo(4);
+    headers[symtabHeader].offset = out.size();
+    out.insert(out.end(), 16, 0);
+    for(int i : order){
+        auto &sym = elfSymbols[i];
+        put32(out, strOffset[sym.name]);
+        put32(out, sym.value);
+        put32(out, 0);
+        out.push_back(sym.global || sym.section == -1 ? 0x10 : 0x00); // STB_GLOBAL / STB_LOCAL，STT_NOTYPE
+        out.push_back(0);
+        put16(out, sym.section == -1 ? 0 : secHeader[sym.section]);
+    }
+    for(int i = 0; i < (int)elfSections.size(); i++){
+        if(relaHeader[i] == -1){
+            continue;
+        }
+        alignTo(4);
+        headers[relaHeader[i]].offset = out.size();
+        for(auto &r : elfSections[i].relocs){
+            put32(out, r.offset);
+            put32(out, (symIndex[r.symbol] << 8) | r.type);
+            put32(out, 0);
+        }
+    }
+    headers[1].offset = out.size();
+    out.insert(out.end(), strtab.begin(), strtab.end());
+    alignTo(4);
+    uint32_t shoff = out.size();
+    for(auto &h : headers){
+        put32(out, h.name.empty() ? 0 : strOffset[h.name]);
+        put32(out, h.type);
+        put32(out, h.flags);
+        put32(out, 0);
+        put32(out, h.offset);
+        put32(out, h.size);
+        put32(out, h.link);
+        put32(out, h.info);
+        put32(out, h.align);
+        put32(out, h.entsize);
+    }
+
+    // ELF 头
+    vector<uint8_t> ehdr = {0x7f, 'E', 'L', 'F', 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+    put16(ehdr, 1);      // ET_REL
+    put16(ehdr, 243);    // EM_RISCV
+    put32(ehdr, 1);
+    put32(ehdr, 0);      // e_entry
+    put32(ehdr, 0);      // e_phoff
+    put32(ehdr, shoff);
+    put32(ehdr, 0);      // e_flags
+    put16(ehdr, 52);
+    put16(ehdr, 0);
+    put16(ehdr, 0);
+    put16(ehdr, 40);
+    put16(ehdr, headers.size());
+    put16(ehdr, 1);      // .strtab 同时也是节名字符串表
+    copy(ehdr.begin(), ehdr.end(), out.begin());
+
+    cout.write(reinterpret_cast<const char*>(out.data()), out.size());
+}
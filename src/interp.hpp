@@ -0,0 +1,590 @@
+#pragma once
+#include <iostream>
+#include <fstream>
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <algorithm>
+#include "koopa.h"
+#include "profile.hpp"
+
+using namespace std;
+
+// Koopa IR 解释器（-run 模式），用来在没有 RISC-V 机器的情况下衡量生成代码的质量
+// raw program 先被翻译成紧凑的指令数组：每个值在函数的寄存器文件中有一个固定位置，
+// 常量和全局变量地址预先放在寄存器文件开头，每条指令直接保存处理它的标签地址（direct threading）
+// 运行时只统计基本块的执行次数，各类指令数和每个函数执行的指令数在最后由块的静态内容推算出来
+
+
+// 内存以字为单位，指针就是字的下标。全局变量放在开头，后面是各个函数的栈帧
+static vector<int32_t> runMemory;
+
+
+enum RunOp{
+    RUN_ALLOC, RUN_LOAD, RUN_STORE, RUN_STORE_ZERO, RUN_GETPTR,
+    RUN_NE, RUN_EQ, RUN_GT, RUN_LT, RUN_GE, RUN_LE, RUN_ADD, RUN_SUB, RUN_MUL, RUN_DIV, RUN_MOD,
+    RUN_AND, RUN_OR, RUN_XOR, RUN_SHL, RUN_SHR, RUN_SAR,
+    RUN_BR, RUN_JUMP, RUN_CALL, RUN_CALL_NATIVE, RUN_RET, RUN_RET_VOID,
+    RUN_OP_COUNT
+};
+
+static const char *runOpName[RUN_OP_COUNT] = {
+    "alloc", "load", "store", "store", "getptr",
+    "ne", "eq", "gt", "lt", "ge", "le", "add", "sub", "mul", "div", "mod",
+    "and", "or", "xor", "shl", "shr", "sar",
+    "br", "jump", "call", "call", "ret", "ret"
+};
+
+
+// 译码后的指令
+struct RunInst{
+    void *handler;
+    int dst, a, b;           // 结果和操作数在寄存器文件中的位置，没有时为 -1
+    int size;                // getptr 的元素大小、store zeroinit 的大小（字）
+    int target, falseTarget; // 跳转目标在函数指令数组中的下标
+    int block, falseBlock;   // 跳转目标的全局块号，用于计数
+    int callee;              // 被调用函数的下标，或者库函数编号
+    int argBegin, argCount;  // 实参在 runArgs 中的位置
+};
+
+struct RunFunc{
+    string name;
+    vector<RunInst> insts;
+    vector<int32_t> initRegs;           // 寄存器文件开头的常量和全局变量地址
+    vector<pair<int, int> > allocs;     // alloc 的寄存器位置和在栈帧中的偏移
+    vector<int> paramRegs;
+    int numRegs = 0;
+    int frameWords = 0;
+    int entryBlock = 0;
+};
+
+struct RunBlock{
+    string func, name;
+    vector<int> ops; // 块中每条 koopa 指令的种类，包括 alloc
+};
+
+static vector<RunFunc> runFuncs;
+static vector<RunBlock> runBlocks;
+static vector<int> runArgs;
+static vector<int64_t> runBlockCount;
+
+
+// SysY 运行时库，以及 -fprofile-generate 用到的 __prof_dump。没有函数体的函数按名字在这里找
+static const char *runNatives[] = {"getint", "getch", "getarray", "putint", "putch", "putarray", "starttime", "stoptime", "__prof_dump"};
+
+static int32_t runNative(int id, const int32_t *args){
+    int32_t x = 0;
+    switch(id){
+        case 0:
+            if(scanf("%d", &x) != 1){
+                x = 0;
+            }
+            return x;
+        case 1:
+            return getchar();
+        case 2:{
+            int n = 0;
+            if(scanf("%d", &n) != 1){
+                return 0;
+            }
+            for(int i = 0; i < n; i++){
+                if(scanf("%d", &runMemory[args[0] + i]) != 1){
+                    break;
+                }
+            }
+            return n;
+        }
+        case 3:
+            printf("%d", args[0]);
+            return 0;
+        case 4:
+            putchar(args[0]);
+            return 0;
+        case 5:
+            printf("%d:", args[0]);
+            for(int i = 0; i < args[0]; i++){
+                printf(" %d", runMemory[args[1] + i]);
+            }
+            putchar('\n');
+            return 0;
+        case 8:
+            profileWrite(&runMemory[args[0]], args[1], (const char *)&runMemory[args[2]]);
+            return 0;
+        default:
+            return 0;
+    }
+}
+
+
+static int runTypeWords(koopa_raw_type_t ty){
+    if(ty->tag == KOOPA_RTT_ARRAY){
+        return ty->data.array.len * runTypeWords(ty->data.array.base);
+    }
+    return 1;
+}
+
+// 全局变量的初值写进内存
+static void runInitGlobal(koopa_raw_value_t init, int addr){
+    if(init->kind.tag == KOOPA_RVT_INTEGER){
+        runMemory[addr] = init->kind.data.integer.value;
+    }else if(init->kind.tag == KOOPA_RVT_AGGREGATE){
+        auto &elems = init->kind.data.aggregate.elems;
+        for(size_t i = 0; i < elems.len; i++){
+            auto e = reinterpret_cast<koopa_raw_value_t>(elems.buffer[i]);
+            runInitGlobal(e, addr);
+            addr += runTypeWords(e->ty);
+        }
+    }
+}
+
+
+static int32_t runProgram(void ***table);
+
+// 把 raw program 译成 runFuncs
+static void runDecode(const koopa_raw_program_t &raw){
+    void **table;
+    runProgram(&table);
+
+    unordered_map<koopa_raw_value_t, int> globalAddr;
+    for(size_t i = 0; i < raw.values.len; i++){
+        auto g = reinterpret_cast<koopa_raw_value_t>(raw.values.buffer[i]);
+        int addr = runMemory.size();
+        runMemory.resize(addr + runTypeWords(g->ty->data.pointer.base));
+        runInitGlobal(g->kind.data.global_alloc.init, addr);
+        globalAddr[g] = addr;
+    }
+
+    unordered_map<koopa_raw_function_t, int> funcIndex;
+    for(size_t i = 0; i < raw.funcs.len; i++){
+        auto f = reinterpret_cast<koopa_raw_function_t>(raw.funcs.buffer[i]);
+        funcIndex[f] = i;
+    }
+    runFuncs.resize(raw.funcs.len);
+
+    for(size_t fi = 0; fi < raw.funcs.len; fi++){
+        auto f = reinterpret_cast<koopa_raw_function_t>(raw.funcs.buffer[fi]);
+        RunFunc &rf = runFuncs[fi];
+        rf.name = f->name + 1;
+        if(f->bbs.len == 0){
+            continue;
+        }
+
+        // 分配寄存器文件：先是常量和全局变量地址，然后是参数、alloc 和指令结果
+        unordered_map<koopa_raw_value_t, int> reg;
+        unordered_map<int32_t, int> constReg;
+        auto operand = [&](koopa_raw_value_t v) -> int {
+            if(v->kind.tag == KOOPA_RVT_INTEGER){
+                int32_t c = v->kind.data.integer.value;
+                if(!constReg.count(c)){
+                    constReg[c] = rf.initRegs.size();
+                    rf.initRegs.push_back(c);
+                }
+                return constReg[c];
+            }
+            if(v->kind.tag == KOOPA_RVT_GLOBAL_ALLOC && !reg.count(v)){
+                reg[v] = rf.initRegs.size();
+                rf.initRegs.push_back(globalAddr[v]);
+            }
+            assert(reg.count(v));
+            return reg[v];
+        };
+        // 常量要排在最前面，所以先扫一遍所有操作数
+        vector<koopa_raw_value_t> values;
+        for(size_t i = 0; i < f->bbs.len; i++){
+            auto bb = reinterpret_cast<koopa_raw_basic_block_t>(f->bbs.buffer[i]);
+            for(size_t j = 0; j < bb->insts.len; j++){
+                values.push_back(reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[j]));
+            }
+        }
+        auto constOperands = [&](koopa_raw_value_t v){
+            vector<koopa_raw_value_t> ops;
+            const auto &k = v->kind;
+            switch(k.tag){
+                case KOOPA_RVT_LOAD: ops = {k.data.load.src}; break;
+                case KOOPA_RVT_STORE: ops = {k.data.store.value, k.data.store.dest}; break;
+                case KOOPA_RVT_GET_PTR: ops = {k.data.get_ptr.src, k.data.get_ptr.index}; break;
+                case KOOPA_RVT_GET_ELEM_PTR: ops = {k.data.get_elem_ptr.src, k.data.get_elem_ptr.index}; break;
+                case KOOPA_RVT_BINARY: ops = {k.data.binary.lhs, k.data.binary.rhs}; break;
+                case KOOPA_RVT_BRANCH: ops = {k.data.branch.cond}; break;
+                case KOOPA_RVT_RETURN: if(k.data.ret.value) ops = {k.data.ret.value}; break;
+                case KOOPA_RVT_CALL:
+                    for(size_t i = 0; i < k.data.call.args.len; i++){
+                        ops.push_back(reinterpret_cast<koopa_raw_value_t>(k.data.call.args.buffer[i]));
+                    }
+                    break;
+                default: break;
+            }
+            for(auto o : ops){
+                if(o->kind.tag == KOOPA_RVT_INTEGER || o->kind.tag == KOOPA_RVT_GLOBAL_ALLOC){
+                    operand(o);
+                }
+            }
+        };
+        for(auto v : values){
+            constOperands(v);
+        }
+        int next = rf.initRegs.size();
+        for(size_t i = 0; i < f->params.len; i++){
+            auto p = reinterpret_cast<koopa_raw_value_t>(f->params.buffer[i]);
+            reg[p] = next;
+            rf.paramRegs.push_back(next++);
+        }
+        for(auto v : values){
+            if(v->kind.tag == KOOPA_RVT_ALLOC){
+                reg[v] = next;
+                rf.allocs.push_back(make_pair(next++, rf.frameWords));
+                rf.frameWords += runTypeWords(v->ty->data.pointer.base);
+            }else if(v->ty->tag != KOOPA_RTT_UNIT){
+                reg[v] = next++;
+            }
+        }
+        rf.numRegs = next;
+
+        // 译码。跳转目标先记块下标，最后换成指令下标
+        unordered_map<koopa_raw_basic_block_t, int> blockIndex;
+        for(size_t i = 0; i < f->bbs.len; i++){
+            blockIndex[reinterpret_cast<koopa_raw_basic_block_t>(f->bbs.buffer[i])] = runBlocks.size() + i;
+        }
+        rf.entryBlock = runBlocks.size();
+        vector<int> blockStart;
+        for(size_t i = 0; i < f->bbs.len; i++){
+            auto bb = reinterpret_cast<koopa_raw_basic_block_t>(f->bbs.buffer[i]);
+            blockStart.push_back(rf.insts.size());
+            RunBlock rb;
+            rb.func = rf.name;
+            rb.name = bb->name ? bb->name : "%?";
+            for(size_t j = 0; j < bb->insts.len; j++){
+                auto v = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[j]);
+                const auto &k = v->kind;
+                RunInst in;
+                memset(&in, 0, sizeof(in));
+                in.dst = reg.count(v) ? reg[v] : -1;
+                int op = RUN_ALLOC;
+                switch(k.tag){
+                    case KOOPA_RVT_ALLOC:
+                        op = RUN_ALLOC;
+                        break;
+                    case KOOPA_RVT_LOAD:
+                        op = RUN_LOAD;
+                        in.a = operand(k.data.load.src);
+                        break;
+                    case KOOPA_RVT_STORE:
+                        if(k.data.store.value->kind.tag == KOOPA_RVT_ZERO_INIT || k.data.store.value->kind.tag == KOOPA_RVT_UNDEF){
+                            op = RUN_STORE_ZERO;
+                            in.size = runTypeWords(k.data.store.value->ty);
+                        }else{
+                            op = RUN_STORE;
+                            in.a = operand(k.data.store.value);
+                        }
+                        in.b = operand(k.data.store.dest);
+                        break;
+                    case KOOPA_RVT_GET_PTR:
+                        op = RUN_GETPTR;
+                        in.a = operand(k.data.get_ptr.src);
+                        in.b = operand(k.data.get_ptr.index);
+                        in.size = runTypeWords(v->ty->data.pointer.base);
+                        break;
+                    case KOOPA_RVT_GET_ELEM_PTR:
+                        op = RUN_GETPTR;
+                        in.a = operand(k.data.get_elem_ptr.src);
+                        in.b = operand(k.data.get_elem_ptr.index);
+                        in.size = runTypeWords(v->ty->data.pointer.base);
+                        break;
+                    case KOOPA_RVT_BINARY:
+                        op = RUN_NE + k.data.binary.op; // koopa 的二元运算顺序和 RunOp 一致
+                        in.a = operand(k.data.binary.lhs);
+                        in.b = operand(k.data.binary.rhs);
+                        break;
+                    case KOOPA_RVT_BRANCH:
+                        op = RUN_BR;
+                        in.a = operand(k.data.branch.cond);
+                        in.block = blockIndex[k.data.branch.true_bb];
+                        in.falseBlock = blockIndex[k.data.branch.false_bb];
+                        break;
+                    case KOOPA_RVT_JUMP:
+                        op = RUN_JUMP;
+                        in.block = blockIndex[k.data.jump.target];
+                        break;
+                    case KOOPA_RVT_CALL:{
+                        auto callee = k.data.call.callee;
+                        in.argBegin = runArgs.size();
+                        in.argCount = k.data.call.args.len;
+                        for(size_t a = 0; a < k.data.call.args.len; a++){
+                            runArgs.push_back(operand(reinterpret_cast<koopa_raw_value_t>(k.data.call.args.buffer[a])));
+                        }
+                        if(callee->bbs.len == 0){
+                            op = RUN_CALL_NATIVE;
+                            in.callee = -1;
+                            for(int n = 0; n < (int)(sizeof(runNatives) / sizeof(runNatives[0])); n++){
+                                if(strcmp(callee->name + 1, runNatives[n]) == 0){
+                                    in.callee = n;
+                                }
+                            }
+                            if(in.callee == -1){
+                                cerr << "undefined function " << callee->name << endl;
+                                assert(false);
+                            }
+                        }else{
+                            op = RUN_CALL;
+                            in.callee = funcIndex[callee];
+                        }
+                        break;
+                    }
+                    case KOOPA_RVT_RETURN:
+                        if(k.data.ret.value != nullptr){
+                            op = RUN_RET;
+                            in.a = operand(k.data.ret.value);
+                        }else{
+                            op = RUN_RET_VOID;
+                        }
+                        break;
+                    default:
+                        assert(false);
+                }
+                rb.ops.push_back(op);
+                if(op == RUN_ALLOC){ // alloc 的地址在进入函数时就设置好了
+                    continue;
+                }
+                in.handler = table[op];
+                rf.insts.push_back(in);
+            }
+            runBlocks.push_back(rb);
+        }
+        for(auto &in : rf.insts){
+            if(in.handler == table[RUN_BR] || in.handler == table[RUN_JUMP]){
+                in.target = blockStart[in.block - rf.entryBlock];
+                in.falseTarget = in.handler == table[RUN_BR] ? blockStart[in.falseBlock - rf.entryBlock] : 0;
+            }
+        }
+    }
+    runBlockCount.assign(runBlocks.size(), 0);
+}
+
+
+// 执行 main。table 不为空时只返回各条指令的处理标签
+static int32_t runProgram(void ***table){
+    static void *labels[RUN_OP_COUNT] = {
+        nullptr, &&op_load, &&op_store, &&op_store_zero, &&op_getptr,
+        &&op_ne, &&op_eq, &&op_gt, &&op_lt, &&op_ge, &&op_le, &&op_add, &&op_sub, &&op_mul, &&op_div, &&op_mod,
+        &&op_and, &&op_or, &&op_xor, &&op_shl, &&op_shr, &&op_sar,
+        &&op_br, &&op_jump, &&op_call, &&op_call_native, &&op_ret, &&op_ret_void
+    };
+    if(table != nullptr){
+        *table = labels;
+        return 0;
+    }
+
+    // 调用栈
+    struct Frame{
+        const RunFunc *func;
+        const RunInst *pc;   // 返回后继续执行的指令
+        size_t regBase;
+        int dst;
+        int memTop;
+    };
+    vector<Frame> frames;
+    vector<int32_t> regStack(1 << 16);
+    size_t regBase = 0;
+    int memTop = runMemory.size();
+    int32_t retValue = 0;
+
+    const RunFunc *func = nullptr;
+    for(auto &f : runFuncs){
+        if(f.name == "main"){
+            func = &f;
+        }
+    }
+    assert(func != nullptr);
+
+    const RunInst *pc;
+    int32_t *R;
+    int32_t *M;
+
+    // 进入函数：准备寄存器文件和栈帧
+    auto enter = [&](const RunFunc *f, size_t base, const int32_t *args){
+        if(base + f->numRegs > regStack.size()){
+            regStack.resize(max(regStack.size() * 2, base + f->numRegs));
+        }
+        int32_t *regs = regStack.data() + base;
+        memcpy(regs, f->initRegs.data(), f->initRegs.size() * sizeof(int32_t));
+        for(size_t i = 0; i < f->paramRegs.size(); i++){
+            regs[f->paramRegs[i]] = args[i];
+        }
+        if(memTop + f->frameWords > (int)runMemory.size()){
+            runMemory.resize(max(runMemory.size() * 2, (size_t)memTop + f->frameWords));
+        }
+        for(auto &a : f->allocs){
+            regs[a.first] = memTop + a.second;
+        }
+        memTop += f->frameWords;
+        runBlockCount[f->entryBlock]++;
+    };
+
+    enter(func, 0, nullptr);
+    pc = func->insts.data();
+    R = regStack.data();
+    M = runMemory.data();
+
+#define NEXT goto *(++pc)->handler
+#define BINARY(name, expr) name: { int32_t x = R[pc->a], y = R[pc->b]; R[pc->dst] = (expr); NEXT; }
+
+    goto *pc->handler;
+
+op_load:
+    R[pc->dst] = M[R[pc->a]];
+    NEXT;
+op_store:
+    M[R[pc->b]] = R[pc->a];
+    NEXT;
+op_store_zero:
+    memset(M + R[pc->b], 0, pc->size * sizeof(int32_t));
+    NEXT;
+op_getptr:
+    R[pc->dst] = R[pc->a] + R[pc->b] * pc->size;
+    NEXT;
+
+BINARY(op_ne, x != y)
+BINARY(op_eq, x == y)
+BINARY(op_gt, x > y)
+BINARY(op_lt, x < y)
+BINARY(op_ge, x >= y)
+BINARY(op_le, x <= y)
+BINARY(op_add, (int32_t)((uint32_t)x + (uint32_t)y))
+BINARY(op_sub, (int32_t)((uint32_t)x - (uint32_t)y))
+BINARY(op_mul, (int32_t)((uint32_t)x * (uint32_t)y))
+// 除零和溢出按 RISC-V 的规定处理，不让解释器自己崩溃
+BINARY(op_div, y == 0 ? -1 : (x == INT32_MIN && y == -1) ? x : x / y)
+BINARY(op_mod, y == 0 ? x : (x == INT32_MIN && y == -1) ? 0 : x % y)
+BINARY(op_and, x & y)
+BINARY(op_or, x | y)
+BINARY(op_xor, x ^ y)
+BINARY(op_shl, (int32_t)((uint32_t)x << (y & 31)))
+BINARY(op_shr, (int32_t)((uint32_t)x >> (y & 31)))
+BINARY(op_sar, x >> (y & 31))
+
+op_br:
+    if(R[pc->a]){
+        runBlockCount[pc->block]++;
+        pc = func->insts.data() + pc->target;
+    }else{
+        runBlockCount[pc->falseBlock]++;
+        pc = func->insts.data() + pc->falseTarget;
+    }
+    goto *pc->handler;
+op_jump:
+    runBlockCount[pc->block]++;
+    pc = func->insts.data() + pc->target;
+    goto *pc->handler;
+
+op_call:{
+    const RunFunc *callee = &runFuncs[pc->callee];
+    int32_t args[pc->argCount + 1];
+    for(int i = 0; i < pc->argCount; i++){
+        args[i] = R[runArgs[pc->argBegin + i]];
+    }
+    frames.push_back({func, pc, regBase, pc->dst, memTop});
+    regBase += func->numRegs;
+    enter(callee, regBase, args);
+    func = callee;
+    R = regStack.data() + regBase;
+    M = runMemory.data();
+    pc = func->insts.data();
+    goto *pc->handler;
+}
+op_call_native:{
+    int32_t args[pc->argCount + 1];
+    for(int i = 0; i < pc->argCount; i++){
+        args[i] = R[runArgs[pc->argBegin + i]];
+    }
+    int32_t v = runNative(pc->callee, args);
+    if(pc->dst >= 0){
+        R[pc->dst] = v;
+    }
+    NEXT;
+}
+
+op_ret:
+    retValue = R[pc->a];
+    goto do_ret;
+op_ret_void:
+    retValue = 0;
+do_ret:
+    if(frames.empty()){
+        return retValue;
+    }
+    {
+        Frame fr = frames.back();
+        frames.pop_back();
+        func = fr.func;
+        pc = fr.pc;
+        regBase = fr.regBase;
+        memTop = fr.memTop;
+        R = regStack.data() + regBase;
+        if(fr.dst >= 0){
+            R[fr.dst] = retValue;
+        }
+    }
+    NEXT;
+
+#undef NEXT
+#undef BINARY
+}
+
+
+// 把 raw program 译码后执行，执行统计写到 report，返回 main 的返回值
+static int runKoopa(const koopa_raw_program_t &raw, ostream &report){
+    runDecode(raw);
+    int32_t result = runProgram(nullptr);
+    fflush(stdout);
+
+    // 由每个块的执行次数推算各类指令和各个函数执行的指令数
+    vector<int64_t> opCount(RUN_OP_COUNT, 0);
+    unordered_map<string, int64_t> funcInsts, funcCalls;
+    int64_t total = 0;
+    for(size_t i = 0; i < runBlocks.size(); i++){
+        for(int op : runBlocks[i].ops){
+            opCount[op] += runBlockCount[i];
+        }
+        funcInsts[runBlocks[i].func] += runBlockCount[i] * runBlocks[i].ops.size();
+        total += runBlockCount[i] * runBlocks[i].ops.size();
+    }
+    for(auto &f : runFuncs){
+        if(!f.insts.empty()){
+            funcCalls[f.name] = runBlockCount[f.entryBlock];
+        }
+    }
+
+    report << "exit code: " << result << endl;
+    report << "instructions: " << total << endl;
+    report << endl << "[opcode]" << endl;
+    unordered_map<string, int64_t> byName;
+    vector<string> names;
+    for(int op = 0; op < RUN_OP_COUNT; op++){
+        if(!byName.count(runOpName[op])){
+            names.push_back(runOpName[op]);
+        }
+        byName[runOpName[op]] += opCount[op];
+    }
+    for(auto &n : names){
+        if(byName[n] != 0){
+            report << n << " " << byName[n] << endl;
+        }
+    }
+    report << endl << "[function] calls instructions" << endl;
+    for(auto &f : runFuncs){
+        if(!f.insts.empty()){
+            report << "@" << f.name << " " << funcCalls[f.name] << " " << funcInsts[f.name] << endl;
+        }
+    }
+    report << endl << "[block] count" << endl;
+    for(size_t i = 0; i < runBlocks.size(); i++){
+        if(runBlockCount[i] != 0){
+            report << "@" << runBlocks[i].func << " " << runBlocks[i].name << " " << runBlockCount[i] << endl;
+        }
+    }
+    return result;
+}
@@ -0,0 +1,739 @@
+#pragma once
+#include <cassert>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+using namespace std;
+
+// 优化用的中间表示：前端生成的 koopa 文本解析成函数、基本块和指令，指令连续存放在函数的数组里，
+// 基本块按顺序记下自己的指令在数组中的下标
+// 操作数（%临时变量、@变量、参数、整数、块的标号）在函数内编号，指令里只存编号，分析的结果也按编号存在数组里；
+// 输出时按编号找回名字，重新拼成 koopa 文本
+// 分析结果（控制流图、支配树、定义-使用链）按函数缓存，pass 返回它保留了哪些分析，其余的作废，下次用到时重新计算
+// -time-passes 时把每个 pass 和每种分析花的时间写到标准错误
+
+
+// 指令的种类，二元运算连在一起，顺序和 koopa_raw_binary_op_t 相同
+enum IrOp {
+    IR_ALLOC, IR_LOAD, IR_STORE, IR_GETPTR, IR_GETELEMPTR,
+    IR_NE, IR_EQ, IR_GT, IR_LT, IR_GE, IR_LE, IR_ADD, IR_SUB, IR_MUL, IR_DIV, IR_MOD,
+    IR_AND, IR_OR, IR_XOR, IR_SHL, IR_SHR, IR_SAR,
+    IR_BR, IR_JUMP, IR_CALL, IR_RET, IR_OP_COUNT
+};
+
+static const char *const irOpNames[IR_OP_COUNT] = {
+    "alloc", "load", "store", "getptr", "getelemptr",
+    "ne", "eq", "gt", "lt", "ge", "le", "add", "sub", "mul", "div", "mod",
+    "and", "or", "xor", "shl", "shr", "sar",
+    "br", "jump", "call", "ret"
+};
+
+static IrOp irOpOf(const string &name){
+    static unordered_map<string, IrOp> ops;
+    if(ops.empty()){
+        for(int op = 0; op < IR_OP_COUNT; op++){
+            ops[irOpNames[op]] = (IrOp)op;
+        }
+    }
+    auto it = ops.find(name);
+    assert(it != ops.end()); // 前端只会生成这些指令
+    return it->second;
+}
+
+static bool irIsBinary(IrOp op){
+    return op >= IR_NE && op <= IR_SAR;
+}
+
+struct IrInst{
+    int dest = -1;        // 结果：临时变量，alloc 是 @变量；没有结果时为 -1
+    IrOp op = IR_RET;
+    string type;          // alloc 的类型
+    string callee;        // call 调用的函数
+    vector<int> args;     // 操作数，call 是实参
+    bool removed = false; // pass 删掉的指令先做标记，结束前由 irSweep 从块里拿掉
+};
+
+struct IrBlock{
+    int label;
+    vector<int> insts;    // 在 IrFunc::insts 中的下标，最后一条是 br、jump 或 ret
+};
+
+struct IrFunc{
+    string header;        // fun @名字(参数): 类型 {
+    vector<int> params;
+    vector<IrBlock> blocks;
+    vector<IrInst> insts;
+    vector<string> names; // 编号到名字
+    unordered_map<string, int> ids;
+    int tempCount = 0;
+
+    // 名字的编号，第一次出现时分配
+    int value(const string &name){
+        auto it = ids.find(name);
+        if(it != ids.end()){
+            return it->second;
+        }
+        ids.emplace(name, names.size());
+        names.push_back(name);
+        return names.size() - 1;
+    }
+    int constant(int32_t c){
+        return value(to_string(c));
+    }
+    // pass 新建的临时变量，名字不和已有的重复
+    int newTemp(){
+        string name;
+        do{
+            name = "%t" + to_string(tempCount++);
+        }while(ids.count(name));
+        return value(name);
+    }
+    // @函数名
+    string name() const{
+        return header.substr(4, header.find('(') - 4);
+    }
+    bool isTemp(int v) const{
+        return v >= 0 && names[v][0] == '%';
+    }
+    bool isLiteral(int v) const{
+        return isdigit((unsigned char)names[v][0]) || names[v][0] == '-';
+    }
+    int32_t literal(int v) const{
+        return (int32_t)stoll(names[v]);
+    }
+};
+
+// 函数以外的行（decl、global、空行）原样保留，func 为 -1
+struct IrItem{
+    string line;
+    int func = -1;
+};
+
+struct IrModule{
+    vector<IrItem> items;
+    vector<IrFunc> funcs;
+    bool wholeProgram = false;
+    unordered_map<string, int32_t> constGlobals; // 整个程序中只被直接 load 的 i32 全局变量和它的初值
+};
+
+
+static IrInst irParseInst(IrFunc &f, const string &line){
+    IrInst inst;
+    string s = line.substr(line.find_first_not_of(' '));
+    size_t eq = s.find(" = ");
+    if(eq != string::npos && (s[0] == '%' || s[0] == '@')){
+        inst.dest = f.value(s.substr(0, eq));
+        s = s.substr(eq + 3);
+    }
+    size_t sp = s.find(' ');
+    inst.op = irOpOf(s.substr(0, sp));
+    if(sp == string::npos){
+        return inst;
+    }
+    string rest = s.substr(sp + 1);
+    if(inst.op == IR_ALLOC){ // alloc 的类型里可能有逗号，不拆开
+        inst.type = rest;
+        return inst;
+    }
+    if(inst.op == IR_CALL){
+        size_t lp = rest.find('(');
+        inst.callee = rest.substr(0, lp);
+        rest = rest.substr(lp + 1, rest.rfind(')') - lp - 1);
+    }
+    for(size_t i = 0; i < rest.size();){
+        size_t j = rest.find(", ", i);
+        if(j == string::npos){
+            j = rest.size();
+        }
+        inst.args.push_back(f.value(rest.substr(i, j - i)));
+        i = j + 2;
+    }
+    return inst;
+}
+
+static string irInstText(const IrFunc &f, const IrInst &inst){
+    string s = "   ";
+    if(inst.dest >= 0){
+        s += f.names[inst.dest] + " = ";
+    }
+    s += irOpNames[inst.op];
+    if(inst.op == IR_ALLOC){
+        return s + " " + inst.type;
+    }
+    string args;
+    for(size_t i = 0; i < inst.args.size(); i++){
+        args += (i == 0 ? "" : ", ") + f.names[inst.args[i]];
+    }
+    if(inst.op == IR_CALL){
+        s += " " + inst.callee + "(" + args + ")";
+    }else if(!args.empty()){
+        s += " " + args;
+    }
+    return s;
+}
+
+
+// koopa 是整个程序时 wholeProgram 为 true，这时才能确定哪些全局变量从来没有被写过
+static IrModule irParse(const string &koopa, bool wholeProgram){
+    IrModule m;
+    m.wholeProgram = wholeProgram;
+    stringstream in(koopa);
+    for(string line; getline(in, line);){
+        if(line.compare(0, 8, "global @") == 0){
+            size_t eq = line.find(" = alloc i32, ");
+            if(wholeProgram && eq != string::npos){
+                string init = line.substr(eq + 14);
+                m.constGlobals[line.substr(7, eq - 7)] = init == "zeroinit" ? 0 : (int32_t)stoll(init);
+            }
+        }else if(line.compare(0, 5, "fun @") == 0 && line.back() == '{'){
+            IrItem item;
+            item.func = m.funcs.size();
+            m.items.push_back(item);
+            m.funcs.emplace_back();
+            IrFunc &f = m.funcs.back();
+            f.header = line;
+            for(size_t i = line.find('%'); i != string::npos; i = line.find('%', i + 1)){
+                f.params.push_back(f.value(line.substr(i, line.find(':', i) - i)));
+            }
+            while(getline(in, line) && line != "}"){
+                if(line[0] == '%' && line.back() == ':'){
+                    f.blocks.emplace_back();
+                    f.blocks.back().label = f.value(line.substr(0, line.size() - 1));
+                }else if(!f.blocks.empty() && line.find_first_not_of(' ') != string::npos){
+                    f.insts.push_back(irParseInst(f, line));
+                    f.blocks.back().insts.push_back(f.insts.size() - 1);
+                }
+            }
+            continue;
+        }
+        IrItem item;
+        item.line = line;
+        m.items.push_back(item);
+    }
+    // 除了直接 load 以外，全局变量出现在其他地方就当作被写过
+    for(IrFunc &f : m.funcs){
+        for(IrInst &inst : f.insts){
+            for(int k = 0; k < (int)inst.args.size(); k++){
+                if(!(inst.op == IR_LOAD && k == 0)){
+                    m.constGlobals.erase(f.names[inst.args[k]]);
+                }
+            }
+        }
+    }
+    return m;
+}
+
+static string irPrint(const IrModule &m){
+    stringstream out;
+    for(const IrItem &item : m.items){
+        if(item.func < 0){
+            out << item.line << endl;
+            continue;
+        }
+        const IrFunc &f = m.funcs[item.func];
+        out << f.header << endl;
+        for(const IrBlock &bb : f.blocks){
+            out << f.names[bb.label] << ":" << endl;
+            for(int i : bb.insts){
+                out << irInstText(f, f.insts[i]) << endl;
+            }
+        }
+        out << "}" << endl;
+    }
+    return out.str();
+}
+
+// 从块里拿掉标记为删除的指令
+static void irSweep(IrFunc &f){
+    for(IrBlock &bb : f.blocks){
+        size_t n = 0;
+        for(int i : bb.insts){
+            if(!f.insts[i].removed){
+                bb.insts[n++] = i;
+            }
+        }
+        bb.insts.resize(n);
+    }
+}
+
+
+// -time-passes：按名字累计时间和次数，按第一次出现的顺序输出
+// 计时可以嵌套（pass 里用到的分析），记在外层的只是去掉内层之后的部分，各项加起来就是总时间
+static bool timePasses = false;
+struct IrTimer{
+    double seconds = 0;
+    int runs = 0;
+};
+static unordered_map<string, IrTimer> irTimers;
+static vector<string> irTimerOrder;
+static double irTimerInner = 0; // 当前计时中已经结束的内层计时的总时间
+
+struct IrTimeScope{
+    const char *name;
+    chrono::steady_clock::time_point start;
+    double outerInner = 0;
+    explicit IrTimeScope(const char *name): name(name){
+        if(timePasses){
+            outerInner = irTimerInner;
+            irTimerInner = 0;
+            start = chrono::steady_clock::now();
+        }
+    }
+    ~IrTimeScope(){
+        if(timePasses){
+            double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            if(!irTimers.count(name)){
+                irTimerOrder.push_back(name);
+            }
+            IrTimer &t = irTimers[name];
+            t.seconds += elapsed - irTimerInner;
+            t.runs++;
+            irTimerInner = outerInner + elapsed;
+        }
+    }
+};
+
+static void irReportTimes(ostream &out){
+    double total = 0;
+    for(auto &p : irTimers){
+        total += p.second.seconds;
+    }
+    out << "===-------------------------------------------------------------------------===" << endl;
+    out << "                      Pass execution timing report" << endl;
+    out << "===-------------------------------------------------------------------------===" << endl;
+    out << "  Total Execution Time: " << fixed << setprecision(4) << total << " seconds" << endl << endl;
+    out << "   ---Time---   --%--   --Runs--  --Name--" << endl;
+    for(const string &name : irTimerOrder){
+        const IrTimer &t = irTimers[name];
+        out << "  " << setw(9) << t.seconds << "  " << setw(6) << setprecision(1)
+            << (total > 0 ? t.seconds * 100 / total : 0.0) << "%  " << setw(8) << t.runs << "  " << name << endl;
+        out << setprecision(4);
+    }
+    out.unsetf(ios::floatfield);
+    out << setprecision(6);
+}
+
+
+// 分析。支配树只依赖控制流图，保留控制流图的 pass 也保留了它
+enum IrAnalysis { IR_CFG = 1, IR_DEFUSE = 2, IR_DOM = 4, IR_ALL = 7 };
+
+struct IrCfg{
+    vector<int> blockOf;                // 标号的编号到块，其余编号是 -1
+    vector<vector<int> > succs, preds;
+    vector<int> rpo;                    // 从入口走得到的块，逆后序
+};
+
+// 按块索引，走不到的块 idom 和编号都是 -1
+struct IrDom{
+    vector<int> idom;                   // 直接支配者，入口是 -1
+    vector<vector<int> > children;
+    vector<int> pre, post;              // 支配树上的先序、后序编号
+
+    bool dominates(int a, int b) const{
+        return pre[a] >= 0 && pre[b] >= 0 && pre[a] <= pre[b] && post[b] <= post[a];
+    }
+};
+
+// 以下数组都按编号索引
+struct IrDefUse{
+    vector<int> def;                    // 临时变量到定义它的指令，其余是 -1
+    vector<int> alloc;                  // 局部的 @变量到 alloc 指令，其余是 -1
+    vector<vector<int> > users;         // 临时变量和 @变量到用到它的指令，用了几次就出现几次
+    vector<bool> scalar;                // 只被直接 load/store 的 i32 局部变量
+};
+
+static void irBuildCfg(const IrFunc &f, IrCfg &cfg){
+    int n = f.blocks.size();
+    cfg.blockOf.assign(f.names.size(), -1);
+    cfg.succs.assign(n, vector<int>());
+    cfg.preds.assign(n, vector<int>());
+    cfg.rpo.clear();
+    for(int b = 0; b < n; b++){
+        cfg.blockOf[f.blocks[b].label] = b;
+    }
+    for(int b = 0; b < n; b++){
+        const IrInst &term = f.insts[f.blocks[b].insts.back()];
+        size_t k = term.op == IR_BR ? 1 : term.op == IR_JUMP ? 0 : term.args.size();
+        for(; k < term.args.size(); k++){
+            int s = cfg.blockOf[term.args[k]];
+            cfg.succs[b].push_back(s);
+            cfg.preds[s].push_back(b);
+        }
+    }
+    // 非递归的深度优先搜索，后序倒过来
+    vector<bool> seen(n, false);
+    vector<int> stack = {0}, post;
+    vector<size_t> next(n, 0);
+    seen[0] = true;
+    while(!stack.empty()){
+        int b = stack.back();
+        if(next[b] < cfg.succs[b].size()){
+            int s = cfg.succs[b][next[b]++];
+            if(!seen[s]){
+                seen[s] = true;
+                stack.push_back(s);
+            }
+        }else{
+            post.push_back(b);
+            stack.pop_back();
+        }
+    }
+    cfg.rpo.assign(post.rbegin(), post.rend());
+}
+
+static void irBuildDefUse(const IrFunc &f, IrDefUse &du){
+    int n = f.names.size();
+    du.def.assign(n, -1);
+    du.alloc.assign(n, -1);
+    du.users.assign(n, vector<int>());
+    du.scalar.assign(n, false);
+    for(const IrBlock &bb : f.blocks){
+        for(int i : bb.insts){
+            const IrInst &inst = f.insts[i];
+            if(inst.op == IR_ALLOC){
+                du.alloc[inst.dest] = i;
+                du.scalar[inst.dest] = inst.type == "i32";
+            }else if(f.isTemp(inst.dest)){
+                du.def[inst.dest] = i;
+            }
+            for(int a : inst.args){
+                du.users[a].push_back(i);
+            }
+        }
+    }
+    // 地址被拿去做别的事情的变量不算
+    for(const IrBlock &bb : f.blocks){
+        for(int i : bb.insts){
+            const IrInst &inst = f.insts[i];
+            for(int k = 0; k < (int)inst.args.size(); k++){
+                if(!((inst.op == IR_LOAD && k == 0) || (inst.op == IR_STORE && k == 1))){
+                    du.scalar[inst.args[k]] = false;
+                }
+            }
+        }
+    }
+}
+
+// Cooper、Harvey、Kennedy 的迭代算法：按逆后序，取已经处理过的前驱在支配树上的公共祖先，直到不变
+static void irBuildDom(const IrCfg &cfg, IrDom &dom){
+    int n = cfg.succs.size();
+    vector<int> order(n, -1);
+    for(int k = 0; k < (int)cfg.rpo.size(); k++){
+        order[cfg.rpo[k]] = k;
+    }
+    dom.idom.assign(n, -1);
+    dom.idom[0] = 0;
+    for(bool changed = true; changed;){
+        changed = false;
+        for(int b : cfg.rpo){
+            if(b == 0){
+                continue;
+            }
+            int d = -1;
+            for(int p : cfg.preds[b]){
+                if(dom.idom[p] < 0){
+                    continue;
+                }
+                int x = p;
+                while(d >= 0 && x != d){
+                    while(order[x] > order[d]){
+                        x = dom.idom[x];
+                    }
+                    while(order[d] > order[x]){
+                        d = dom.idom[d];
+                    }
+                }
+                d = x;
+            }
+            if(d != dom.idom[b]){
+                dom.idom[b] = d;
+                changed = true;
+            }
+        }
+    }
+    dom.idom[0] = -1;
+    dom.children.assign(n, vector<int>());
+    for(int b : cfg.rpo){
+        if(b != 0){
+            dom.children[dom.idom[b]].push_back(b);
+        }
+    }
+    dom.pre.assign(n, -1);
+    dom.post.assign(n, -1);
+    int pre = 0, post = 0;
+    vector<pair<int, size_t> > stack = {{0, 0}};
+    dom.pre[0] = pre++;
+    while(!stack.empty()){
+        pair<int, size_t> &top = stack.back();
+        if(top.second < dom.children[top.first].size()){
+            int c = dom.children[top.first][top.second++];
+            dom.pre[c] = pre++;
+            stack.push_back({c, 0});
+        }else{
+            dom.post[top.first] = post++;
+            stack.pop_back();
+        }
+    }
+}
+
+// 一个函数的分析缓存
+struct IrAnalyses{
+    IrFunc &f;
+    unsigned valid = 0;
+    IrCfg cfgResult;
+    IrDom domResult;
+    IrDefUse defUseResult;
+
+    explicit IrAnalyses(IrFunc &f): f(f){}
+    const IrCfg &cfg(){
+        if(!(valid & IR_CFG)){
+            IrTimeScope t("cfg (analysis)");
+            irBuildCfg(f, cfgResult);
+            valid |= IR_CFG;
+        }
+        return cfgResult;
+    }
+    const IrDom &dom(){
+        if(!(valid & IR_DOM)){
+            const IrCfg &c = cfg();
+            IrTimeScope t("dominators (analysis)");
+            irBuildDom(c, domResult);
+            valid |= IR_DOM;
+        }
+        return domResult;
+    }
+    const IrDefUse &defUse(){
+        if(!(valid & IR_DEFUSE)){
+            IrTimeScope t("def-use (analysis)");
+            irBuildDefUse(f, defUseResult);
+            valid |= IR_DEFUSE;
+        }
+        return defUseResult;
+    }
+    void keep(unsigned preserved){
+        if(preserved & IR_CFG){
+            preserved |= IR_DOM;
+        }
+        valid &= preserved;
+    }
+};
+
+
+// 过程间的副作用分析。SysY 的函数只能调用前面定义的函数和自己，每个函数优化完后总结它的副作用，
+// 后面的函数优化时按调用的函数查表；流式编译时各个函数分开解析，总结留在全局的表里
+// 纯函数只读写自己的局部变量；只读函数还读全局变量或参数指向的内存；其余的有副作用，包括输入输出
+// 没有副作用的调用只有确定会返回时才能在结果没人用时删掉：函数里没有循环，也不递归，调用的函数都确定会返回
+enum IrEffectKind { IR_PURE, IR_READONLY, IR_SIDEEFFECT };
+
+struct IrEffects{
+    int kind = IR_PURE;
+    bool writesArgs = false;      // 可能写参数指向的内存
+    bool writesAll = false;       // 不知道的函数，什么都可能写
+    unordered_set<string> writes; // 可能写的全局变量
+    bool terminates = false;      // 确定会返回
+};
+
+static unordered_map<string, IrEffects> irFuncEffects;
+
+static const IrEffects &irEffectsOf(const string &callee){
+    auto it = irFuncEffects.find(callee);
+    if(it != irFuncEffects.end()){
+        return it->second;
+    }
+    // 运行时库的输入输出都是副作用，其中只有 getarray 写内存（参数指向的数组）；
+    // 还没有总结的函数（调用自己）什么都可能写
+    static const IrEffects io = {IR_SIDEEFFECT, false, false, {}, true};
+    static const IrEffects input = {IR_SIDEEFFECT, true, false, {}, true};
+    static const IrEffects unknown = {IR_SIDEEFFECT, false, true, {}, false};
+    static const unordered_set<string> runtime = {
+        "@getint", "@getch", "@putint", "@putch", "@putarray", "@starttime", "@stoptime"
+    };
+    return callee == "@getarray" ? input : runtime.count(callee) ? io : unknown;
+}
+
+// 地址的来源：局部变量、全局变量，或者参数指向的内存（调用者的数组，可能是任何一个全局数组）。
+// direct 表示地址就是变量本身，不是用 getelemptr/getptr 算出来的；标量的地址不会被拿去用，
+// 所以参数指向的内存不会是标量全局变量
+enum IrBaseKind { IR_NOBASE, IR_LOCAL, IR_GLOBAL, IR_ARGMEM };
+
+struct IrBase{
+    int kind = IR_NOBASE;
+    int var = -1;
+    bool direct = true;
+};
+
+static IrBase irBaseOf(const IrFunc &f, const IrDefUse &du, int v){
+    IrBase b;
+    while(true){
+        if(f.names[v][0] == '@'){
+            b.kind = du.alloc[v] >= 0 ? IR_LOCAL : IR_GLOBAL;
+            b.var = v;
+            return b;
+        }
+        int d = du.def[v];
+        if(d < 0){ // 参数
+            b.kind = f.isLiteral(v) ? IR_NOBASE : IR_ARGMEM;
+            return b;
+        }
+        const IrInst &inst = f.insts[d];
+        if(inst.op == IR_GETELEMPTR || inst.op == IR_GETPTR){
+            v = inst.args[0];
+            b.direct = false;
+            continue;
+        }
+        // 保存数组参数的局部变量里 load 出来的指针
+        int a = inst.op == IR_LOAD ? du.alloc[inst.args[0]] : -1;
+        b.kind = a >= 0 && f.insts[a].type[0] == '*' ? IR_ARGMEM : IR_NOBASE;
+        return b;
+    }
+}
+
+static bool irMayAlias(const IrBase &a, const IrBase &b){
+    if(a.kind == IR_NOBASE || b.kind == IR_NOBASE){
+        return true;
+    }
+    if(a.kind == IR_LOCAL || b.kind == IR_LOCAL || (a.kind == IR_GLOBAL && b.kind == IR_GLOBAL)){
+        return a.kind == b.kind && a.var == b.var;
+    }
+    if(a.kind == IR_ARGMEM && b.kind == IR_ARGMEM){
+        return true;
+    }
+    return a.kind == IR_GLOBAL ? !a.direct : !b.direct;
+}
+
+// 调用传进去的指针：整数的实参没有来源，跳过
+static vector<IrBase> irPointerArgs(const IrFunc &f, const IrDefUse &du, const IrInst &call){
+    vector<IrBase> bases;
+    for(int a : call.args){
+        IrBase b = irBaseOf(f, du, a);
+        if(b.kind != IR_NOBASE){
+            b.direct = false;
+            bases.push_back(b);
+        }
+    }
+    return bases;
+}
+
+// 调用可能写 b 处的内存吗
+static bool irCallMayWrite(const IrFunc &f, const IrDefUse &du, const IrInst &call, const IrBase &b){
+    const IrEffects &e = irEffectsOf(call.callee);
+    if(e.kind != IR_SIDEEFFECT){
+        return false;
+    }
+    if(e.writesAll || b.kind == IR_NOBASE){
+        return true;
+    }
+    if((b.kind == IR_GLOBAL && e.writes.count(f.names[b.var])) || (b.kind == IR_ARGMEM && !e.writes.empty())){
+        return true;
+    }
+    if(e.writesArgs){
+        for(const IrBase &a : irPointerArgs(f, du, call)){
+            if(irMayAlias(a, b)){
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// 调用可能写任何内存吗（只读函数的调用结果还能不能用）
+static bool irCallWrites(const IrInst &call){
+    const IrEffects &e = irEffectsOf(call.callee);
+    return e.writesAll || e.writesArgs || !e.writes.empty();
+}
+
+// 调用自己的地方用正在总结的结果，反复做到不再变化
+static IrEffects irSummarize(const IrFunc &f, const IrCfg &cfg, const IrDefUse &du){
+    string name = f.name();
+    IrEffects e;
+    // 按逆后序，指向不在后面的块的边就是循环的回边
+    vector<int> order(f.blocks.size(), -1);
+    for(int k = 0; k < (int)cfg.rpo.size(); k++){
+        order[cfg.rpo[k]] = k;
+    }
+    e.terminates = true;
+    for(int b : cfg.rpo){
+        for(int s : cfg.succs[b]){
+            e.terminates = e.terminates && order[s] > order[b];
+        }
+    }
+    for(const IrBlock &bb : f.blocks){
+        for(int i : bb.insts){
+            const IrInst &inst = f.insts[i];
+            if(inst.op == IR_CALL){
+                e.terminates = e.terminates && inst.callee != name && irEffectsOf(inst.callee).terminates;
+            }
+        }
+    }
+    auto write = [&](const IrBase &b){
+        if(b.kind == IR_LOCAL){
+            return;
+        }
+        e.kind = IR_SIDEEFFECT;
+        if(b.kind == IR_GLOBAL){
+            e.writes.insert(f.names[b.var]);
+        }else if(b.kind == IR_ARGMEM){
+            e.writesArgs = true;
+        }else{
+            e.writesAll = true;
+        }
+    };
+    for(bool changed = true; changed;){
+        IrEffects before = e;
+        for(const IrBlock &bb : f.blocks){
+            for(int i : bb.insts){
+                const IrInst &inst = f.insts[i];
+                if(inst.op == IR_LOAD && irBaseOf(f, du, inst.args[0]).kind != IR_LOCAL){
+                    e.kind = max(e.kind, (int)IR_READONLY);
+                }else if(inst.op == IR_STORE){
+                    write(irBaseOf(f, du, inst.args[1]));
+                }else if(inst.op == IR_CALL){
+                    IrEffects c = inst.callee == name ? e : irEffectsOf(inst.callee);
+                    e.kind = max(e.kind, c.kind);
+                    e.writesAll = e.writesAll || c.writesAll;
+                    e.writes.insert(c.writes.begin(), c.writes.end());
+                    if(c.writesArgs){
+                        for(const IrBase &b : irPointerArgs(f, du, inst)){
+                            write(b);
+                        }
+                    }
+                }
+            }
+        }
+        changed = e.kind != before.kind || e.writesArgs != before.writesArgs || e.writesAll != before.writesAll ||
+                  e.writes.size() != before.writes.size();
+    }
+    return e;
+}
+
+
+// pass 对一个函数做变换，返回保留下来的分析（IrAnalysis 的组合），没有改动时返回 IR_ALL
+struct IrPass{
+    const char *name;
+    unsigned (*run)(IrModule &m, IrFunc &f, IrAnalyses &am);
+};
+
+static void irRunPasses(IrModule &m, const vector<IrPass> &passes){
+    for(IrFunc &f : m.funcs){
+        if(f.blocks.empty()){
+            continue;
+        }
+        IrAnalyses am(f);
+        for(const IrPass &pass : passes){
+            IrTimeScope t(pass.name);
+            am.keep(pass.run(m, f, am));
+        }
+        const IrCfg &cfg = am.cfg();
+        const IrDefUse &du = am.defUse();
+        IrTimeScope t("effects (analysis)");
+        irFuncEffects[f.name()] = irSummarize(f, cfg, du);
+    }
+}
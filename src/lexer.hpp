@@ -0,0 +1,566 @@
+#pragma once
+#include <cstdio>
+#include <cctype>
+#include <cstring>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include <sys/wait.h>
+#include <unistd.h>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+#include "sysy.tab.hpp"
+
+using namespace std;
+
+// 手写的词法分析器（-fhand-lexer），和 sysy.l 生成的扫描器返回同样的 token
+// 整个输入先读进内存，末尾补上 32 个 '\0'，一次比较 16/32 个字节时不会读出界：
+// 跳过空白、找注释结尾都用 SIMD，关键字用完美哈希查表，整数在扫描时直接算出来
+// 标识符和 flex 的扫描器一样换成 lexNames 中的编号交给 parser，见 ast.hpp
+
+extern FILE *yyin;
+int flex_yylex(); // sysy.l 生成的扫描器，见其中的 YY_DECL
+void yyrestart(FILE *input_file);
+
+static bool useHandLexer = false;
+
+static string lexBuf;
+static const char *lexCur = nullptr;
+static const char *lexEnd = nullptr;
+static const int lexPadding = 32;
+
+
+// 字符分类表
+enum LexClass : unsigned char { LEX_OTHER, LEX_SPACE, LEX_IDENT, LEX_DIGIT, LEX_OP };
+struct LexTable{
+    LexClass cls[256];
+    bool idChar[256];
+    LexTable(){
+        for(int c = 0; c < 256; c++){
+            bool alpha = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+            bool digit = c >= '0' && c <= '9';
+            cls[c] = alpha ? LEX_IDENT : digit ? LEX_DIGIT : LEX_OTHER;
+            idChar[c] = alpha || digit;
+        }
+        cls[(unsigned char)' '] = cls[(unsigned char)'\t'] = cls[(unsigned char)'\n'] = cls[(unsigned char)'\r'] = LEX_SPACE;
+        for(char c : string("<>=!|&")){ // 可能是两个字符的运算符
+            cls[(unsigned char)c] = LEX_OP;
+        }
+    }
+};
+static const LexTable lexTable;
+
+
+// 关键字的完美哈希：(长度 << 2) + 首字符 + (末字符 << 3) 的低 4 位对这 9 个关键字互不相同
+struct LexKeyword{
+    const char *word;
+    int len;
+    int token;
+};
+static const LexKeyword lexKeywords[16] = {
+    {nullptr, 0, 0}, {"if", 2, IF}, {nullptr, 0, 0}, {"while", 5, WHILE},
+    {nullptr, 0, 0}, {"int", 3, INT}, {"void", 4, VOID}, {"const", 5, CONST},
+    {nullptr, 0, 0}, {nullptr, 0, 0}, {"return", 6, RETURN}, {"continue", 8, CONTINUE},
+    {nullptr, 0, 0}, {"else", 4, ELSE}, {"break", 5, BREAK}, {nullptr, 0, 0}
+};
+
+static int lexKeyword(const char *s, int len){
+    if(len < 2 || len > 8){
+        return 0;
+    }
+    const LexKeyword &k = lexKeywords[((len << 2) + (unsigned char)s[0] + ((unsigned char)s[len - 1] << 3)) & 15];
+    if(k.len == len && memcmp(k.word, s, len) == 0){
+        return k.token;
+    }
+    return 0;
+}
+
+
+// 跳过空白，返回第一个不是空白的位置
+static const char* lexSkipSpace(const char *p){
+#if defined(__AVX2__)
+    const __m256i sp = _mm256_set1_epi8(' '), tab = _mm256_set1_epi8('\t'), nl = _mm256_set1_epi8('\n'), cr = _mm256_set1_epi8('\r');
+    while(true){
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i m = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, sp), _mm256_cmpeq_epi8(v, tab)),
+                                    _mm256_or_si256(_mm256_cmpeq_epi8(v, nl), _mm256_cmpeq_epi8(v, cr)));
+        uint32_t mask = ~(uint32_t)_mm256_movemask_epi8(m);
+        if(mask != 0){
+            return p + __builtin_ctz(mask);
+        }
+        p += 32;
+    }
+#elif defined(__SSE2__)
+    const __m128i sp = _mm_set1_epi8(' '), tab = _mm_set1_epi8('\t'), nl = _mm_set1_epi8('\n'), cr = _mm_set1_epi8('\r');
+    while(true){
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, sp), _mm_cmpeq_epi8(v, tab)),
+                                 _mm_or_si128(_mm_cmpeq_epi8(v, nl), _mm_cmpeq_epi8(v, cr)));
+        uint32_t mask = ~(uint32_t)_mm_movemask_epi8(m) & 0xffff;
+        if(mask != 0){
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+#else
+    while(lexTable.cls[(unsigned char)*p] == LEX_SPACE){
+        p++;
+    }
+    return p;
+#endif
+}
+
+// 找到字符 c 或者 '\0' 第一次出现的位置
+static const char* lexFind(const char *p, char c){
+#if defined(__AVX2__)
+    const __m256i target = _mm256_set1_epi8(c), zero = _mm256_setzero_si256();
+    while(true){
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        uint32_t mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, target), _mm256_cmpeq_epi8(v, zero)));
+        if(mask != 0){
+            return p + __builtin_ctz(mask);
+        }
+        p += 32;
+    }
+#elif defined(__SSE2__)
+    const __m128i target = _mm_set1_epi8(c), zero = _mm_setzero_si128();
+    while(true){
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        uint32_t mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, target), _mm_cmpeq_epi8(v, zero)));
+        if(mask != 0){
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+#else
+    while(*p != c && *p != '\0'){
+        p++;
+    }
+    return p;
+#endif
+}
+
+
+static void lexReset(const string &text){
+    lexBuf = text;
+    lexBuf.append(lexPadding, '\0');
+    lexCur = lexBuf.data();
+    lexEnd = lexCur + text.size();
+}
+
+static string lexReadInput(){
+    string text;
+    char buf[65536];
+    size_t n;
+    while((n = fread(buf, 1, sizeof(buf), yyin)) > 0){
+        text.append(buf, n);
+    }
+    return text;
+}
+
+// 扫描下一个 token，返回它的种类。start 是它在输入中的位置，标识符的长度放在 len，整数的值放在 value
+static int lexScan(const char *&start, int &len, int &value){
+    // 空白和注释
+    const char *p = lexCur;
+    while(true){
+        p = lexSkipSpace(p);
+        if(p[0] == '/' && p[1] == '/'){
+            // 和 sysy.l 的 "//"[^\n]* 一样到换行或输入末尾为止，注释里的 '\0' 也跳过
+            p += 2;
+            while((p = lexFind(p, '\n')) < lexEnd && *p != '\n'){
+                p++;
+            }
+        }else if(p[0] == '/' && p[1] == '*'){
+            const char *q = p + 2;
+            while(true){
+                q = lexFind(q, '*');
+                if(q >= lexEnd || (*q == '*' && q[1] == '/')){
+                    break;
+                }
+                q++;
+            }
+            if(q >= lexEnd){
+                // 没有结束的注释，flex 的 Comment 匹配不上，退回到单个字符的规则，先返回 '/'
+                break;
+            }
+            p = q + 2;
+        }else{
+            break;
+        }
+    }
+    if(p >= lexEnd){
+        lexCur = start = lexEnd;
+        return 0;
+    }
+
+    start = p;
+    switch(lexTable.cls[(unsigned char)*p]){
+        case LEX_IDENT:{
+            while(lexTable.idChar[(unsigned char)*p]){
+                p++;
+            }
+            lexCur = p;
+            len = p - start;
+            int kw = lexKeyword(start, len);
+            return kw != 0 ? kw : IDENT;
+        }
+        case LEX_DIGIT:{
+            // 和 strtol 一样分十进制、八进制（0 开头）、十六进制（0x 开头），溢出时按 32 位回绕
+            uint32_t v = 0;
+            if(p[0] == '0' && (p[1] == 'x' || p[1] == 'X') && isxdigit((unsigned char)p[2])){
+                p += 2;
+                while(isxdigit((unsigned char)*p)){
+                    v = v * 16 + (*p <= '9' ? *p - '0' : (*p | 0x20) - 'a' + 10);
+                    p++;
+                }
+            }else if(p[0] == '0'){
+                p++;
+                while(*p >= '0' && *p <= '7'){
+                    v = v * 8 + (*p - '0');
+                    p++;
+                }
+            }else{
+                while(lexTable.cls[(unsigned char)*p] == LEX_DIGIT){
+                    v = v * 10 + (*p - '0');
+                    p++;
+                }
+            }
+            lexCur = p;
+            value = (int)v;
+            return INT_CONST;
+        }
+        case LEX_OP:{
+            char c = p[0], d = p[1];
+            lexCur = p + 2;
+            if(d == '=' && (c == '<' || c == '>' || c == '=' || c == '!')){
+                return c == '<' ? LEQUAL : c == '>' ? GEQUAL : c == '=' ? EQUAL : NEQUAL;
+            }
+            if(c == d && (c == '|' || c == '&')){
+                return c == '|' ? OR : AND;
+            }
+            lexCur = p + 1;
+            return c;
+        }
+        default:
+            lexCur = p + 1;
+            return *p;
+    }
+}
+
+static const char *lexLast = nullptr; // 上一个 token 的位置，报错时用
+
+static int handLex(){
+    if(lexCur == nullptr){
+        lexReset(lexReadInput());
+    }
+    int len = 0, value = 0;
+    int token = lexScan(lexLast, len, value);
+    if(token == IDENT){
+        yylval.sym_val = lexIntern(string_view(lexLast, len));
+    }else if(token == INT_CONST){
+        yylval.int_val = value;
+    }
+    return token;
+}
+
+
+// -fthread-lexer：手写的扫描器在另一个线程上运行，和 parser 之间用单生产者单消费者的环形缓冲区传递 token。
+// token 记成定长的记录（种类、整数的值或标识符的符号编号、在输入中的位置），标识符在扫描线程里查表编号，
+// 符号表只记名字在输入中的位置。编号按第一次出现的顺序分配，parser 所在的线程第一次读到一个编号时
+// 把名字追加到 lexNames，编号就是名字在 lexNames 中的下标，每个名字只复制一次，之后只传编号
+// 两边各自缓存对方的下标，每 lexBatch 个 token 才公布一次自己的下标，等待对方之前先公布，不会互相等死。
+// 符号表按输入长度的一半预先分配（每个标识符后面至少跟着一个别的字符），扫描线程写入时不会搬动，
+// 写在公布下标之前，parser 线程读到这个 token 时名字已经写好了
+struct LexToken{
+    int kind;
+    int value;       // INT_CONST 的值，IDENT 的符号编号
+    uint32_t offset; // 在输入中的位置
+};
+
+struct LexSymbol{
+    uint32_t offset, len;
+};
+
+static const size_t lexRingSize = 1 << 18;
+static const size_t lexBatch = 64;
+
+struct LexRing{
+    LexToken tokens[lexRingSize];
+    alignas(64) atomic<size_t> head{0}; // parser 下一个要读的位置
+    alignas(64) atomic<size_t> tail{0}; // 扫描线程下一个要写的位置
+    atomic<bool> stop{false};           // parser 提前结束（语法错误），扫描线程不用再等空位
+};
+
+static bool useThreadLexer = false;
+static LexRing lexRing;
+static unique_ptr<LexSymbol[]> lexSymbols;
+static thread lexThread;
+static size_t lexHead = 0, lexTailSeen = 0; // parser 线程读到的位置和见到的扫描线程的位置
+
+static void lexProduce(){
+    unordered_map<string_view, int> ids;
+    size_t head = 0, tail = 0;
+    while(true){
+        LexToken t;
+        const char *start;
+        int len = 0;
+        t.value = 0;
+        t.kind = lexScan(start, len, t.value);
+        t.offset = start - lexBuf.data();
+        if(t.kind == IDENT){
+            auto r = ids.emplace(string_view(start, len), (int)ids.size());
+            if(r.second){
+                lexSymbols[r.first->second] = {t.offset, (uint32_t)len};
+            }
+            t.value = r.first->second;
+        }
+        while(tail - head == lexRingSize){
+            lexRing.tail.store(tail, memory_order_release);
+            head = lexRing.head.load(memory_order_acquire);
+            if(tail - head == lexRingSize){
+                if(lexRing.stop.load(memory_order_relaxed)){
+                    return;
+                }
+                this_thread::yield();
+            }
+        }
+        lexRing.tokens[tail % lexRingSize] = t;
+        tail++;
+        if(t.kind == 0 || tail % lexBatch == 0){
+            lexRing.tail.store(tail, memory_order_release);
+        }
+        if(t.kind == 0){
+            return;
+        }
+    }
+}
+
+// 在 lexReset 之后启动扫描线程
+static void lexThreadStart(){
+    lexRing.head.store(0);
+    lexRing.tail.store(0);
+    lexRing.stop.store(false);
+    lexHead = lexTailSeen = 0;
+    lexNames.clear();
+    lexNameIds.clear();
+    lexSymbols.reset(new LexSymbol[lexBuf.size() / 2 + 1]);
+    lexThread = thread(lexProduce);
+}
+
+// parser 结束后等扫描线程退出
+static void lexThreadFinish(){
+    if(lexThread.joinable()){
+        lexRing.stop.store(true);
+        lexThread.join();
+    }
+}
+
+static int threadLex(){
+    if(!lexThread.joinable()){
+        lexReset(lexReadInput());
+        lexThreadStart();
+    }
+    if(lexHead == lexTailSeen){
+        lexRing.head.store(lexHead, memory_order_release);
+        while((lexTailSeen = lexRing.tail.load(memory_order_acquire)) == lexHead){
+            this_thread::yield();
+        }
+    }
+    LexToken t = lexRing.tokens[lexHead % lexRingSize];
+    if(++lexHead % lexBatch == 0){
+        lexRing.head.store(lexHead, memory_order_release);
+    }
+    lexLast = lexBuf.data() + t.offset;
+    if(t.kind == IDENT){
+        if(t.value == (int)lexNames.size()){
+            const LexSymbol &sym = lexSymbols[t.value];
+            lexNames.emplace_back(lexBuf.data() + sym.offset, sym.len);
+        }
+        yylval.sym_val = t.value;
+    }else if(t.kind == INT_CONST){
+        yylval.int_val = t.value;
+    }
+    return t.kind;
+}
+
+
+int yylex(){
+    if(useThreadLexer){
+        return threadLex();
+    }
+    return useHandLexer ? handLex() : flex_yylex();
+}
+
+// -dump-tokens：用选定的扫描器扫描整个输入，每行一个 token：种类，标识符的名字或者整数的值
+// 比较不同扫描器的输出，见 tests/lex.sh
+static void dumpTokens(ostream &out){
+    for(int t; (t = yylex()) != 0;){
+        out << t;
+        if(t == IDENT){
+            out << " " << lexNames[yylval.sym_val];
+        }else if(t == INT_CONST){
+            out << " " << yylval.int_val;
+        }
+        out << "\n";
+    }
+}
+
+// 语法错误的位置（行号、列号），只有手写的扫描器知道；见 sysy.y 的 yyerror
+string lexPosition(){
+    if(lexLast == nullptr || !(useHandLexer || useThreadLexer)){
+        return "";
+    }
+    int line = 1;
+    const char *lineStart = lexBuf.data();
+    for(const char *p = lexBuf.data(); p < lexLast; p++){
+        if(*p == '\n'){
+            line++;
+            lineStart = p + 1;
+        }
+    }
+    return " at line " + to_string(line) + ", column " + to_string(lexLast - lineStart + 1);
+}
+
+
+// -bench-lex：分别用两个扫描器把输入扫描几遍，取最快的一次比较每秒的 token 数
+static void benchLexers(const char *path, ostream &out){
+    ifstream in(path, ios::binary);
+    stringstream ss;
+    ss << in.rdbuf();
+    string text = ss.str();
+    const int rounds = 5;
+
+    auto run = [&](bool hand, long long &tokens){
+        double best = 1e100;
+        for(int r = 0; r < rounds; r++){
+            FILE *f = nullptr;
+            if(hand){
+                lexReset(text);
+            }else{
+                f = fopen(path, "r");
+                yyin = f;
+                yyrestart(f);
+            }
+            tokens = 0;
+            auto begin = chrono::steady_clock::now();
+            while((hand ? handLex() : flex_yylex()) != 0){
+                tokens++;
+            }
+            best = min(best, chrono::duration<double>(chrono::steady_clock::now() - begin).count());
+            if(f != nullptr){
+                fclose(f);
+            }
+        }
+        return best;
+    };
+
+    long long flexTokens = 0, handTokens = 0;
+    double flexTime = run(false, flexTokens);
+    double handTime = run(true, handTokens);
+    auto report = [&](const char *name, long long tokens, double t){
+        out << name << ": " << tokens << " tokens, " << t * 1000 << " ms, "
+            << tokens / t / 1e6 << " Mtokens/s, " << text.size() / t / 1e6 << " MB/s" << endl;
+    };
+    out << "input: " << text.size() << " bytes" << endl;
+    report("flex", flexTokens, flexTime);
+    report("hand", handTokens, handTime);
+    if(flexTokens != handTokens){
+        out << "warning: token counts differ" << endl;
+    }
+    out << "speedup: " << flexTime / handTime << "x" << endl;
+}
+
+
+// -bench-frontend：整个前端（扫描、语法分析、建出语法树）的时间，分别用 flex、手写的扫描器和 -fthread-lexer，
+// 各做几遍取最快的一次。读入和释放语法树不计时间。释放一棵大的语法树之后堆里满是碎片，接着建树会慢好几倍，
+// 所以每一遍都在 fork 出来的子进程里做，通过管道把时间传回来
+static double benchInChild(const function<double()> &run){
+    int fds[2];
+    if(pipe(fds) != 0){
+        return run();
+    }
+    pid_t pid = fork();
+    if(pid == 0){
+        double t = run();
+        ssize_t n = write(fds[1], &t, sizeof(t));
+        _exit(n == sizeof(t) ? 0 : 1);
+    }
+    close(fds[1]);
+    double t = 1e100;
+    if(pid < 0 || read(fds[0], &t, sizeof(t)) != sizeof(t)){
+        t = 1e100;
+    }
+    close(fds[0]);
+    if(pid > 0){
+        waitpid(pid, nullptr, 0);
+    }
+    return t;
+}
+
+static void benchFrontend(const char *path, ostream &out){
+    ifstream in(path, ios::binary);
+    stringstream ss;
+    ss << in.rdbuf();
+    string text = ss.str();
+    const int rounds = 3;
+    bool hand = useHandLexer, threaded = useThreadLexer;
+
+    // 一遍：在子进程里扫描并建出语法树，返回所用的时间，语法错误时返回 1e100。子进程直接退出，不释放语法树
+    auto once = [&](){
+        FILE *f = nullptr;
+        if(useHandLexer || useThreadLexer){
+            lexReset(text);
+        }else{
+            f = fopen(path, "r");
+            yyin = f;
+            yyrestart(f);
+        }
+        unique_ptr<BaseAST> ast;
+        auto begin = chrono::steady_clock::now();
+        if(useThreadLexer){
+            lexThreadStart();
+        }
+        int ret = yyparse(ast);
+        lexThreadFinish();
+        double t = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+        ast.release();
+        return ret == 0 ? t : 1e100;
+    };
+    auto run = [&](bool useHand, bool useThread){
+        useHandLexer = useHand;
+        useThreadLexer = useThread;
+        double best = 1e100;
+        for(int r = 0; r < rounds; r++){
+            best = min(best, benchInChild(once));
+        }
+        return best;
+    };
+
+    double flexTime = run(false, false);
+    double handTime = run(true, false);
+    double threadTime = run(false, true);
+    if(max(flexTime, max(handTime, threadTime)) >= 1e100){
+        out << "error: the input cannot be parsed" << endl;
+        return;
+    }
+    useHandLexer = hand;
+    useThreadLexer = threaded;
+    auto report = [&](const char *name, double t){
+        out << name << ": " << t * 1000 << " ms, " << text.size() / t / 1e6 << " MB/s" << endl;
+    };
+    out << "input: " << text.size() << " bytes" << endl;
+    report("flex", flexTime);
+    report("hand", handTime);
+    report("thread", threadTime);
+    out << "speedup: " << handTime / threadTime << "x over hand, " << flexTime / threadTime << "x over flex" << endl;
+}
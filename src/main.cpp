@@ -5,8 +5,15 @@
 #include <sstream>
 #include <memory>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include "ast.hpp"
 #include "riscv.hpp"
+#include "elf.hpp"
+#include "interp.hpp"
+#include "lexer.hpp"
+#include "opt.hpp"
+#include "raw.hpp"
 
 using namespace std;
 
@@ -19,60 +26,290 @@ extern FILE *yyin;
 extern int yyparse(unique_ptr<BaseAST> &ast);
 //extern stack<unordered_map<string,entry> > symbolTableStack;
 
-//void riscv_parse(const char* str);
+// cout重定向到字符串，得到 koopa 文本
+static string dumpKoopa(BaseAST *ast){
+  stringstream ss;
+  streambuf* coutBuf = cout.rdbuf(ss.rdbuf());
+  ast->Dump();
+  cout.rdbuf(coutBuf);
+  return ss.str();
+}
+
+// -fstream：不保留整个程序的 AST 和 koopa。parser 每归约出一个函数定义或全局声明就立刻生成它的 koopa 和汇编，
+// 写到输出文件后释放。跨函数只保留全局变量的 koopa 定义和已输出函数的声明，
+// 每个函数的 koopa 前面只拼上它用到的那些，后端不会重复输出已经输出过的全局变量
+static bool streamMode = false;
+static bool streamKoopa = false;            // -koopa 时直接输出 koopa 文本
+static unordered_map<string, string> streamDefs; // 带 @ 的名字到全局变量的定义或函数的声明
+
+// m 中的函数调用的函数和用到的全局变量，按第一次出现的顺序拼成它们的定义或声明
+static string streamPrefixFor(const IrModule &m){
+  string prefix;
+  unordered_set<string> seen;
+  auto need = [&](const string &name){
+    auto it = streamDefs.find(name);
+    if(it != streamDefs.end() && seen.insert(name).second){
+      prefix += it->second;
+    }
+  };
+  for(const IrFunc &f : m.funcs){
+    for(const IrInst &inst : f.insts){
+      if(inst.op == IR_CALL){
+        need(inst.callee);
+      }
+      for(int a : inst.args){
+        if(f.names[a][0] == '@'){
+          need(f.names[a]);
+        }
+      }
+    }
+  }
+  return prefix;
+}
+
+// 流式处理时把 prefix 中的声明和全局变量放在 m 的开头，m 中的调用和全局变量都有定义
+static void streamBuildRaw(IrModule &m, const string &prefix, IrRawProgram &raw){
+  IrModule defs = irParse(prefix, false);
+  m.items.insert(m.items.begin(), defs.items.begin(), defs.items.end());
+  irBuildRaw(m, raw);
+}
+
+bool streamTopLevel(BaseAST *item){
+  if(!streamMode){
+    return false;
+  }
+  int vecFrom = vecKernels.size();
+  string text = dumpKoopa(item);
+  text = vecDecls(vecFrom) + text;
+  IrModule m = optimizeModule(text, false);
+  text = irPrint(m);
+  auto func = dynamic_cast<FuncDefAST*>(item);
+  if(streamKoopa){
+    cout << text;
+    if(emitStats && func != nullptr){
+      IrRawProgram raw;
+      streamBuildRaw(m, streamPrefixFor(m), raw);
+      statsKoopaProgram(raw.raw);
+    }
+  }else if(!text.empty()){
+    IrRawProgram raw;
+    streamBuildRaw(m, func != nullptr ? streamPrefixFor(m) : "", raw);
+    riscv_generate(raw.raw);
+    dumpAsm();
+    asmLines.clear();
+  }
+  if(func != nullptr){
+    streamDefs["@" + func->ident] = func->declStr() + "\n";
+  }else{
+    // 全局声明，每行一个 global @名字 = ...
+    stringstream lines(text);
+    for(string line; getline(lines, line);){
+      size_t at = line.find('@');
+      streamDefs[line.substr(at, line.find(' ', at) - at)] = line + "\n";
+    }
+  }
+  if(func == nullptr || !pureFuncs.count(func->ident)){ // 纯函数的语法树留给后面的编译期求值
+    delete item;
+  }
+  return true;
+}
+
+// -emit-stats：把前端记下的块数和临时变量数并入统计，写出 JSON
+static void finishStats(const string &path){
+  for(auto &c : funcDumpCounts){
+    FuncStats &st = statsOf(c.ident);
+    st.blocks = c.blocks;
+    st.temps = c.temps;
+  }
+  writeStats(path);
+}
 
 int main(int argc, const char *argv[]) {
   // 解析命令行参数. 测试脚本/评测平台要求你的编译器能接收如下参数:
-  // compiler 模式 输入文件 -o 输出文件
-  assert(argc == 5);
+  // compiler 模式 输入文件 -o 输出文件 [选项...]
+  assert(argc >= 5);
   auto mode = argv[1];
   auto input = argv[2];
   auto output = argv[4];
+  bool profileGenerate = false;
+  string profileUse;
+  string statsPath;
+  for(int i = 5; i < argc; i++){
+    string opt = argv[i];
+    if(opt == "-fprofile-generate"){
+      profileGenerate = true;
+    }else if(opt.compare(0, 14, "-fprofile-use=") == 0){
+      profileUse = opt.substr(14);
+    }else if(opt == "-fhand-lexer"){
+      useHandLexer = true;
+    }else if(opt == "-fthread-lexer"){
+      useThreadLexer = true;
+    }else if(opt == "-fbatch-io"){
+      batchIO = true;
+    }else if(opt == "-fschedule"){
+      scheduleInsts = true;
+    }else if(opt.compare(0, 16, "-fsched-latency=") == 0){
+      parseSchedLatency(opt.substr(16));
+    }else if(opt == "-march=rv32imv"){
+      vectorizeLoops = true;
+    }else if(opt == "-march=rv32im"){
+      vectorizeLoops = false;
+    }else if(opt == "-fno-unroll-loops"){
+      unrollLoops = false;
+    }else if(opt == "-fno-sccp"){
+      sccpEnabled = false;
+    }else if(opt == "-O0" || opt == "-O1" || opt == "-O2"){
+      optLevel = opt[2] - '0';
+    }else if(opt == "-time-passes"){
+      timePasses = true;
+    }else if(opt == "-fstream"){
+      streamMode = true;
+    }else if(opt.compare(0, 12, "-emit-stats=") == 0){
+      emitStats = true;
+      statsPath = opt.substr(12);
+    }
+  }
+
+  if(string(mode) == "-bench-lex"){
+    // 比较 flex 生成的扫描器和手写的扫描器的速度，结果写到输出文件
+    ofstream of(output);
+    benchLexers(input, of);
+    return 0;
+  }
+  if(string(mode) == "-bench-frontend"){
+    // 比较三种扫描方式下整个前端的速度，结果写到输出文件
+    ofstream of(output);
+    benchFrontend(input, of);
+    return 0;
+  }
 
   // 打开输入文件, 并且指定 lexer 在解析的时候读取这个文件
   yyin = fopen(input, "r");
   assert(yyin);
 
+  if(string(mode) == "-dump-tokens"){
+    // 输出扫描器得到的 token 序列，用来比较 flex 和手写的扫描器
+    ofstream of(output);
+    dumpTokens(of);
+    lexThreadFinish();
+    return 0;
+  }
+
+  if(vectorizeLoops && string(mode) != "-riscv" && string(mode) != "-obj"){
+    // 向量循环只有后端能展开，koopa 和解释器里没有对应的函数
+    cerr << "warning: -march=rv32imv only applies to -riscv and -obj, ignored" << endl;
+    vectorizeLoops = false;
+  }
+  if(streamMode){
+    // 目标文件要等所有函数的汇编都生成后才能写出，-run 和 profile 需要整个程序，这些情况不按函数流式处理
+    if(string(mode) != "-koopa" && string(mode) != "-riscv"){
+      cerr << "warning: -fstream only applies to -koopa and -riscv, ignored" << endl;
+      streamMode = false;
+    }else if(profileGenerate || !profileUse.empty()){
+      cerr << "warning: -fstream cannot be used with profile options, ignored" << endl;
+      streamMode = false;
+    }
+  }
+  if(streamMode){
+    ofstream of(output);
+    streambuf* coutBuf = cout.rdbuf(of.rdbuf());
+    streamKoopa = mode[1] == 'k';
+    // 运行时库的声明和已输出函数的声明一样，按需拼到每个函数前面；-koopa 时在开头输出一次
+    stringstream decls(runtimeDecls);
+    for(string line; getline(decls, line);){
+      size_t at = line.find('@');
+      streamDefs[line.substr(at, line.find('(', at) - at)] = line + "\n";
+    }
+    if(streamKoopa){
+      cout << runtimeDecls << endl;
+    }
+    unique_ptr<BaseAST> ast;
+    auto ret = yyparse(ast);
+    lexThreadFinish();
+    cout.rdbuf(coutBuf);
+    if(ret){
+      return 1;
+    }
+    if(emitStats){
+      finishStats(statsPath);
+    }
+    if(timePasses){
+      irReportTimes(cerr);
+    }
+    return 0;
+  }
+
+  // profile 要在生成 koopa 之前读入，循环展开时用到
+  if(!profileUse.empty()){
+    profileRead(profileUse);
+  }
+
   // 调用 parser 函数, parser 函数会进一步调用 lexer 解析输入文件的
   unique_ptr<BaseAST> ast;
   auto ret = yyparse(ast);
-  assert(!ret);
+  lexThreadFinish();
+  if(ret){
+    return 1;
+  }
+
+  // 语法树和 koopa 文本用完就释放，大的输入上它们占了内存峰值的大部分
+  string koopa = dumpKoopa(ast.get());
+  ast.reset();
+  koopa.insert(0, vecDecls(0));
+  IrModule m = optimizeModule(koopa, true);
+  string().swap(koopa);
+  streambuf* coutBuf = cout.rdbuf();
 
+  if(profileGenerate){
+    // 插桩按行改写 koopa 文本，改完再解析回来
+    m = irParse(profileInstrument(irPrint(m)), true);
+  }
+
+  // 后端直接读由 IrModule 构建的 raw program，建好后 IrModule 就不再需要
+  IrRawProgram raw;
   if(mode[1] == 'k'){
     // mode == -koopa
-    // cout重定向
-    streambuf* coutBuf = cout.rdbuf();
     ofstream of(output);
-    streambuf* fileBuf = of.rdbuf();
-    cout.rdbuf(fileBuf);
-  
-    // 输出解析得到的 AST
-    ast->Dump(); 
-    cout << endl;
-
-    // 恢复cout重定向
-    cout.rdbuf(coutBuf);
-  }else{
-    // -riscv
-    // cout重定向到字符串
-    streambuf* coutBuf = cout.rdbuf();
-    stringstream ss;
-    cout.rdbuf(ss.rdbuf());
+    of << irPrint(m) << endl;
+  }
+  if(mode[1] != 'k' || emitStats){
+    irBuildRaw(m, raw);
+    m = IrModule();
+  }
 
-    ast->Dump();
-    string s(ss.str());
+  if(emitStats && (mode[1] == 'k' || string(mode) == "-run")){
+    statsKoopaProgram(raw.raw);
+  }
 
-    // cout重定向到输出文件
+  int exitCode = 0;
+  if(string(mode) == "-run"){
+    // -run: 解释执行 koopa，程序的输入输出走标准输入输出，执行统计写到输出文件
     ofstream of(output);
+    exitCode = runKoopa(raw.raw, of) & 0xff;
+  }else if(mode[1] != 'k'){
+    // -riscv 或 -obj
+    // cout重定向到输出文件
+    ofstream of(output, ios::binary);
     streambuf* fileBuf = of.rdbuf();
     cout.rdbuf(fileBuf);
 
-    riscv_parse(s.c_str());
+    riscv_generate(raw.raw);
+    if(mode[1] == 'o'){
+      // -obj: 直接输出目标文件
+      dumpObject();
+    }else{
+      dumpAsm();
+    }
 
     // 恢复cout重定向
     cout.rdbuf(coutBuf);
-
   }
 
-  return 0;
+  if(emitStats){
+    finishStats(statsPath);
+  }
+  if(timePasses){
+    irReportTimes(cerr);
+  }
+  return exitCode;
 }
@@ -0,0 +1,867 @@
+#pragma once
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ir.hpp"
+#include "sccp.hpp"
+
+using namespace std;
+
+// 优化级别和各级别的 pass 序列
+// -O0 不做优化，前端的 koopa 原样交给后端；-O1（默认）是 looprotate、sccp、reassociate、dce、simplifycfg；
+// -O2 在 looprotate 之后加上 loadelim，让 sccp 看到按路径区分的值，在 reassociate 之后加上 gvn、licm。
+// looprotate 要在 loadelim 之前，否则循环头部 load 的值会被带进循环体，头部的值不再只在头部使用，就不能旋转了
+// reassociate 在 sccp 之后，已知是常数的变量都换成了常数，可以和别的常数合并；换下来的叶子留给 dce。
+// gvn 在 reassociate 之后，重新组合出来的相同的子树也能合并
+
+
+static int optLevel = 1;
+
+
+// 删除死代码：结果没人用的运算、load、地址计算、确定会返回的纯函数和只读函数的调用，以及没有 load 的变量的 store 和 alloc
+static unsigned dcePass(IrModule &m, IrFunc &f, IrAnalyses &am){
+    const IrDefUse &du = am.defUse();
+    int n = du.def.size();
+    vector<int> uses(n, 0), loads(n, 0), allocOf(n, -1), work;
+    for(int v = 0; v < n; v++){
+        uses[v] = du.users[v].size();
+        if(du.def[v] >= 0){
+            work.push_back(du.def[v]);
+        }
+    }
+    // 没有 load 的变量：它的 alloc 和 store 都可以删
+    for(const IrBlock &bb : f.blocks){
+        for(int i : bb.insts){
+            const IrInst &inst = f.insts[i];
+            if(inst.op == IR_LOAD && du.scalar[inst.args[0]]){
+                loads[inst.args[0]]++;
+            }else if(inst.op == IR_ALLOC && du.scalar[inst.dest]){
+                allocOf[inst.dest] = i;
+            }
+        }
+    }
+    for(int v = 0; v < n; v++){
+        if(allocOf[v] >= 0 && loads[v] == 0){
+            work.insert(work.end(), du.users[v].begin(), du.users[v].end());
+            work.push_back(allocOf[v]);
+        }
+    }
+    bool changed = false;
+    while(!work.empty()){
+        IrInst &inst = f.insts[work.back()];
+        work.pop_back();
+        if(inst.removed){
+            continue;
+        }
+        bool dead = false;
+        if(f.isTemp(inst.dest) && uses[inst.dest] == 0 &&
+           (inst.op == IR_LOAD || inst.op == IR_GETELEMPTR || inst.op == IR_GETPTR || irIsBinary(inst.op) ||
+            (inst.op == IR_CALL && irEffectsOf(inst.callee).kind != IR_SIDEEFFECT && irEffectsOf(inst.callee).terminates))){
+            dead = true;
+        }else if(inst.op == IR_ALLOC || inst.op == IR_STORE){
+            int var = inst.op == IR_ALLOC ? inst.dest : inst.args[1];
+            dead = du.scalar[var] && loads[var] == 0;
+        }
+        if(!dead){
+            continue;
+        }
+        inst.removed = true;
+        changed = true;
+        for(int a : inst.args){
+            if(--uses[a] == 0 && du.def[a] >= 0){
+                work.push_back(du.def[a]);
+            }
+        }
+        if(inst.op == IR_LOAD && du.scalar[inst.args[0]] && --loads[inst.args[0]] == 0){
+            int var = inst.args[0];
+            work.insert(work.end(), du.users[var].begin(), du.users[var].end());
+            work.push_back(allocOf[var]);
+        }
+    }
+    if(!changed){
+        return IR_ALL;
+    }
+    irSweep(f);
+    return IR_CFG;
+}
+
+
+// 合并基本块。br 改成 jump 后常常留下只有一条 jump 的空块和一串只有一个前驱的块：
+// 跳到空块的直接跳到它的目标，jump 到只有一个前驱的块时把那个块接在后面，走不到的块删掉
+static unsigned simplifyCfgPass(IrModule &m, IrFunc &f, IrAnalyses &am){
+    const IrCfg &cfg = am.cfg();
+    int n = f.blocks.size();
+    vector<int> last(n), single(n, -1);
+    for(int b = 0; b < n; b++){
+        last[b] = f.blocks[b].insts.back();
+        if(b != 0 && f.blocks[b].insts.size() == 1 && f.insts[last[b]].op == IR_JUMP){
+            single[b] = cfg.succs[b][0];
+        }
+    }
+    // 顺着空块找到最终的目标，记下路上每个块的结果。空块组成的环停在进入环的地方
+    vector<int> resolved(n, -1), onPath(n, 0);
+    int pathId = 0;
+    auto target = [&](int b){
+        vector<int> path;
+        pathId++;
+        while(resolved[b] < 0 && single[b] >= 0 && onPath[b] != pathId){
+            onPath[b] = pathId;
+            path.push_back(b);
+            b = single[b];
+        }
+        int t = resolved[b] >= 0 ? resolved[b] : b;
+        for(int p : path){
+            resolved[p] = t;
+        }
+        return t;
+    };
+    bool changed = false;
+    vector<int> preds(n, 0), stack = {0};
+    vector<bool> reached(n, false);
+    reached[0] = true;
+    while(!stack.empty()){
+        int b = stack.back();
+        stack.pop_back();
+        IrInst &term = f.insts[last[b]];
+        if(term.op != IR_JUMP && term.op != IR_BR){
+            continue;
+        }
+        for(size_t k = term.op == IR_BR ? 1 : 0; k < term.args.size(); k++){
+            int t = target(cfg.blockOf[term.args[k]]);
+            if(term.args[k] != f.blocks[t].label){
+                term.args[k] = f.blocks[t].label;
+                changed = true;
+            }
+            preds[t]++;
+            if(!reached[t]){
+                reached[t] = true;
+                stack.push_back(t);
+            }
+        }
+    }
+
+    vector<IrBlock> blocks;
+    vector<bool> done(n, false);
+    for(int b = 0; b < n; b++){
+        if(!reached[b] || done[b]){
+            changed = true;
+            continue;
+        }
+        blocks.emplace_back();
+        blocks.back().label = f.blocks[b].label;
+        for(int cur = b; cur >= 0;){
+            done[cur] = true;
+            int succ = -1;
+            if(f.insts[last[cur]].op == IR_JUMP){
+                succ = cfg.blockOf[f.insts[last[cur]].args[0]];
+                if(succ == 0 || preds[succ] != 1 || done[succ]){
+                    succ = -1;
+                }
+            }
+            vector<int> &insts = blocks.back().insts;
+            insts.insert(insts.end(), f.blocks[cur].insts.begin(), f.blocks[cur].insts.end());
+            if(succ >= 0){
+                insts.pop_back();
+                f.insts[last[cur]].removed = true;
+                changed = true;
+            }
+            cur = succ;
+        }
+    }
+    if(!changed){
+        return IR_ALL;
+    }
+    // 被删掉的块里的指令也标记为删除
+    for(int b = 0; b < n; b++){
+        if(!reached[b]){
+            for(int i : f.blocks[b].insts){
+                f.insts[i].removed = true;
+            }
+        }
+    }
+    f.blocks = move(blocks);
+    return 0;
+}
+
+
+// 局部变量的 load 换成已知的值：块内 store 之后的 load 直接用存进去的值，再次 load 用上一次的结果。
+// 只有一个前驱的块接着用前驱结束时的已知值，沿逆后序处理，值的定义总在使用之前。
+// 这些变量的地址没有被拿去用，指针的 store 和函数调用都改不了它们
+// 存入的是参数时不记下：后端只在入口处读 a 寄存器里的参数，之后的调用和变量的寄存器都会改写它
+static unsigned loadElimPass(IrModule &m, IrFunc &f, IrAnalyses &am){
+    const IrCfg &cfg = am.cfg();
+    const IrDefUse &du = am.defUse();
+    int n = f.blocks.size();
+    vector<bool> isParam(f.names.size(), false);
+    for(int p : f.params){
+        isParam[p] = true;
+    }
+    // 块结束时的已知值（变量到值的编号），留给只有一个前驱的后继，最后一个后继用完时释放
+    vector<unordered_map<int, int> > known(n);
+    vector<int> pending(n, 0);
+    for(int b = 0; b < n; b++){
+        for(int s : cfg.succs[b]){
+            pending[b] += s != 0 && cfg.preds[s].size() == 1;
+        }
+    }
+    vector<int> repl(f.names.size(), -1); // 删掉的 load 的结果到替代它的值
+    bool changed = false;
+    auto replace = [&](IrInst &inst){
+        for(int &a : inst.args){
+            if(repl[a] >= 0){
+                a = repl[a];
+            }
+        }
+    };
+    for(int b : cfg.rpo){
+        unordered_map<int, int> cur;
+        if(b != 0 && cfg.preds[b].size() == 1){
+            int p = cfg.preds[b][0];
+            if(--pending[p] == 0){
+                cur = move(known[p]);
+            }else{
+                cur = known[p];
+            }
+        }
+        for(int i : f.blocks[b].insts){
+            IrInst &inst = f.insts[i];
+            replace(inst);
+            if(inst.op == IR_LOAD && du.scalar[inst.args[0]]){
+                auto k = cur.find(inst.args[0]);
+                if(k != cur.end()){
+                    repl[inst.dest] = k->second;
+                    inst.removed = true;
+                    changed = true;
+                }else{
+                    cur[inst.args[0]] = inst.dest;
+                }
+            }else if(inst.op == IR_STORE && du.scalar[inst.args[1]]){
+                if(isParam[inst.args[0]]){
+                    cur.erase(inst.args[1]);
+                }else{
+                    cur[inst.args[1]] = inst.args[0];
+                }
+            }
+        }
+        if(pending[b] > 0){
+            known[b] = move(cur);
+        }
+    }
+    if(!changed){
+        return IR_ALL;
+    }
+    // 走不到的块不在逆后序里，也可能用到被删掉的 load
+    vector<bool> visited(n, false);
+    for(int b : cfg.rpo){
+        visited[b] = true;
+    }
+    for(int b = 0; b < n; b++){
+        if(!visited[b]){
+            for(int i : f.blocks[b].insts){
+                replace(f.insts[i]);
+            }
+        }
+    }
+    irSweep(f);
+    return IR_CFG;
+}
+
+
+// 循环旋转：while 循环的头部 H 计算条件，以 br 结束，循环体的末尾和 continue 都 jump 回 H，
+// 每次迭代要执行一次 jump 和一次 br。把 H 的指令复制到每条回边的 jump 处（定义的值换成新的临时变量），
+// 循环体末尾直接按条件跳回循环体或者跳出；H 只在进入循环时执行一次，成了循环前的判断
+// 回边是逆后序中不往前走的边，前端生成的控制流图都是可归约的，H 支配这些块，H 用到的外面的值在复制处也可用
+// H 中定义的值只在 H 里用到、H 里没有 alloc、复制的总量不超过 rotateMaxInsts 条时才旋转
+static const int rotateMaxInsts = 64;
+
+static unsigned loopRotatePass(IrModule &m, IrFunc &f, IrAnalyses &am){
+    const IrCfg &cfg = am.cfg();
+    const IrDefUse &du = am.defUse();
+    int n = f.blocks.size();
+    vector<int> order(n, -1), instBlock(f.insts.size(), -1);
+    for(int k = 0; k < (int)cfg.rpo.size(); k++){
+        order[cfg.rpo[k]] = k;
+    }
+    for(int b = 0; b < n; b++){
+        for(int i : f.blocks[b].insts){
+            instBlock[i] = b;
+        }
+    }
+    bool changed = false;
+    for(int h = 1; h < n; h++){
+        if(order[h] < 0 || f.insts[f.blocks[h].insts.back()].op != IR_BR){
+            continue;
+        }
+        vector<int> latches;
+        for(int p : cfg.preds[h]){
+            if(order[p] >= order[h] && f.insts[f.blocks[p].insts.back()].op == IR_JUMP){
+                latches.push_back(p);
+            }
+        }
+        vector<int> header = f.blocks[h].insts;
+        if(latches.empty() || header.size() * latches.size() > rotateMaxInsts){
+            continue;
+        }
+        bool local = true;
+        for(int i : header){
+            const IrInst &inst = f.insts[i];
+            if(inst.op == IR_ALLOC){
+                local = false;
+            }else if(inst.dest >= 0){
+                for(int u : du.users[inst.dest]){
+                    local = local && instBlock[u] == h;
+                }
+            }
+        }
+        if(!local){
+            continue;
+        }
+        for(int l : latches){
+            f.insts[f.blocks[l].insts.back()].removed = true;
+            f.blocks[l].insts.pop_back();
+            unordered_map<int, int> rename;
+            for(int i : header){
+                IrInst copy = f.insts[i];
+                for(int &a : copy.args){
+                    auto r = rename.find(a);
+                    if(r != rename.end()){
+                        a = r->second;
+                    }
+                }
+                if(copy.dest >= 0){
+                    copy.dest = rename[copy.dest] = f.newTemp();
+                }
+                f.insts.push_back(copy);
+                f.blocks[l].insts.push_back(f.insts.size() - 1);
+            }
+        }
+        changed = true;
+    }
+    return changed ? 0 : IR_ALL;
+}
+
+
+// 重结合：前端把 a + b + c + d 生成向左倾斜的一条链，每条 add 都要等上一条的结果，关键路径和链一样长。
+// add（连同减常数）、mul、and、or、xor 在 32 位回绕下满足结合律和交换律：块内同一种运算、中间结果只被
+// 下一条用到一次的一棵树，从左到右取出叶子，常数合并成一个放在最后（后端可以用带立即数的指令），
+// 其余叶子二分组成平衡的树，依赖的高度从 n-1 降到 log n。合并出乘 0、与 0、或 -1 时整棵树就是常数
+// 新的结点放在它最后用到的叶子原来被使用的位置，按后序排列，同时活着的中间结果和原来的链差不多
+// 指令按哪种运算参与重结合，不参与的是 IR_OP_COUNT
+static IrOp reassocKind(const IrFunc &f, const IrInst &inst){
+    if(inst.op == IR_ADD || inst.op == IR_MUL || inst.op == IR_AND || inst.op == IR_OR || inst.op == IR_XOR){
+        return inst.op;
+    }
+    if(inst.op == IR_SUB && f.isLiteral(inst.args[1])){
+        return IR_ADD;
+    }
+    return IR_OP_COUNT;
+}
+
+static int32_t reassocFold(IrOp op, int32_t x, int32_t y){
+    switch(op){
+        case IR_ADD: return (int32_t)((uint32_t)x + (uint32_t)y);
+        case IR_MUL: return (int32_t)((uint32_t)x * (uint32_t)y);
+        case IR_AND: return x & y;
+        case IR_OR: return x | y;
+        default: return x ^ y;
+    }
+}
+
+static unsigned reassociatePass(IrModule &m, IrFunc &f, IrAnalyses &am){
+    const IrDefUse &du = am.defUse();
+    bool changed = false;
+    for(IrBlock &bb : f.blocks){
+        int len = bb.insts.size();
+        unordered_map<int, int> pos; // 指令到它在块内的位置
+        vector<IrOp> kind(len);
+        for(int p = 0; p < len; p++){
+            pos[bb.insts[p]] = p;
+            kind[p] = reassocKind(f, f.insts[bb.insts[p]]);
+        }
+        // 树的内部结点：结果只被块内同一种运算用到一次
+        auto interior = [&](int v, IrOp k){
+            if(du.def[v] < 0 || du.users[v].size() != 1){
+                return false;
+            }
+            auto d = pos.find(du.def[v]), u = pos.find(du.users[v][0]);
+            return d != pos.end() && u != pos.end() && kind[d->second] == k && kind[u->second] == k;
+        };
+        vector<bool> drop(len, false);
+        vector<vector<IrInst> > emit(len); // 放在每个位置的新指令
+        bool rewritten = false;
+        for(int r = 0; r < len; r++){
+            IrOp k = kind[r];
+            int rootDest = f.insts[bb.insts[r]].dest;
+            if(k == IR_OP_COUNT || interior(rootDest, k)){
+                continue;
+            }
+            // 从左到右取出叶子和用到它的结点的位置，常数合并到 acc
+            int32_t identity = k == IR_MUL ? 1 : k == IR_AND ? -1 : 0, acc = identity;
+            int constants = 0;
+            vector<pair<int, int> > leaves, stack;
+            vector<int> nodes;
+            auto expand = [&](int p){
+                const IrInst &inst = f.insts[bb.insts[p]];
+                nodes.push_back(p);
+                if(inst.op == IR_SUB){
+                    acc = reassocFold(k, acc, (int32_t)(0u - (uint32_t)f.literal(inst.args[1])));
+                    constants++;
+                    stack.push_back({inst.args[0], p});
+                }else{
+                    stack.push_back({inst.args[1], p});
+                    stack.push_back({inst.args[0], p});
+                }
+            };
+            expand(r);
+            while(!stack.empty()){
+                pair<int, int> v = stack.back();
+                stack.pop_back();
+                if(f.isLiteral(v.first)){
+                    acc = reassocFold(k, acc, f.literal(v.first));
+                    constants++;
+                }else if(interior(v.first, k)){
+                    expand(pos[du.def[v.first]]);
+                }else{
+                    leaves.push_back(v);
+                }
+            }
+            int n = leaves.size();
+            bool absorbed = (k == IR_MUL || k == IR_AND) ? acc == 0 : k == IR_OR && acc == -1;
+            if(!absorbed && (n == 0 || (n < 3 && constants < 2))){
+                continue;
+            }
+            for(int p : nodes){
+                drop[p] = true;
+            }
+            rewritten = true;
+            if(absorbed){
+                int c = f.constant(acc);
+                for(int u : du.users[rootDest]){
+                    for(int &a : f.insts[u].args){
+                        a = a == rootDest ? c : a;
+                    }
+                }
+                continue;
+            }
+            bool tail = constants > 0 && (acc != identity || n == 1);
+            // 二分：返回结果的值和放置的位置，整棵树的根在没有常数时直接用原来的结果
+            function<pair<int, int>(int, int)> build = [&](int l, int h){
+                if(h - l == 1){
+                    return leaves[l];
+                }
+                pair<int, int> a = build(l, (l + h) / 2), b = build((l + h) / 2, h);
+                IrInst inst;
+                inst.op = k;
+                inst.dest = l == 0 && h == n && !tail ? rootDest : f.newTemp();
+                inst.args = {a.first, b.first};
+                int at = max(a.second, b.second);
+                emit[at].push_back(inst);
+                return make_pair(inst.dest, at);
+            };
+            int top = build(0, n).first;
+            if(tail){
+                IrInst inst;
+                inst.op = k;
+                inst.dest = rootDest;
+                inst.args = {top, f.constant(acc)};
+                emit[r].push_back(inst);
+            }
+        }
+        if(!rewritten){
+            continue;
+        }
+        changed = true;
+        vector<int> insts;
+        for(int p = 0; p < len; p++){
+            if(drop[p]){
+                f.insts[bb.insts[p]].removed = true;
+            }else{
+                insts.push_back(bb.insts[p]);
+            }
+            for(IrInst &inst : emit[p]){
+                f.insts.push_back(inst);
+                insts.push_back(f.insts.size() - 1);
+            }
+        }
+        bb.insts = move(insts);
+    }
+    return changed ? IR_CFG : IR_ALL;
+}
+
+
+// 全局值编号：沿支配树的先序处理，同样的运算（可交换的运算先排好操作数）、地址计算和纯函数的调用
+// 在支配它的块里已经算过时直接用之前的结果，离开子树时撤销子树里记下的表项
+// load 和只读函数的调用还依赖内存，像 loadelim 一样只传给只有一个前驱的块：可能写同一处内存的 store
+// 和调用之后作废，调用的函数不写这处内存时 load 的结果跨过调用继续使用；store 之后的 load 直接用存进去的值
+struct GvnMemory{
+    unordered_map<int, pair<int, IrBase> > loads; // 地址到已知的值和地址的来源
+    unordered_map<string, int> calls;            // 只读函数的调用到结果
+};
+
+static string gvnKey(const IrInst &inst){
+    bool commutative = inst.op == IR_ADD || inst.op == IR_MUL || inst.op == IR_AND || inst.op == IR_OR ||
+                       inst.op == IR_XOR || inst.op == IR_EQ || inst.op == IR_NE;
+    vector<int> args = inst.args;
+    if(commutative && args[0] > args[1]){
+        swap(args[0], args[1]);
+    }
+    string key = inst.op == IR_CALL ? inst.callee : irOpNames[inst.op];
+    for(int a : args){
+        key += " " + to_string(a);
+    }
+    return key;
+}
+
+static unsigned gvnPass(IrModule &m, IrFunc &f, IrAnalyses &am){
+    const IrCfg &cfg = am.cfg();
+    const IrDom &dom = am.dom();
+    const IrDefUse &du = am.defUse();
+    int n = f.blocks.size();
+    vector<bool> isParam(f.names.size(), false);
+    for(int p : f.params){
+        isParam[p] = true;
+    }
+    vector<GvnMemory> known(n);
+    vector<int> pending(n, 0);
+    for(int b = 0; b < n; b++){
+        for(int s : cfg.succs[b]){
+            pending[b] += s != 0 && cfg.preds[s].size() == 1;
+        }
+    }
+    vector<int> repl(f.names.size(), -1);
+    unordered_map<string, int> table;
+    vector<string> added; // 按加入的顺序记下表项，离开子树时删掉
+    bool changed = false;
+    auto replace = [&](IrInst &inst){
+        for(int &a : inst.args){
+            if(repl[a] >= 0){
+                a = repl[a];
+            }
+        }
+    };
+    auto visit = [&](int b){
+        GvnMemory mem;
+        if(b != 0 && cfg.preds[b].size() == 1){
+            int p = cfg.preds[b][0];
+            if(--pending[p] == 0){
+                mem = move(known[p]);
+            }else{
+                mem = known[p];
+            }
+        }
+        for(int i : f.blocks[b].insts){
+            IrInst &inst = f.insts[i];
+            replace(inst);
+            int kind = inst.op == IR_CALL ? irEffectsOf(inst.callee).kind : -1;
+            int found = -1;
+            if(irIsBinary(inst.op) || inst.op == IR_GETELEMPTR || inst.op == IR_GETPTR || (kind == IR_PURE && inst.dest >= 0)){
+                string key = gvnKey(inst);
+                auto it = table.find(key);
+                if(it != table.end()){
+                    found = it->second;
+                }else{
+                    table.emplace(key, inst.dest);
+                    added.push_back(key);
+                }
+            }else if(kind == IR_READONLY && inst.dest >= 0){
+                string key = gvnKey(inst);
+                auto it = mem.calls.find(key);
+                if(it != mem.calls.end()){
+                    found = it->second;
+                }else{
+                    mem.calls.emplace(key, inst.dest);
+                }
+            }else if(inst.op == IR_CALL && irCallWrites(inst)){
+                mem.calls.clear();
+                for(auto it = mem.loads.begin(); it != mem.loads.end();){
+                    it = irCallMayWrite(f, du, inst, it->second.second) ? mem.loads.erase(it) : next(it);
+                }
+            }else if(inst.op == IR_LOAD){
+                auto it = mem.loads.find(inst.args[0]);
+                if(it != mem.loads.end()){
+                    found = it->second.first;
+                }else{
+                    mem.loads.emplace(inst.args[0], make_pair(inst.dest, irBaseOf(f, du, inst.args[0])));
+                }
+            }else if(inst.op == IR_STORE){
+                IrBase b = irBaseOf(f, du, inst.args[1]);
+                for(auto it = mem.loads.begin(); it != mem.loads.end();){
+                    it = irMayAlias(b, it->second.second) ? mem.loads.erase(it) : next(it);
+                }
+                if(!(b.kind == IR_LOCAL && du.scalar[b.var])){
+                    mem.calls.clear();
+                }
+                // 参数的值同 loadelim，不往后传
+                if(!isParam[inst.args[0]]){
+                    mem.loads.emplace(inst.args[1], make_pair(inst.args[0], b));
+                }
+            }
+            if(found >= 0){
+                repl[inst.dest] = found;
+                inst.removed = true;
+                changed = true;
+            }
+        }
+        if(pending[b] > 0){
+            known[b] = move(mem);
+        }
+    };
+    // 支配树上非递归的深度优先搜索
+    struct Frame{
+        int block;
+        size_t child, mark;
+    };
+    vector<Frame> stack = {{0, 0, 0}};
+    visit(0);
+    while(!stack.empty()){
+        Frame &top = stack.back();
+        if(top.child < dom.children[top.block].size()){
+            int c = dom.children[top.block][top.child++];
+            stack.push_back({c, 0, added.size()});
+            visit(c);
+        }else{
+            for(size_t k = top.mark; k < added.size(); k++){
+                table.erase(added[k]);
+            }
+            added.resize(top.mark);
+            stack.pop_back();
+        }
+    }
+    if(!changed){
+        return IR_ALL;
+    }
+    for(int b = 0; b < n; b++){
+        if(dom.pre[b] < 0){
+            for(int i : f.blocks[b].insts){
+                replace(f.insts[i]);
+            }
+        }
+    }
+    irSweep(f);
+    return IR_CFG;
+}
+
+
+// 循环不变量外提：循环里操作数都在循环外定义的运算和地址计算移到循环的前置块。可能出错的除法、load
+// 和调用要求每次进入循环都一定执行到（所在的块支配循环的每个出口）；load 还要求循环里没有可能写这处内存的
+// store 和调用，只读函数的调用要求循环里不写内存，纯函数的调用只看参数
+// 从内层循环开始，移到内层前置块的指令接着可以被外层再往外移。没有前置块（循环外只有一个前驱，以 jump 结束）
+// 的循环先加上一个，没有用上的由 simplifycfg 删掉
+static unsigned licmPass(IrModule &m, IrFunc &f, IrAnalyses &am){
+    {
+        const IrCfg &cfg = am.cfg();
+        const IrDom &dom = am.dom();
+        vector<IrBlock> blocks;
+        bool added = false;
+        for(int h = 0; h < (int)f.blocks.size(); h++){
+            vector<int> outside;
+            bool loop = false;
+            for(int p : cfg.preds[h]){
+                if(dom.dominates(h, p)){
+                    loop = true;
+                }else{
+                    outside.push_back(p);
+                }
+            }
+            if(loop && !outside.empty() && !(outside.size() == 1 && f.insts[f.blocks[outside[0]].insts.back()].op == IR_JUMP)){
+                IrBlock pre;
+                // 按循环头命名，不随别的 pass 新建的临时变量变化，-fprofile-use 时有的循环不展开，块名仍然和生成 profile 时对得上
+                string label = f.names[f.blocks[h].label] + "_pre";
+                while(f.ids.count(label)){
+                    label += "_";
+                }
+                pre.label = f.value(label);
+                IrInst jump;
+                jump.op = IR_JUMP;
+                jump.args = {f.blocks[h].label};
+                f.insts.push_back(jump);
+                pre.insts.push_back(f.insts.size() - 1);
+                for(int p : outside){
+                    IrInst &term = f.insts[f.blocks[p].insts.back()];
+                    for(size_t k = term.op == IR_BR ? 1 : 0; k < term.args.size(); k++){
+                        if(term.args[k] == f.blocks[h].label){
+                            term.args[k] = pre.label;
+                        }
+                    }
+                }
+                blocks.push_back(pre);
+                added = true;
+            }
+            blocks.push_back(f.blocks[h]);
+        }
+        if(added){
+            f.blocks = move(blocks);
+            am.keep(0);
+        }
+    }
+
+    const IrCfg &cfg = am.cfg();
+    const IrDom &dom = am.dom();
+    const IrDefUse &du = am.defUse();
+    int n = f.blocks.size();
+    vector<int> order(n, -1), instBlock(f.insts.size(), -1);
+    for(int k = 0; k < (int)cfg.rpo.size(); k++){
+        order[cfg.rpo[k]] = k;
+    }
+    for(int b = 0; b < n; b++){
+        for(int i : f.blocks[b].insts){
+            instBlock[i] = b;
+        }
+    }
+    vector<bool> inLoop(n, false), hoisted(f.insts.size(), false);
+    for(int k = cfg.rpo.size() - 1; k >= 0; k--){
+        int h = cfg.rpo[k];
+        vector<int> body = {h}, stack, outside;
+        bool loop = false;
+        inLoop[h] = true;
+        for(int p : cfg.preds[h]){
+            if(!dom.dominates(h, p)){
+                outside.push_back(p);
+                continue;
+            }
+            loop = true;
+            if(!inLoop[p]){
+                inLoop[p] = true;
+                body.push_back(p);
+                stack.push_back(p);
+            }
+        }
+        while(!stack.empty()){
+            int b = stack.back();
+            stack.pop_back();
+            for(int p : cfg.preds[b]){
+                if(!inLoop[p] && dom.dominates(h, p)){
+                    inLoop[p] = true;
+                    body.push_back(p);
+                    stack.push_back(p);
+                }
+            }
+        }
+        int pre = outside.size() == 1 ? outside[0] : -1;
+        if(loop && pre >= 0){
+            sort(body.begin(), body.end(), [&](int a, int b){ return order[a] < order[b]; });
+            // 循环的出口和循环里写内存的地方
+            vector<int> exiting, calls;
+            vector<IrBase> stores;
+            bool writes = false;
+            for(int b : body){
+                for(int s : cfg.succs[b]){
+                    if(!inLoop[s]){
+                        exiting.push_back(b);
+                        break;
+                    }
+                }
+                for(int i : f.blocks[b].insts){
+                    const IrInst &inst = f.insts[i];
+                    if(inst.op == IR_STORE){
+                        stores.push_back(irBaseOf(f, du, inst.args[1]));
+                        writes = writes || !(stores.back().kind == IR_LOCAL && du.scalar[stores.back().var]);
+                    }else if(inst.op == IR_CALL){
+                        calls.push_back(i);
+                        writes = writes || irCallWrites(inst);
+                    }
+                }
+            }
+            vector<int> moved;
+            for(int b : body){
+                bool always = !exiting.empty();
+                for(int e : exiting){
+                    always = always && dom.dominates(b, e);
+                }
+                for(int i : f.blocks[b].insts){
+                    const IrInst &inst = f.insts[i];
+                    bool invariant = inst.dest >= 0;
+                    for(int a : inst.args){
+                        int d = du.def[a] >= 0 ? du.def[a] : du.alloc[a];
+                        invariant = invariant && (d < 0 || !inLoop[instBlock[d]]);
+                    }
+                    if(!invariant){
+                        continue;
+                    }
+                    bool hoist = false;
+                    if(irIsBinary(inst.op)){
+                        hoist = (inst.op != IR_DIV && inst.op != IR_MOD) || always;
+                    }else if(inst.op == IR_GETELEMPTR || inst.op == IR_GETPTR){
+                        hoist = true;
+                    }else if(inst.op == IR_LOAD && always){
+                        IrBase base = irBaseOf(f, du, inst.args[0]);
+                        hoist = true;
+                        for(const IrBase &s : stores){
+                            hoist = hoist && !irMayAlias(s, base);
+                        }
+                        for(int c : calls){
+                            hoist = hoist && !irCallMayWrite(f, du, f.insts[c], base);
+                        }
+                    }else if(inst.op == IR_CALL && always){
+                        int kind = irEffectsOf(inst.callee).kind;
+                        hoist = kind == IR_PURE || (kind == IR_READONLY && !writes);
+                    }
+                    if(hoist){
+                        moved.push_back(i);
+                        hoisted[i] = true;
+                        instBlock[i] = pre;
+                    }
+                }
+            }
+            if(!moved.empty()){
+                for(int b : body){
+                    vector<int> &insts = f.blocks[b].insts;
+                    insts.erase(remove_if(insts.begin(), insts.end(), [&](int i){ return hoisted[i]; }), insts.end());
+                }
+                for(int i : moved){
+                    hoisted[i] = false;
+                }
+                vector<int> &insts = f.blocks[pre].insts;
+                insts.insert(insts.end() - 1, moved.begin(), moved.end());
+            }
+        }
+        for(int b : body){
+            inLoop[b] = false;
+        }
+    }
+    // 只是在块之间移动指令，分析的结果都还有效
+    return IR_ALL;
+}
+
+
+static vector<IrPass> optPipeline(){
+    vector<IrPass> passes;
+    if(optLevel >= 1){
+        passes.push_back({"looprotate", loopRotatePass});
+    }
+    if(optLevel >= 2){
+        passes.push_back({"loadelim", loadElimPass});
+    }
+    if(optLevel >= 1){
+        if(sccpEnabled){
+            passes.push_back({"sccp", sccpPass});
+        }
+        passes.push_back({"reassociate", reassociatePass});
+    }
+    if(optLevel >= 2){
+        passes.push_back({"gvn", gvnPass});
+        passes.push_back({"licm", licmPass});
+    }
+    if(optLevel >= 1){
+        passes.push_back({"dce", dcePass});
+        passes.push_back({"simplifycfg", simplifyCfgPass});
+    }
+    return passes;
+}
+
+// 前端生成的 koopa 解析成 IrModule，再经过当前优化级别的 pass 序列（-O0 时没有），wholeProgram 的含义同 irParse
+static IrModule optimizeModule(const string &koopa, bool wholeProgram){
+    IrModule m;
+    {
+        IrTimeScope t("parse koopa");
+        m = irParse(koopa, wholeProgram);
+    }
+    vector<IrPass> passes = optPipeline();
+    if(!passes.empty()){
+        irRunPasses(m, passes);
+    }
+    return m;
+}
@@ -0,0 +1,168 @@
+#pragma once
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+// 基于 profile 的优化
+// -fprofile-generate 在 koopa 文本中插入计数器：每个基本块入口一个，每条 br 的真假两条边各一个，
+// main 返回前调用 @__prof_dump 把计数器写到 sysy.profdata（运行时见 runtime/profile.c，-run 模式由解释器实现）
+// -fprofile-use=文件 读回计数，后端据此安排基本块的顺序，循环展开时跳过展开的循环体很少执行的循环（见 ast.hpp）
+// 计数器是 32 位无符号数，加到最大值后不再增加。profile 文件每行一个计数和它对应的块或边，
+// 这些名字插桩时作为全局数组 @__prof_names 传给 @__prof_dump，读入时不需要重新生成 koopa
+// 前端展开循环时也要查 profile，这个头文件经 ast.hpp 也被 parser 包含，所以变量和函数都用 inline
+
+
+inline const char *profileDataFile = "sysy.profdata";
+
+// 计数器对应的块或边，块是 "@函数 %块"，边是 "@函数 %块->%后继"
+inline vector<string> profileKeys;
+// -fprofile-use 读入的计数，键同上
+inline unordered_map<string, int64_t> profileCount;
+inline int64_t profileMaxCount = 0; // 最热的块的次数
+
+// 执行次数不到最热的块的千分之一时当作冷的
+inline const int profileColdFraction = 1000;
+inline bool profileIsCold(int64_t count){
+    return count * profileColdFraction < profileMaxCount;
+}
+
+
+inline string profileBlockKey(const string &func, const string &block){
+    return func + " " + block;
+}
+inline string profileEdgeKey(const string &func, const string &block, const string &succ){
+    return func + " " + block + "->" + succ;
+}
+
+
+// 插桩，同时生成 profileKeys
+inline string profileInstrument(const string &koopa){
+    profileKeys.clear();
+    stringstream in(koopa), out;
+    string line, func, block;
+    int temp = 0;
+    // 计数器加一，index 是常数或者临时变量。已经是 0xffffffff 时加一得 0，再减去 1 回到原值，不会绕回去
+    auto increase = [&](const string &index){
+        string p = "%__prof_" + to_string(temp++);
+        string c = "%__prof_" + to_string(temp++);
+        string c1 = "%__prof_" + to_string(temp++);
+        string wrap = "%__prof_" + to_string(temp++);
+        string c2 = "%__prof_" + to_string(temp++);
+        out << "   " << p << " = getelemptr @__prof_counters, " << index << endl;
+        out << "   " << c << " = load " << p << endl;
+        out << "   " << c1 << " = add " << c << ", 1" << endl;
+        out << "   " << wrap << " = eq " << c1 << ", 0" << endl;
+        out << "   " << c2 << " = sub " << c1 << ", " << wrap << endl;
+        out << "   store " << c2 << ", " << p << endl;
+    };
+    while(getline(in, line)){
+        if(line.compare(0, 5, "fun @") == 0){
+            func = line.substr(4, line.find('(') - 4);
+            temp = 0;
+            out << line << endl;
+        }else if(!line.empty() && line[0] == '%' && line.back() == ':'){
+            block = line.substr(0, line.size() - 1);
+            out << line << endl;
+            increase(to_string(profileKeys.size()));
+            profileKeys.push_back(profileBlockKey(func, block));
+        }else if(line.compare(0, 6, "   br ") == 0){
+            // br 条件, 真, 假。条件非零时加第一个计数器，否则加第二个
+            stringstream args(line.substr(6));
+            string cond, t, f;
+            getline(args, cond, ',');
+            args >> t >> f;
+            t.pop_back();
+            int index = profileKeys.size();
+            string nz = "%__prof_" + to_string(temp++);
+            string i = "%__prof_" + to_string(temp++);
+            out << "   " << nz << " = ne " << cond << ", 0" << endl;
+            out << "   " << i << " = sub " << index + 1 << ", " << nz << endl;
+            increase(i);
+            profileKeys.push_back(profileEdgeKey(func, block, t));
+            profileKeys.push_back(profileEdgeKey(func, block, f));
+            out << line << endl;
+        }else if(func == "@main" && line.compare(0, 6, "   ret") == 0){
+            string p = "%__prof_" + to_string(temp++);
+            string q = "%__prof_" + to_string(temp++);
+            out << "   " << p << " = getelemptr @__prof_counters, 0" << endl;
+            out << "   " << q << " = getelemptr @__prof_names, 0" << endl;
+            out << "   call @__prof_dump(" << p << ", PROFILE_COUNTERS, " << q << ")" << endl;
+            out << line << endl;
+        }else{
+            out << line << endl;
+        }
+    }
+
+    // 计数器的个数最后才知道
+    string n = to_string(profileKeys.size());
+    string body = out.str();
+    for(size_t pos = body.find("PROFILE_COUNTERS"); pos != string::npos; pos = body.find("PROFILE_COUNTERS", pos)){
+        body.replace(pos, 16, n);
+    }
+
+    // 计数器的名字，每个以换行结尾，整个以 0 结尾，按小端每 4 个字节拼成一个 i32
+    string names;
+    for(auto &key : profileKeys){
+        names += key + "\n";
+    }
+    names.resize(names.size() / 4 * 4 + 4, '\0');
+    string words;
+    for(size_t i = 0; i < names.size(); i += 4){
+        uint32_t w = 0;
+        for(int k = 3; k >= 0; k--){
+            w = w << 8 | (unsigned char)names[i + k];
+        }
+        words += (i ? ", " : "") + to_string((int32_t)w);
+    }
+    return "decl @__prof_dump(*i32, i32, *i32)\n"
+           "global @__prof_counters = alloc [i32, " + n + "], zeroinit\n"
+           "global @__prof_names = alloc [i32, " + to_string(names.size() / 4) + "], {" + words + "}\n" + body;
+}
+
+
+// 写出 profile 文件：第一行是计数器个数，之后每行一个计数和它的名字。names 是 @__prof_names 的内容
+inline void profileWrite(const int32_t *counters, int n, const char *names){
+    FILE *f = fopen(profileDataFile, "w");
+    if(f == nullptr){
+        return;
+    }
+    fprintf(f, "sysy-profile %d\n", n);
+    for(int i = 0; i < n; i++){
+        const char *end = strchr(names, '\n');
+        fprintf(f, "%u %.*s\n", (uint32_t)counters[i], (int)(end - names), names);
+        names = end + 1;
+    }
+    fclose(f);
+}
+
+
+// 读入 profile。名字和计数器的编号无关，程序改动后对不上的块或边只是查不到
+inline void profileRead(const string &path){
+    ifstream in(path);
+    string magic, line;
+    size_t n = 0;
+    if(!(in >> magic >> n) || magic != "sysy-profile"){
+        cerr << "warning: cannot read profile " << path << endl;
+        return;
+    }
+    getline(in, line);
+    for(size_t i = 0; i < n && getline(in, line); i++){
+        size_t space = line.find(' ');
+        if(space == string::npos){
+            cerr << "warning: profile " << path << " is truncated" << endl;
+            return;
+        }
+        int64_t &c = profileCount[line.substr(space + 1)];
+        c += stoll(line.substr(0, space));
+        profileMaxCount = max(profileMaxCount, c);
+    }
+}
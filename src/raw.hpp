@@ -0,0 +1,346 @@
+#pragma once
+#include <cassert>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "koopa.h"
+#include "ir.hpp"
+
+using namespace std;
+
+// 后端（汇编生成、解释器、统计）读的 raw program 直接由优化后的 IrModule 构建，不再输出 koopa 文本交给 libkoopa 解析
+// 结构和 libkoopa 构建的相同：每个有结果的指令、参数、全局变量有名字，整数常量每出现一次就是一个新的值，
+// used_by 按使用的指令的顺序记下，同一条指令用两次就记两次，函数和全局变量按在程序中出现的顺序排列
+// 所有的值、类型、块、切片和名字都归 IrRawProgram 所有，raw 在它释放之前有效
+
+
+struct IrRawProgram{
+    koopa_raw_program_t raw;
+    deque<koopa_raw_value_data_t> values;
+    deque<koopa_raw_type_kind_t> types;
+    deque<koopa_raw_function_data_t> funcs;
+    deque<koopa_raw_basic_block_data_t> blocks;
+    deque<vector<const void *> > slices;
+    deque<string> names;
+    unordered_map<string, koopa_raw_type_t> typeByText;
+    unordered_map<koopa_raw_type_t, koopa_raw_type_t> pointerTo;
+    unordered_map<string, koopa_raw_function_data_t *> funcByName;
+    unordered_map<string, koopa_raw_value_t> globalByName;
+    unordered_map<koopa_raw_value_t, vector<const void *> > users;
+
+    IrRawProgram() = default;
+    IrRawProgram(const IrRawProgram &) = delete;
+    IrRawProgram &operator=(const IrRawProgram &) = delete;
+
+    koopa_raw_slice_t slice(vector<const void *> items, koopa_raw_slice_item_kind_t kind){
+        slices.push_back(move(items));
+        return {slices.back().data(), (uint32_t)slices.back().size(), kind};
+    }
+    const char *name(const string &s){
+        names.push_back(s);
+        return names.back().c_str();
+    }
+    koopa_raw_type_kind_t *type(koopa_raw_type_tag_t tag){
+        types.emplace_back();
+        types.back().tag = tag;
+        return &types.back();
+    }
+    koopa_raw_type_t pointer(koopa_raw_type_t base){
+        auto &t = pointerTo[base];
+        if(t == nullptr){
+            koopa_raw_type_kind_t *p = type(KOOPA_RTT_POINTER);
+            p->data.pointer.base = base;
+            t = p;
+        }
+        return t;
+    }
+    koopa_raw_value_data_t *value(koopa_raw_value_tag_t tag, koopa_raw_type_t ty, const char *valueName){
+        values.emplace_back();
+        koopa_raw_value_data_t &v = values.back();
+        v.kind.tag = tag;
+        v.ty = ty;
+        v.name = valueName;
+        v.used_by = {nullptr, 0, KOOPA_RSIK_VALUE};
+        return &v;
+    }
+    void use(koopa_raw_value_t v, const void *user){
+        if(v != nullptr){
+            users[v].push_back(user);
+        }
+    }
+};
+
+
+static koopa_raw_type_t irRawI32(IrRawProgram &p){
+    auto &i32 = p.typeByText["i32"];
+    if(i32 == nullptr){
+        i32 = p.type(KOOPA_RTT_INT32);
+    }
+    return i32;
+}
+
+static koopa_raw_type_t irRawUnit(IrRawProgram &p){
+    auto &unit = p.typeByText[""];
+    if(unit == nullptr){
+        unit = p.type(KOOPA_RTT_UNIT);
+    }
+    return unit;
+}
+
+// 类型的文本：i32、*T、[T, n]，从 pos 开始读一个，pos 移到它后面
+static koopa_raw_type_t irRawType(IrRawProgram &p, const string &s, size_t &pos){
+    size_t begin = pos;
+    if(s.compare(pos, 3, "i32") == 0){
+        pos += 3;
+        return irRawI32(p);
+    }else if(s[pos] == '*'){
+        pos++;
+        return p.pointer(irRawType(p, s, pos));
+    }
+    assert(s[pos] == '[');
+    pos++;
+    koopa_raw_type_t base = irRawType(p, s, pos);
+    size_t end = s.find(']', pos);
+    size_t len = stoul(s.substr(pos + 2, end - pos - 2));
+    pos = end + 1;
+    auto &array = p.typeByText[s.substr(begin, pos - begin)];
+    if(array == nullptr){
+        koopa_raw_type_kind_t *a = p.type(KOOPA_RTT_ARRAY);
+        a->data.array.base = base;
+        a->data.array.len = len;
+        array = a;
+    }
+    return array;
+}
+
+// 全局变量的初值：zeroinit、整数或 {...}
+static koopa_raw_value_t irRawInit(IrRawProgram &p, const string &s, size_t &pos, koopa_raw_type_t ty){
+    if(s.compare(pos, 8, "zeroinit") == 0){
+        pos += 8;
+        return p.value(KOOPA_RVT_ZERO_INIT, ty, nullptr);
+    }
+    if(s[pos] != '{'){
+        size_t end = s.find_first_of(",}", pos);
+        if(end == string::npos){
+            end = s.size();
+        }
+        auto v = p.value(KOOPA_RVT_INTEGER, ty, nullptr);
+        v->kind.data.integer.value = (int32_t)stoll(s.substr(pos, end - pos));
+        pos = end;
+        return v;
+    }
+    vector<const void *> elems;
+    pos++;
+    while(true){
+        elems.push_back(irRawInit(p, s, pos, ty->data.array.base));
+        if(s[pos] == '}'){
+            pos++;
+            break;
+        }
+        pos += 2; // ", "
+    }
+    auto v = p.value(KOOPA_RVT_AGGREGATE, ty, nullptr);
+    v->kind.data.aggregate.elems = p.slice(move(elems), KOOPA_RSIK_VALUE);
+    return v;
+}
+
+// decl @f(T, ...): R 和 fun @f(%x: T, ...): R {，参数的值只有 fun 有
+static koopa_raw_function_data_t *irRawFuncHeader(IrRawProgram &p, const string &line){
+    p.funcs.emplace_back();
+    koopa_raw_function_data_t &f = p.funcs.back();
+    size_t at = line.find('@');
+    size_t lp = line.find('(', at);
+    f.name = p.name(line.substr(at, lp - at));
+    bool isFun = line[0] == 'f';
+    vector<const void *> paramTypes, params;
+    size_t pos = lp + 1;
+    while(line[pos] != ')'){
+        string paramName;
+        if(isFun){
+            size_t colon = line.find(':', pos);
+            paramName = line.substr(pos, colon - pos);
+            pos = colon + 2;
+        }
+        koopa_raw_type_t t = irRawType(p, line, pos);
+        paramTypes.push_back(t);
+        if(isFun){
+            auto v = p.value(KOOPA_RVT_FUNC_ARG_REF, t, p.name(paramName));
+            v->kind.data.func_arg_ref.index = params.size();
+            params.push_back(v);
+        }
+        if(line[pos] == ','){
+            pos += 2;
+        }
+    }
+    pos++;
+    koopa_raw_type_t ret = irRawUnit(p);
+    if(line.compare(pos, 2, ": ") == 0){
+        pos += 2;
+        ret = irRawType(p, line, pos);
+    }
+    koopa_raw_type_kind_t *ft = p.type(KOOPA_RTT_FUNCTION);
+    ft->data.function.params = p.slice(move(paramTypes), KOOPA_RSIK_TYPE);
+    ft->data.function.ret = ret;
+    f.ty = ft;
+    f.params = p.slice(move(params), KOOPA_RSIK_VALUE);
+    f.bbs = p.slice({}, KOOPA_RSIK_BASIC_BLOCK);
+    p.funcByName[f.name] = &f;
+    return &f;
+}
+
+static void irRawFuncBody(IrRawProgram &p, const IrFunc &f, koopa_raw_function_data_t &rf){
+    vector<koopa_raw_value_t> local(f.names.size(), nullptr);
+    for(size_t i = 0; i < f.params.size(); i++){
+        local[f.params[i]] = reinterpret_cast<koopa_raw_value_t>(rf.params.buffer[i]);
+    }
+    vector<koopa_raw_basic_block_data_t *> blockOf(f.names.size(), nullptr);
+    vector<const void *> bbs;
+    for(const IrBlock &bb : f.blocks){
+        p.blocks.emplace_back();
+        koopa_raw_basic_block_data_t &b = p.blocks.back();
+        b.name = p.name(f.names[bb.label]);
+        b.params = p.slice({}, KOOPA_RSIK_VALUE);
+        b.used_by = p.slice({}, KOOPA_RSIK_VALUE);
+        blockOf[bb.label] = &b;
+        bbs.push_back(&b);
+    }
+    // 操作数：整数和 zeroinit 每次新建，其余是本函数中的值或全局变量
+    auto operand = [&](int v, koopa_raw_type_t zeroType) -> koopa_raw_value_t{
+        if(f.isLiteral(v)){
+            auto c = p.value(KOOPA_RVT_INTEGER, irRawI32(p), nullptr);
+            c->kind.data.integer.value = f.literal(v);
+            return c;
+        }
+        if(f.names[v] == "zeroinit"){
+            return p.value(KOOPA_RVT_ZERO_INIT, zeroType, nullptr);
+        }
+        if(local[v] != nullptr){
+            return local[v];
+        }
+        auto it = p.globalByName.find(f.names[v]);
+        assert(it != p.globalByName.end());
+        return it->second;
+    };
+    for(size_t k = 0; k < f.blocks.size(); k++){
+        vector<const void *> insts;
+        for(int i : f.blocks[k].insts){
+            const IrInst &inst = f.insts[i];
+            const char *dest = inst.dest >= 0 ? p.name(f.names[inst.dest]) : nullptr;
+            koopa_raw_value_data_t *v;
+            if(inst.op == IR_ALLOC){
+                size_t pos = 0;
+                v = p.value(KOOPA_RVT_ALLOC, p.pointer(irRawType(p, inst.type, pos)), dest);
+            }else if(inst.op == IR_LOAD){
+                koopa_raw_value_t src = operand(inst.args[0], nullptr);
+                v = p.value(KOOPA_RVT_LOAD, src->ty->data.pointer.base, dest);
+                v->kind.data.load.src = src;
+                p.use(src, v);
+            }else if(inst.op == IR_STORE){
+                koopa_raw_value_t to = operand(inst.args[1], nullptr);
+                koopa_raw_value_t val = operand(inst.args[0], to->ty->data.pointer.base);
+                v = p.value(KOOPA_RVT_STORE, irRawUnit(p), dest);
+                v->kind.data.store.value = val;
+                v->kind.data.store.dest = to;
+                p.use(val, v);
+                p.use(to, v);
+            }else if(inst.op == IR_GETPTR || inst.op == IR_GETELEMPTR){
+                koopa_raw_value_t src = operand(inst.args[0], nullptr);
+                koopa_raw_value_t index = operand(inst.args[1], nullptr);
+                if(inst.op == IR_GETPTR){
+                    v = p.value(KOOPA_RVT_GET_PTR, src->ty, dest);
+                    v->kind.data.get_ptr.src = src;
+                    v->kind.data.get_ptr.index = index;
+                }else{
+                    v = p.value(KOOPA_RVT_GET_ELEM_PTR, p.pointer(src->ty->data.pointer.base->data.array.base), dest);
+                    v->kind.data.get_elem_ptr.src = src;
+                    v->kind.data.get_elem_ptr.index = index;
+                }
+                p.use(src, v);
+                p.use(index, v);
+            }else if(irIsBinary(inst.op)){
+                koopa_raw_value_t lhs = operand(inst.args[0], nullptr);
+                koopa_raw_value_t rhs = operand(inst.args[1], nullptr);
+                v = p.value(KOOPA_RVT_BINARY, irRawI32(p), dest);
+                v->kind.data.binary.op = (koopa_raw_binary_op_t)(inst.op - IR_NE);
+                v->kind.data.binary.lhs = lhs;
+                v->kind.data.binary.rhs = rhs;
+                p.use(lhs, v);
+                p.use(rhs, v);
+            }else if(inst.op == IR_BR){
+                koopa_raw_value_t cond = operand(inst.args[0], nullptr);
+                v = p.value(KOOPA_RVT_BRANCH, irRawUnit(p), dest);
+                koopa_raw_branch_t &br = v->kind.data.branch;
+                br.cond = cond;
+                br.true_bb = blockOf[inst.args[1]];
+                br.false_bb = blockOf[inst.args[2]];
+                br.true_args = p.slice({}, KOOPA_RSIK_VALUE);
+                br.false_args = p.slice({}, KOOPA_RSIK_VALUE);
+                p.use(cond, v);
+            }else if(inst.op == IR_JUMP){
+                v = p.value(KOOPA_RVT_JUMP, irRawUnit(p), dest);
+                v->kind.data.jump.target = blockOf[inst.args[0]];
+                v->kind.data.jump.args = p.slice({}, KOOPA_RSIK_VALUE);
+            }else if(inst.op == IR_CALL){
+                auto it = p.funcByName.find(inst.callee);
+                assert(it != p.funcByName.end());
+                vector<const void *> args;
+                for(int a : inst.args){
+                    args.push_back(operand(a, nullptr));
+                }
+                v = p.value(KOOPA_RVT_CALL, it->second->ty->data.function.ret, dest);
+                v->kind.data.call.callee = it->second;
+                for(const void *a : args){
+                    p.use(reinterpret_cast<koopa_raw_value_t>(a), v);
+                }
+                v->kind.data.call.args = p.slice(move(args), KOOPA_RSIK_VALUE);
+            }else{
+                koopa_raw_value_t ret = inst.args.empty() ? nullptr : operand(inst.args[0], nullptr);
+                v = p.value(KOOPA_RVT_RETURN, irRawUnit(p), dest);
+                v->kind.data.ret.value = ret;
+                p.use(ret, v);
+            }
+            if(inst.dest >= 0){
+                local[inst.dest] = v;
+            }
+            insts.push_back(v);
+        }
+        blockOf[f.blocks[k].label]->insts = p.slice(move(insts), KOOPA_RSIK_VALUE);
+    }
+    rf.bbs = p.slice(move(bbs), KOOPA_RSIK_BASIC_BLOCK);
+}
+
+// 由 IrModule 构建 raw program。先建出所有函数和全局变量，函数体里可以调用后面才定义的函数
+static void irBuildRaw(const IrModule &m, IrRawProgram &p){
+    vector<const void *> globals, funcs;
+    vector<koopa_raw_function_data_t *> funcOf(m.funcs.size(), nullptr);
+    for(const IrItem &item : m.items){
+        if(item.func >= 0){
+            funcOf[item.func] = irRawFuncHeader(p, m.funcs[item.func].header);
+            funcs.push_back(funcOf[item.func]);
+        }else if(item.line.compare(0, 5, "decl ") == 0){
+            funcs.push_back(irRawFuncHeader(p, item.line));
+        }else if(item.line.compare(0, 7, "global ") == 0){
+            // global @名字 = alloc 类型, 初值
+            size_t eq = item.line.find(" = alloc ");
+            size_t pos = eq + 9;
+            koopa_raw_type_t ty = irRawType(p, item.line, pos);
+            pos += 2;
+            koopa_raw_value_t init = irRawInit(p, item.line, pos, ty);
+            auto v = p.value(KOOPA_RVT_GLOBAL_ALLOC, p.pointer(ty), p.name(item.line.substr(7, eq - 7)));
+            v->kind.data.global_alloc.init = init;
+            p.globalByName[v->name] = v;
+            globals.push_back(v);
+        }
+    }
+    for(size_t i = 0; i < m.funcs.size(); i++){
+        irRawFuncBody(p, m.funcs[i], *funcOf[i]);
+    }
+    for(auto &u : p.users){
+        const_cast<koopa_raw_value_data_t *>(u.first)->used_by = p.slice(move(u.second), KOOPA_RSIK_VALUE);
+    }
+    p.users.clear();
+    p.raw.values = p.slice(move(globals), KOOPA_RSIK_VALUE);
+    p.raw.funcs = p.slice(move(funcs), KOOPA_RSIK_FUNCTION);
+}
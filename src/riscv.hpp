@@ -1,6 +1,16 @@
 #include <iostream>
 #include <cassert>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+#include <cstring>
 #include "koopa.h"
+#include "profile.hpp"
+#include "stats.hpp"
+#include "vector.hpp"
 
 using namespace std;
 
@@ -11,21 +21,401 @@ void Visit(const koopa_raw_basic_block_t &bb);
 void Visit(const koopa_raw_value_t &value);
 
 
-void riscv_parse(const char* str){
-    // 解析字符串 str, 得到 Koopa IR 程序
-    koopa_program_t program;
-    koopa_error_code_t ret = koopa_parse_from_string(str, &program);
-    assert(ret == KOOPA_EC_SUCCESS);  // 确保解析时没有出错
-    // 创建一个 raw program builder, 用来构建 raw program
-    koopa_raw_program_builder_t builder = koopa_new_raw_program_builder();
-    // 将 Koopa IR 程序转换为 raw program
-    koopa_raw_program_t raw = koopa_build_raw_program(builder, program);
-    // 释放 Koopa IR 程序占用的内存
-    koopa_delete_program(program);
+// 后端输出的汇编先放在 asmLines 中，汇编文本（-riscv）和目标文件（-obj）都由这个列表生成
+struct AsmLine{
+    enum Kind{ INST, LABEL, DIRECTIVE };
+    Kind kind;
+    string op;           // 指令名、标号名或伪指令名（如 .word），空的伪指令输出一个空行
+    vector<string> args; // 操作数，访存的地址写成 "4(sp)" 的形式
+};
+static vector<AsmLine> asmLines;
 
+static void emit(const string &op, const vector<string> &args = {}){
+    asmLines.push_back({AsmLine::INST, op, args});
+}
+
+static void emitLabel(const string &name){
+    asmLines.push_back({AsmLine::LABEL, name, {}});
+}
+
+static void emitDirective(const string &op, const vector<string> &args = {}){
+    asmLines.push_back({AsmLine::DIRECTIVE, op, args});
+}
+
+
+// 指令编码后的字节数。li 按汇编器的展开方式计算：12 位以内一条 addi，否则 lui 加上可能的 addi
+static int instSize(const AsmLine &line){
+    if(line.op == "li"){
+        int imm = stoi(line.args[1]);
+        if(imm >= -2048 && imm < 2048){
+            return 4;
+        }
+        return (imm & 0xfff) == 0 ? 4 : 8;
+    }
+    if(line.op == "la" || line.op == "call" || line.op == "tail"){
+        return 8;
+    }
+    return 4;
+}
+
+
+// 条件分支只能跳 ±4KiB，函数很大时把超出范围的分支改写成反向分支跳过一条 j
+static void relaxBranches(){
+    static const unordered_map<string, string> inverse = {
+        {"beqz", "bnez"}, {"bnez", "beqz"}, {"beq", "bne"}, {"bne", "beq"},
+        {"blt", "bge"}, {"bge", "blt"}, {"bltu", "bgeu"}, {"bgeu", "bltu"},
+        {"bgt", "ble"}, {"ble", "bgt"}, {"bgtz", "blez"}, {"blez", "bgtz"},
+        {"bltz", "bgez"}, {"bgez", "bltz"}
+    };
+    int farCount = 0;
+    bool changed = true;
+    while(changed){
+        changed = false;
+        unordered_map<string, int> labelAddr;
+        vector<int> addr(asmLines.size());
+        int pc = 0;
+        for(int i = 0; i < (int)asmLines.size(); i++){
+            addr[i] = pc;
+            if(asmLines[i].kind == AsmLine::LABEL){
+                labelAddr[asmLines[i].op] = pc;
+            }else if(asmLines[i].kind == AsmLine::INST){
+                pc += instSize(asmLines[i]);
+            }
+        }
+        // 改写会让别的分支变得更远，所以重复到没有超出范围的分支为止
+        vector<AsmLine> lines;
+        for(int i = 0; i < (int)asmLines.size(); i++){
+            AsmLine &line = asmLines[i];
+            if(line.kind != AsmLine::INST || !inverse.count(line.op)){
+                lines.push_back(line);
+                continue;
+            }
+            int offset = labelAddr[line.args.back()] - addr[i];
+            if(offset >= -4096 && offset < 4096){
+                lines.push_back(line);
+                continue;
+            }
+            string skip = ".Lfar_" + to_string(farCount++);
+            AsmLine branch = line;
+            branch.op = inverse.at(line.op);
+            branch.args.back() = skip;
+            lines.push_back(branch);
+            lines.push_back({AsmLine::INST, "j", {line.args.back()}});
+            lines.push_back({AsmLine::LABEL, skip, {}});
+            changed = true;
+        }
+        asmLines.swap(lines);
+    }
+}
+
+
+// 指令调度（-fschedule）
+// 顺序发射的核上，lw、mul、div 的结果紧接着被使用就会停顿。每个基本块内建立依赖图做表调度：
+// 寄存器分配之前在 koopa 指令上排一遍（scheduleKoopaBlock），生成汇编之后在 asmLines 上再排一遍（scheduleAsm）
+static bool scheduleInsts = false;
+// 各类指令的延迟。branch 是分支的操作数至少要提前准备好的拍数
+static unordered_map<string, int> schedLatency = {{"load", 3}, {"mul", 3}, {"div", 20}, {"branch", 1}};
+
+// 解析 -fsched-latency=load=3,mul=3,div=20,branch=1
+static void parseSchedLatency(const string &spec){
+    stringstream ss(spec);
+    string item;
+    while(getline(ss, item, ',')){
+        size_t eq = item.find('=');
+        if(eq == string::npos || !schedLatency.count(item.substr(0, eq))){
+            cerr << "warning: unknown latency " << item << endl;
+            continue;
+        }
+        schedLatency[item.substr(0, eq)] = max(1, stoi(item.substr(eq + 1)));
+    }
+}
+
+struct SchedNode{
+    int latency = 1;
+    vector<pair<int, int> > succs; // 后继以及边上的延迟，边总是从前往后
+};
+
+// 表调度。每次从就绪的节点中选操作数已经准备好、到块末尾的路径最长的；都没准备好时选最早能发射的
+static vector<int> listSchedule(const vector<SchedNode> &nodes){
+    int n = nodes.size();
+    vector<int> height(n), preds(n, 0), earliest(n, 0);
+    for(int i = n - 1; i >= 0; i--){
+        height[i] = nodes[i].latency;
+        for(auto &e : nodes[i].succs){
+            height[i] = max(height[i], e.second + height[e.first]);
+            preds[e.first]++;
+        }
+    }
+    vector<int> ready, order;
+    for(int i = 0; i < n; i++){
+        if(preds[i] == 0){
+            ready.push_back(i);
+        }
+    }
+    int cycle = 0;
+    while(!ready.empty()){
+        auto better = [&](int a, int b){
+            bool aok = earliest[a] <= cycle, bok = earliest[b] <= cycle;
+            if(aok != bok){
+                return aok;
+            }
+            if(!aok && earliest[a] != earliest[b]){
+                return earliest[a] < earliest[b];
+            }
+            return height[a] != height[b] ? height[a] > height[b] : a < b;
+        };
+        int best = 0;
+        for(int k = 1; k < (int)ready.size(); k++){
+            if(better(ready[k], ready[best])){
+                best = k;
+            }
+        }
+        int i = ready[best];
+        ready.erase(ready.begin() + best);
+        int t = max(cycle, earliest[i]);
+        order.push_back(i);
+        cycle = t + 1;
+        for(auto &e : nodes[i].succs){
+            earliest[e.first] = max(earliest[e.first], t + e.second);
+            if(--preds[e.first] == 0){
+                ready.push_back(e.first);
+            }
+        }
+    }
+    return order;
+}
+
+// 块结束的跳转，调度时留在最后
+static bool isAsmBlockEnd(const string &op){
+    static const unordered_set<string> ends = {
+        "j", "jr", "ret", "tail", "beq", "bne", "blt", "bge", "bltu", "bgeu", "bgt", "ble",
+        "beqz", "bnez", "bltz", "bgez", "blez", "bgtz"
+    };
+    return ends.count(op);
+}
+
+// 汇编指令的延迟、读写的寄存器和访存。跳转、调用等不参与调度的指令返回 false
+struct AsmAccess{
+    vector<string> defs, uses;
+    int mem = 0; // 1 是 lw，2 是 sw
+    string base;
+    int offset = 0;
+    int latency = 1;
+};
+static bool asmAccess(const AsmLine &line, AsmAccess &acc){
+    static const unordered_set<string> regs = {
+        "ra", "sp", "gp", "tp", "t0", "t1", "t2", "t3", "t4", "t5", "t6",
+        "s0", "s1", "s2", "s3", "s4", "s5", "s6", "s7", "s8", "s9", "s10", "s11",
+        "a0", "a1", "a2", "a3", "a4", "a5", "a6", "a7"
+    };
+    // 向量指令（都以 v 开头）不参与调度
+    if(line.kind != AsmLine::INST || line.op == "call" || line.op == "jal" || line.op == "jalr" || isAsmBlockEnd(line.op) || line.op[0] == 'v'){
+        return false;
+    }
+    for(int i = 0; i < (int)line.args.size(); i++){
+        string a = line.args[i];
+        size_t paren = a.find('(');
+        if(paren != string::npos){
+            acc.offset = stoi(a.substr(0, paren));
+            acc.base = a.substr(paren + 1, a.size() - paren - 2);
+            acc.uses.push_back(acc.base);
+            acc.mem = line.op == "sw" ? 2 : 1;
+        }else if(regs.count(a)){
+            if(i == 0 && line.op != "sw"){
+                acc.defs.push_back(a);
+            }else{
+                acc.uses.push_back(a);
+            }
+        }
+    }
+    if(line.op == "lw"){
+        acc.latency = schedLatency["load"];
+    }else if(line.op == "mul" || line.op == "mulh"){
+        acc.latency = schedLatency["mul"];
+    }else if(line.op == "div" || line.op == "rem" || line.op == "divu" || line.op == "remu"){
+        acc.latency = schedLatency["div"];
+    }
+    return true;
+}
+
+// 寄存器分配之后的调度。调用、标号和伪指令把指令分成若干段，块末尾的跳转留在段的最后
+static void scheduleAsm(){
+    vector<AsmLine> lines;
+    for(int i = 0; i < (int)asmLines.size(); ){
+        vector<AsmAccess> accs;
+        int j = i;
+        for(AsmAccess acc; j < (int)asmLines.size() && asmAccess(asmLines[j], acc); acc = AsmAccess()){
+            accs.push_back(acc);
+            j++;
+        }
+        bool end = j < (int)asmLines.size() && asmLines[j].kind == AsmLine::INST && isAsmBlockEnd(asmLines[j].op);
+        if(accs.size() < 2){ // 不参与调度的指令，或者只有一条，原样输出
+            lines.push_back(asmLines[i]);
+            i++;
+            continue;
+        }
+
+        int n = accs.size();
+        vector<SchedNode> nodes(n + end);
+        unordered_map<string, int> lastDef, version;
+        unordered_map<string, vector<int> > usesSince;
+        vector<int> memOps;
+        vector<int> baseVersion(n);
+        for(int k = 0; k < n; k++){
+            AsmAccess &a = accs[k];
+            nodes[k].latency = a.latency;
+            for(auto &u : a.uses){
+                if(lastDef.count(u)){
+                    nodes[lastDef[u]].succs.push_back(make_pair(k, accs[lastDef[u]].latency));
+                }
+            }
+            for(auto &d : a.defs){
+                if(lastDef.count(d)){
+                    nodes[lastDef[d]].succs.push_back(make_pair(k, 0));
+                }
+                for(int p : usesSince[d]){
+                    if(p != k){
+                        nodes[p].succs.push_back(make_pair(k, 0));
+                    }
+                }
+            }
+            // 基址寄存器相同且期间没被改写时，按偏移判断两次访存是否重叠
+            if(a.mem){
+                baseVersion[k] = version[a.base];
+                for(int p : memOps){
+                    if(a.mem == 1 && accs[p].mem == 1){
+                        continue;
+                    }
+                    bool disjoint = accs[p].base == a.base && baseVersion[p] == baseVersion[k] && abs(accs[p].offset - a.offset) >= 4;
+                    if(!disjoint){
+                        nodes[p].succs.push_back(make_pair(k, accs[p].mem == 2 && a.mem == 1 ? 1 : 0));
+                    }
+                }
+                memOps.push_back(k);
+            }
+            for(auto &u : a.uses){
+                usesSince[u].push_back(k);
+            }
+            for(auto &d : a.defs){
+                lastDef[d] = k;
+                usesSince[d].clear();
+                version[d]++;
+            }
+        }
+        if(end){
+            AsmAccess a;
+            for(auto &arg : asmLines[j].args){
+                a.uses.push_back(arg);
+            }
+            nodes[n].latency = schedLatency["branch"];
+            for(int k = 0; k < n; k++){
+                bool feeds = false;
+                for(auto &d : accs[k].defs){
+                    feeds = feeds || (lastDef.count(d) && lastDef[d] == k && find(a.uses.begin(), a.uses.end(), d) != a.uses.end());
+                }
+                nodes[k].succs.push_back(make_pair(n, feeds ? max(accs[k].latency, schedLatency["branch"]) : 0));
+            }
+        }
+        for(int k : listSchedule(nodes)){
+            lines.push_back(asmLines[i + k]);
+        }
+        i = j + end;
+    }
+    asmLines.swap(lines);
+}
+
+
+// 静态的周期估计：[begin, end) 中每条指令执行一次，顺序发射，操作数没准备好时停顿
+// 延迟和调度用的相同。标号、跳转和调用之后不再跟踪寄存器何时就绪
+static int64_t estimateCycles(int begin, int end){
+    int64_t cycle = 0;
+    unordered_map<string, int64_t> ready;
+    for(int i = begin; i < end; i++){
+        const AsmLine &line = asmLines[i];
+        if(line.kind == AsmLine::LABEL){
+            ready.clear();
+            continue;
+        }
+        if(line.kind != AsmLine::INST){
+            continue;
+        }
+        AsmAccess acc;
+        if(!asmAccess(line, acc)){
+            for(auto &a : line.args){
+                if(ready.count(a)){
+                    cycle = max(cycle, ready[a]);
+                }
+            }
+            cycle += isAsmBlockEnd(line.op) ? schedLatency["branch"] : 1;
+            ready.clear();
+            continue;
+        }
+        for(auto &u : acc.uses){
+            if(ready.count(u)){
+                cycle = max(cycle, ready[u]);
+            }
+        }
+        for(auto &d : acc.defs){
+            ready[d] = cycle + acc.latency;
+        }
+        cycle++;
+    }
+    return cycle;
+}
+
+// -emit-stats：每个函数从 .globl 开始，到下一个 .globl 或列表末尾为止
+static void statsAsm(){
+    for(int i = 0; i < (int)asmLines.size(); i++){
+        if(asmLines[i].kind != AsmLine::DIRECTIVE || asmLines[i].op != ".globl"){
+            continue;
+        }
+        int end = i + 1;
+        while(end < (int)asmLines.size() && !(asmLines[end].kind == AsmLine::DIRECTIVE && asmLines[end].op == ".globl")){
+            end++;
+        }
+        FuncStats &st = statsOf(asmLines[i].args[0]);
+        st.asmInsts = 0;
+        for(int k = i; k < end; k++){
+            st.asmInsts += asmLines[k].kind == AsmLine::INST;
+        }
+        st.cycles = estimateCycles(i, end);
+        i = end - 1;
+    }
+}
+
+
+// 输出汇编文本
+static void dumpAsm(){
+    for(auto &line : asmLines){
+        if(line.kind == AsmLine::LABEL){
+            cout << line.op << ":" << endl;
+            continue;
+        }
+        if(line.op.empty()){
+            cout << endl;
+            continue;
+        }
+        cout << "   " << line.op;
+        for(int i = 0; i < (int)line.args.size(); i++){
+            cout << (i == 0 ? " " : ", ") << line.args[i];
+        }
+        cout << endl;
+    }
+}
+
+
+// raw 由 irBuildRaw 从优化后的 IrModule 直接构建，见 raw.hpp
+void riscv_generate(const koopa_raw_program_t &raw){
     // 处理 raw program
     // -----------------------------------
     Visit(raw);
+    if(scheduleInsts){
+        scheduleAsm();
+    }
+    relaxBranches();
+    if(emitStats){
+        statsAsm();
+    }
     /*
     for (size_t i = 0; i < raw.funcs.len; ++i) {
     // 正常情况下, 列表中的元素就是函数, 我们只不过是在确认这个事实
@@ -63,23 +453,933 @@ void riscv_parse(const char* str){
     }
     */
     // -----------------------------------
+}
+
+
+
+// 后端使用的全局状态。值默认放在栈上的槽位中，alloc 则按类型大小分配内存
+// 叶子函数里没有调用，caller-saved 寄存器可以随意使用，值和标量变量尽量直接放在寄存器中
+static unordered_map<koopa_raw_value_t, int> stackOffset; // 指令结果 / alloc 相对 sp 的偏移
+static unordered_map<koopa_raw_value_t, string> valueHome; // 分配到寄存器的值，以及提升到寄存器的标量 alloc
+static int frameSize = 0;      // 当前函数栈帧大小（16 字节对齐）
+static bool hasCall = false;   // 当前函数是否调用了其他函数，决定是否保存 ra
+static string curFuncName;     // 当前函数名，用于生成基本块标号
+static int labelCount = 0;     // 后端自己生成的标号（如批量清零循环）的计数
+static unordered_map<koopa_raw_value_t, string> globalReg; // 当前函数中缓存了地址的全局变量及所用的寄存器
+static vector<string> savedRegs;  // 当前函数需要保存的 s 寄存器
+static koopa_raw_basic_block_t nextBlock; // 紧接在当前块后面输出的块，跳到它时可以不生成跳转
+static unordered_set<string> emittedGlobals; // 已经输出过的全局变量
+
+
+// 类型占用的字节数
+static int typeSize(koopa_raw_type_t ty){
+    switch(ty->tag){
+        case KOOPA_RTT_INT32:
+        case KOOPA_RTT_POINTER:
+            return 4;
+        case KOOPA_RTT_ARRAY:
+            return ty->data.array.len * typeSize(ty->data.array.base);
+        default:
+            return 0;
+    }
+}
+
+
+// 基本块在汇编中的标号。koopa 中的块名只在函数内唯一，所以加上函数名
+static string bbLabel(koopa_raw_basic_block_t bb){
+    return ".L" + curFuncName + "_" + string(bb->name + 1);
+}
+
+
+// 栈上访存。偏移超出 12 位立即数范围时借助 t6 计算地址
+static void lwSp(const string &reg, int offset){
+    if(offset >= -2048 && offset < 2048){
+        emit("lw", {reg, to_string(offset) + "(sp)"});
+    }else{
+        emit("li", {"t6", to_string(offset)});
+        emit("add", {"t6", "sp", "t6"});
+        emit("lw", {reg, "0(t6)"});
+    }
+}
+
+static void swSp(const string &reg, int offset){
+    if(offset >= -2048 && offset < 2048){
+        emit("sw", {reg, to_string(offset) + "(sp)"});
+    }else{
+        emit("li", {"t6", to_string(offset)});
+        emit("add", {"t6", "sp", "t6"});
+        emit("sw", {reg, "0(t6)"});
+    }
+}
+
+// reg = sp + offset
+static void addSp(const string &reg, int offset){
+    if(offset >= -2048 && offset < 2048){
+        emit("addi", {reg, "sp", to_string(offset)});
+    }else{
+        emit("li", {reg, to_string(offset)});
+        emit("add", {reg, "sp", reg});
+    }
+}
+
+static void mv(const string &dest, const string &src){
+    if(dest != src){
+        emit("mv", {dest, src});
+    }
+}
+
+
+// 返回存放 value 的寄存器：整数 0 用 x0，分配了寄存器的值直接用其寄存器，否则装入 scratch
+// 前 8 个参数在 a0~a7 中。前端只在入口处把参数存进 alloc，此时还没有任何调用，a 寄存器仍然有效
+static string valueReg(koopa_raw_value_t value, const string &scratch){
+    if(value->kind.tag == KOOPA_RVT_INTEGER){
+        if(value->kind.data.integer.value == 0){
+            return "x0";
+        }
+        emit("li", {scratch, to_string(value->kind.data.integer.value)});
+        return scratch;
+    }
+    if(value->kind.tag == KOOPA_RVT_FUNC_ARG_REF){
+        int index = value->kind.data.func_arg_ref.index;
+        if(index < 8){
+            return "a" + to_string(index);
+        }
+        lwSp(scratch, frameSize + 4 * (index - 8)); // 多出的参数在调用者栈帧的底部
+        return scratch;
+    }
+    if(valueHome.count(value)){
+        return valueHome[value];
+    }
+    assert(stackOffset.count(value));
+    lwSp(scratch, stackOffset[value]);
+    return scratch;
+}
+
+
+// 把一个值放进指定的寄存器
+static void loadValue(koopa_raw_value_t value, const string &reg){
+    mv(reg, valueReg(value, reg));
+}
+
+
+// 指令结果应该写入的寄存器：分配了寄存器就直接写进去，否则先写进 scratch 再存回栈
+static string resultReg(koopa_raw_value_t value, const string &scratch){
+    if(valueHome.count(value)){
+        return valueHome[value];
+    }
+    return scratch;
+}
+
+
+// 把 reg 中的结果保存到 value 的位置
+static void saveResult(koopa_raw_value_t value, const string &reg){
+    if(valueHome.count(value)){
+        mv(valueHome[value], reg);
+    }else{
+        swSp(reg, stackOffset[value]);
+    }
+}
+
+
+// 把一个指针的值放进寄存器。alloc 的地址由 sp 算出，其余指针是普通的值
+static void loadAddress(koopa_raw_value_t ptr, const string &reg){
+    if(ptr->kind.tag == KOOPA_RVT_ALLOC){
+        addSp(reg, stackOffset[ptr]);
+    }else if(ptr->kind.tag == KOOPA_RVT_GLOBAL_ALLOC){
+        if(globalReg.count(ptr)){
+            mv(reg, globalReg[ptr]);
+        }else{
+            emit("la", {reg, ptr->name + 1});
+        }
+    }else{
+        loadValue(ptr, reg);
+    }
+}
+
+
+// 返回存放指针 ptr 的寄存器。地址已缓存的全局变量和分配了寄存器的指针直接使用该寄存器，否则放进 reg
+static string addressReg(koopa_raw_value_t ptr, const string &reg){
+    if(ptr->kind.tag == KOOPA_RVT_GLOBAL_ALLOC && globalReg.count(ptr)){
+        return globalReg[ptr];
+    }
+    if(ptr->kind.tag != KOOPA_RVT_ALLOC && ptr->kind.tag != KOOPA_RVT_GLOBAL_ALLOC){
+        return valueReg(ptr, reg);
+    }
+    loadAddress(ptr, reg);
+    return reg;
+}
+
+
+// 从 sp+offset 开始清零 size 个字节。小块直接展开，大块用循环，每次迭代清 4 个字
+static void clearStack(int offset, int size){
+    if(size <= 64){
+        for(int i = 0; i < size; i += 4){
+            swSp("x0", offset + i);
+        }
+        return;
+    }
+    int unroll = (size % 16 == 0) ? 4 : 1;
+    string label = ".Lclear_" + to_string(labelCount++);
+    addSp("t0", offset);
+    emit("li", {"t1", to_string(size)});
+    emit("add", {"t1", "t0", "t1"});
+    emitLabel(label);
+    for(int i = 0; i < unroll; i++){
+        emit("sw", {"x0", to_string(i * 4) + "(t0)"});
+    }
+    emit("addi", {"t0", "t0", to_string(unroll * 4)});
+    emit("bne", {"t0", "t1", label});
+}
+
+
+// 函数返回前恢复 ra、s 寄存器和 sp。叶子函数不保存 ra，栈帧为空时也不调整 sp
+static void restoreFrame(){
+    if(hasCall){
+        lwSp("ra", frameSize - 4);
+    }
+    for(int i = 0; i < (int)savedRegs.size(); i++){
+        lwSp(savedRegs[i], frameSize - 8 - 4 * i);
+    }
+    if(frameSize != 0){
+        if(frameSize < 2048){
+            emit("addi", {"sp", "sp", to_string(frameSize)});
+        }else{
+            emit("li", {"t0", to_string(frameSize)});
+            emit("add", {"sp", "sp", "t0"});
+        }
+    }
+}
+
+static void epilogue(){
+    restoreFrame();
+    emit("ret");
+}
+
+
+// 指针是否由当前栈帧中的 alloc 算出
+static bool pointsIntoFrame(koopa_raw_value_t ptr){
+    while(ptr->kind.tag == KOOPA_RVT_GET_ELEM_PTR || ptr->kind.tag == KOOPA_RVT_GET_PTR){
+        ptr = ptr->kind.tag == KOOPA_RVT_GET_ELEM_PTR ? ptr->kind.data.get_elem_ptr.src : ptr->kind.data.get_ptr.src;
+    }
+    return ptr->kind.tag == KOOPA_RVT_ALLOC;
+}
+
+
+// 前端插入的向量循环 @__vec_K，不是真的调用
+static bool isVecCall(koopa_raw_value_t inst){
+    return inst->kind.tag == KOOPA_RVT_CALL && strncmp(inst->kind.data.call.callee->name, "@__vec_", 7) == 0;
+}
+
+// call 之后紧跟着 ret 它的结果（或者不带返回值的 ret）时是尾调用，可以先释放栈帧再跳过去，由被调用者直接返回
+// 参数都要放在寄存器里，也不能把指向本栈帧的指针传过去
+static bool isTailCall(koopa_raw_value_t inst, koopa_raw_value_t next){
+    if(inst->kind.tag != KOOPA_RVT_CALL || isVecCall(inst) || next == nullptr || next->kind.tag != KOOPA_RVT_RETURN){
+        return false;
+    }
+    if(next->kind.data.ret.value != nullptr && next->kind.data.ret.value != inst){
+        return false;
+    }
+    auto &args = inst->kind.data.call.args;
+    if(args.len > 8){
+        return false;
+    }
+    for(size_t i = 0; i < args.len; i++){
+        if(pointsIntoFrame(reinterpret_cast<koopa_raw_value_t>(args.buffer[i]))){
+            return false;
+        }
+    }
+    return true;
+}
+
+
+// 尾调用：装好参数，恢复现场后用 tail 跳转
+static void dumpTailCall(koopa_raw_value_t inst){
+    auto &args = inst->kind.data.call.args;
+    for(size_t i = 0; i < args.len; i++){
+        loadValue(reinterpret_cast<koopa_raw_value_t>(args.buffer[i]), "a" + to_string(i));
+    }
+    restoreFrame();
+    emit("tail", {inst->kind.data.call.callee->name + 1});
+}
+
+
+// 指令选择的两种模式：
+// 比较的结果只被紧跟着的 br 用到时不单独算出来，和 br 合成一条 blt/bge/beq/bne；
+// 运算的一个操作数是 12 位以内的整数时用带立即数的指令（addi、slti、andi、ori、xori、移位），省掉装常数的 li，
+// 和 0 比较相等用 seqz/snez
+static bool isCompare(koopa_raw_binary_op_t op){
+    return op == KOOPA_RBO_EQ || op == KOOPA_RBO_NOT_EQ || op == KOOPA_RBO_LT ||
+           op == KOOPA_RBO_GT || op == KOOPA_RBO_LE || op == KOOPA_RBO_GE;
+}
+
+static bool isFusedCompare(koopa_raw_value_t inst, koopa_raw_value_t next){
+    return inst->kind.tag == KOOPA_RVT_BINARY && isCompare(inst->kind.data.binary.op) && inst->used_by.len == 1 &&
+           next != nullptr && next->kind.tag == KOOPA_RVT_BRANCH && next->kind.data.branch.cond == inst;
+}
+
+// 比较并跳转，后继紧跟在后面时反过来跳到另一边
+static void dumpCompareBranch(koopa_raw_value_t cmp, koopa_raw_value_t br){
+    static const unordered_map<string, string> inverse = {{"beq", "bne"}, {"bne", "beq"}, {"blt", "bge"}, {"bge", "blt"}};
+    auto &bin = cmp->kind.data.binary;
+    string l = valueReg(bin.lhs, "t0");
+    string r = valueReg(bin.rhs, "t1");
+    string op;
+    switch(bin.op){
+        case KOOPA_RBO_EQ: op = "beq"; break;
+        case KOOPA_RBO_NOT_EQ: op = "bne"; break;
+        case KOOPA_RBO_LT: op = "blt"; break;
+        case KOOPA_RBO_GE: op = "bge"; break;
+        case KOOPA_RBO_GT: op = "blt"; swap(l, r); break; // l > r 即 r < l
+        default: op = "bge"; swap(l, r); break;           // l <= r 即 r >= l
+    }
+    auto &branch = br->kind.data.branch;
+    if(branch.true_bb == nextBlock){
+        emit(inverse.at(op), {l, r, bbLabel(branch.false_bb)});
+    }else{
+        emit(op, {l, r, bbLabel(branch.true_bb)});
+        if(branch.false_bb != nextBlock){
+            emit("j", {bbLabel(branch.false_bb)});
+        }
+    }
+}
+
+// 带立即数的运算，不适用时返回 false，什么也不生成
+static bool dumpBinaryImm(koopa_raw_value_t value){
+    auto lhs = value->kind.data.binary.lhs, rhs = value->kind.data.binary.rhs;
+    auto op = value->kind.data.binary.op;
+    if(lhs->kind.tag == KOOPA_RVT_INTEGER && rhs->kind.tag != KOOPA_RVT_INTEGER){
+        // 常数换到右边，大小比较跟着换方向
+        switch(op){
+            case KOOPA_RBO_ADD: case KOOPA_RBO_MUL: case KOOPA_RBO_AND: case KOOPA_RBO_OR:
+            case KOOPA_RBO_XOR: case KOOPA_RBO_EQ: case KOOPA_RBO_NOT_EQ: break;
+            case KOOPA_RBO_LT: op = KOOPA_RBO_GT; break;
+            case KOOPA_RBO_GT: op = KOOPA_RBO_LT; break;
+            case KOOPA_RBO_LE: op = KOOPA_RBO_GE; break;
+            case KOOPA_RBO_GE: op = KOOPA_RBO_LE; break;
+            default: return false;
+        }
+        swap(lhs, rhs);
+    }
+    if(rhs->kind.tag != KOOPA_RVT_INTEGER){
+        return false;
+    }
+    int64_t c = rhs->kind.data.integer.value;
+    auto fits = [](int64_t x){ return x >= -2048 && x < 2048; };
+    string inst, post;
+    int64_t imm = c;
+    switch(op){
+        case KOOPA_RBO_EQ: case KOOPA_RBO_NOT_EQ:
+            post = op == KOOPA_RBO_EQ ? "seqz" : "snez";
+            inst = c == 0 ? "" : "xori";
+            if(!fits(c)){
+                return false;
+            }
+            break;
+        case KOOPA_RBO_ADD: inst = "addi"; break;
+        case KOOPA_RBO_SUB: inst = "addi"; imm = -c; break;
+        case KOOPA_RBO_AND: inst = "andi"; break;
+        case KOOPA_RBO_OR: inst = "ori"; break;
+        case KOOPA_RBO_XOR: inst = "xori"; break;
+        case KOOPA_RBO_LT: inst = "slti"; break;
+        case KOOPA_RBO_LE: inst = "slti"; imm = c + 1; break;                // x <= c 即 x < c + 1
+        case KOOPA_RBO_GE: inst = "slti"; post = "xori"; break;              // x >= c 即 !(x < c)
+        case KOOPA_RBO_SHL: inst = "slli"; imm = c & 31; break;
+        case KOOPA_RBO_SHR: inst = "srli"; imm = c & 31; break;
+        case KOOPA_RBO_SAR: inst = "srai"; imm = c & 31; break;
+        case KOOPA_RBO_MUL:                                                   // 乘 2 的幂改成左移
+            if(c <= 1 || (c & (c - 1)) != 0){
+                return false;
+            }
+            inst = "slli";
+            for(imm = 0; (1LL << imm) < c; imm++);
+            break;
+        default: return false;
+    }
+    if(!fits(imm)){
+        return false;
+    }
+    string x = valueReg(lhs, "t0");
+    string rd = resultReg(value, "t0");
+    if(inst.empty()){
+        emit(post, {rd, x});
+    }else{
+        emit(inst, {rd, x, to_string(imm)});
+        if(post == "xori"){
+            emit("xori", {rd, rd, "1"});
+        }else if(!post.empty()){
+            emit(post, {rd, rd});
+        }
+    }
+    saveResult(value, rd);
+    return true;
+}
+
+
+// 合并输出（-fbatch-io，要和 runtime/sylib.c 一起链接）
+// 一个基本块内，中间没有隔着别的调用的 putch(常数) 和 putint 看作一串，推迟到最后一个一起输出：
+// 连续的 putch 装进 __sysy_putchars(n, w0..w6)，每个字小端放 4 个字符；putint 和紧跟着的 putch 用 __sysy_putint_chars(x, n, w0..w5)
+// 中间的指令照常生成，它们没有输入输出，提前执行不影响结果；有调用的函数中值都在栈上，推迟装参数也取得到
+static bool batchIO = false;
+
+// 0：不是输出，1：putch(常数)，2：putint
+static int outputKind(koopa_raw_value_t inst){
+    if(inst->kind.tag != KOOPA_RVT_CALL){
+        return 0;
+    }
+    const char *name = inst->kind.data.call.callee->name;
+    if(strcmp(name, "@putint") == 0){
+        return 2;
+    }
+    auto &args = inst->kind.data.call.args;
+    if(strcmp(name, "@putch") == 0 && reinterpret_cast<koopa_raw_value_t>(args.buffer[0])->kind.tag == KOOPA_RVT_INTEGER){
+        return 1;
+    }
+    return 0;
+}
+
+static koopa_raw_value_t firstArg(koopa_raw_value_t call){
+    return reinterpret_cast<koopa_raw_value_t>(call->kind.data.call.args.buffer[0]);
+}
+
+// 把 chars 中的字符按字装进从 a<first> 开始的寄存器，a<first - 1> 是字符个数
+static void loadPackedChars(const vector<int> &chars, int first){
+    emit("li", {"a" + to_string(first - 1), to_string(chars.size())});
+    for(int i = 0; i < (int)chars.size(); i += 4){
+        uint32_t w = 0;
+        for(int j = i; j < i + 4 && j < (int)chars.size(); j++){
+            w |= (uint32_t)(chars[j] & 0xff) << (8 * (j - i));
+        }
+        emit("li", {"a" + to_string(first + i / 4), to_string((int32_t)w)});
+    }
+}
 
-    // 处理完成, 释放 raw program builder 占用的内存
-    // 注意, raw program 中所有的指针指向的内存均为 raw program builder 的内存
-    // 所以不要在 raw program builder 处理完毕之前释放 builder
-    koopa_delete_raw_program_builder(builder);
+// 从第 start 条指令开始的一串输出，返回之后第一条还没生成的指令
+static size_t dumpBatchedOutput(koopa_raw_basic_block_t bb, size_t start){
+    vector<koopa_raw_value_t> outputs;
+    size_t i = start;
+    for(; i < bb->insts.len; i++){
+        auto inst = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[i]);
+        if(outputKind(inst) != 0){
+            outputs.push_back(inst);
+        }else if(inst->kind.tag == KOOPA_RVT_CALL || inst->kind.tag == KOOPA_RVT_BRANCH
+                 || inst->kind.tag == KOOPA_RVT_JUMP || inst->kind.tag == KOOPA_RVT_RETURN){
+            break;
+        }else{
+            Visit(inst);
+        }
+    }
+    for(size_t k = 0; k < outputs.size();){
+        koopa_raw_value_t value = nullptr; // putint 的参数
+        if(outputKind(outputs[k]) == 2){
+            value = firstArg(outputs[k++]);
+        }
+        int limit = value != nullptr ? 24 : 28;
+        vector<int> chars;
+        while(k < outputs.size() && outputKind(outputs[k]) == 1 && (int)chars.size() < limit){
+            chars.push_back(firstArg(outputs[k++])->kind.data.integer.value);
+        }
+        if(value != nullptr && chars.empty()){
+            loadValue(value, "a0");
+            emit("call", {"putint"});
+        }else if(value != nullptr){
+            loadValue(value, "a0");
+            loadPackedChars(chars, 2);
+            emit("call", {"__sysy_putint_chars"});
+        }else if(chars.size() == 1){
+            emit("li", {"a0", to_string(chars[0])});
+            emit("call", {"putch"});
+        }else{
+            loadPackedChars(chars, 1);
+            emit("call", {"__sysy_putchars"});
+        }
+    }
+    return i;
+}
+
+
+// 展开向量循环，见 vector.hpp。t0 是下标 i，t2 是这一段的元素个数，t6 是 i 对应的字节偏移，t1 用来装地址和标量
+// v0 放比较的结果，v1 开始是后缀式求值的栈。结果是处理到的下标
+static void dumpVecKernel(koopa_raw_value_t value){
+    auto &call = value->kind.data.call;
+    const VecKernel &k = vecKernels[stoi(call.callee->name + 7)];
+    auto arg = [&](int i){
+        return reinterpret_cast<koopa_raw_value_t>(call.args.buffer[i]);
+    };
+    auto v = [](int i){
+        return "v" + to_string(i);
+    };
+    koopa_raw_value_t n = arg(k.arrays + k.scalars + 1);
+    string id = to_string(labelCount++);
+    string loop = ".Lvec_loop_" + id, done = ".Lvec_done_" + id;
+    loadValue(arg(k.arrays + k.scalars), "t0");
+
+    // 两个数组的首地址不同，而 [首地址 + 4i, 首地址 + 4N) 相交时不做向量化，全部留给后面的标量循环
+    if(!k.aliasChecks.empty()){
+        loadValue(n, "t1");
+        emit("sub", {"t1", "t1", "t0"});
+        emit("blez", {"t1", done});
+        emit("slli", {"t1", "t1", "2"});
+        for(auto &p : k.aliasChecks){
+            string next = ".Lvec_alias_" + to_string(labelCount++);
+            loadValue(arg(p.first), "t2");
+            emit("sub", {"t2", "t2", valueReg(arg(p.second), "t6")});
+            emit("beqz", {"t2", next});
+            emit("srai", {"t6", "t2", "31"});
+            emit("xor", {"t2", "t2", "t6"});
+            emit("sub", {"t2", "t2", "t6"});
+            emit("bltu", {"t2", "t1", done});
+            emitLabel(next);
+        }
+    }
+
+    emitLabel(loop);
+    loadValue(n, "t1");
+    emit("sub", {"t2", "t1", "t0"});
+    emit("blez", {"t2", done});
+    emit("vsetvli", {"t2", "t2", "e32", "m1", "ta", "ma"});
+    emit("slli", {"t6", "t0", "2"});
+    // 比较的结果是掩码，再用 vmerge 变成 0 和 1
+    static const unordered_map<string, pair<string, bool> > compares = { // 指令，是否交换操作数
+        {"<", {"vmslt.vv", false}}, {">", {"vmslt.vv", true}}, {"<=", {"vmsle.vv", false}},
+        {">=", {"vmsle.vv", true}}, {"==", {"vmseq.vv", false}}, {"!=", {"vmsne.vv", false}}
+    };
+    static const unordered_map<string, string> arith = {
+        {"+", "vadd.vv"}, {"-", "vsub.vv"}, {"*", "vmul.vv"}, {"/", "vdiv.vv"}, {"%", "vrem.vv"}
+    };
+    for(auto &st : k.stores){
+        int top = 0;
+        for(auto &node : st.expr){
+            if(node.kind == VEC_LOAD){
+                top++;
+                emit("add", {"t1", valueReg(arg(node.arg), "t1"), "t6"});
+                emit("vle32.v", {v(top), "(t1)"});
+            }else if(node.kind == VEC_SPLAT){
+                top++;
+                koopa_raw_value_t x = arg(k.arrays + node.arg);
+                if(x->kind.tag == KOOPA_RVT_INTEGER && x->kind.data.integer.value >= -16 && x->kind.data.integer.value < 16){
+                    emit("vmv.v.i", {v(top), to_string(x->kind.data.integer.value)});
+                }else{
+                    emit("vmv.v.x", {v(top), valueReg(x, "t1")});
+                }
+            }else if(node.op == "neg"){
+                emit("vrsub.vi", {v(top), v(top), "0"});
+            }else if(node.op == "!"){
+                emit("vmseq.vi", {"v0", v(top), "0"});
+                emit("vmv.v.i", {v(top), "0"});
+                emit("vmerge.vim", {v(top), v(top), "1", "v0"});
+            }else if(arith.count(node.op)){
+                top--;
+                emit(arith.at(node.op), {v(top), v(top), v(top + 1)});
+            }else{
+                top--;
+                auto &cmp = compares.at(node.op);
+                emit(cmp.first, {"v0", v(cmp.second ? top + 1 : top), v(cmp.second ? top : top + 1)});
+                emit("vmv.v.i", {v(top), "0"});
+                emit("vmerge.vim", {v(top), v(top), "1", "v0"});
+            }
+        }
+        emit("add", {"t1", valueReg(arg(st.array), "t1"), "t6"});
+        emit("vse32.v", {v(top), "(t1)"});
+    }
+    emit("add", {"t0", "t0", "t2"});
+    emit("j", {loop});
+    emitLabel(done);
+    saveResult(value, "t0");
+}
+
+
+// 指令用到的值（不含基本块）
+static vector<koopa_raw_value_t> operandsOf(koopa_raw_value_t inst){
+    const auto &kind = inst->kind;
+    switch(kind.tag){
+        case KOOPA_RVT_LOAD: return {kind.data.load.src};
+        case KOOPA_RVT_STORE: return {kind.data.store.value, kind.data.store.dest};
+        case KOOPA_RVT_GET_PTR: return {kind.data.get_ptr.src, kind.data.get_ptr.index};
+        case KOOPA_RVT_GET_ELEM_PTR: return {kind.data.get_elem_ptr.src, kind.data.get_elem_ptr.index};
+        case KOOPA_RVT_BINARY: return {kind.data.binary.lhs, kind.data.binary.rhs};
+        case KOOPA_RVT_BRANCH: return {kind.data.branch.cond};
+        case KOOPA_RVT_RETURN:
+            if(kind.data.ret.value != nullptr){
+                return {kind.data.ret.value};
+            }
+            return {};
+        case KOOPA_RVT_CALL:{
+            vector<koopa_raw_value_t> ops;
+            for(size_t i = 0; i < kind.data.call.args.len; i++){
+                ops.push_back(reinterpret_cast<koopa_raw_value_t>(kind.data.call.args.buffer[i]));
+            }
+            return ops;
+        }
+        default:
+            return {};
+    }
+}
+
+
+// 指针指向的 alloc 或全局变量，从参数 load 出来的指针返回 nullptr
+static koopa_raw_value_t pointerRoot(koopa_raw_value_t ptr){
+    while(ptr->kind.tag == KOOPA_RVT_GET_ELEM_PTR || ptr->kind.tag == KOOPA_RVT_GET_PTR){
+        ptr = ptr->kind.tag == KOOPA_RVT_GET_ELEM_PTR ? ptr->kind.data.get_elem_ptr.src : ptr->kind.data.get_ptr.src;
+    }
+    if(ptr->kind.tag == KOOPA_RVT_ALLOC || ptr->kind.tag == KOOPA_RVT_GLOBAL_ALLOC){
+        return ptr;
+    }
+    return nullptr;
+}
+
+// 两次访存可能重叠吗。数组参数只能指向调用者的数组或者全局数组，不会指向本函数的 alloc
+static bool mayAlias(koopa_raw_value_t p, koopa_raw_value_t q){
+    koopa_raw_value_t a = pointerRoot(p), b = pointerRoot(q);
+    if(a != nullptr && b != nullptr){
+        return a == b;
+    }
+    if(a == nullptr && b == nullptr){
+        return true;
+    }
+    koopa_raw_value_t known = a != nullptr ? a : b;
+    return known->kind.tag == KOOPA_RVT_GLOBAL_ALLOC;
+}
+
+// 寄存器分配之前的调度：直接重排基本块中的 koopa 指令。调用前后的指令不会越过调用，块末尾的跳转留在最后
+static void scheduleKoopaBlock(koopa_raw_basic_block_t bb){
+    int n = bb->insts.len;
+    if(n < 3){
+        return;
+    }
+    vector<koopa_raw_value_t> insts;
+    unordered_map<koopa_raw_value_t, int> index;
+    for(int k = 0; k < n; k++){
+        insts.push_back(reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[k]));
+        index[insts[k]] = k;
+    }
+    auto latency = [](koopa_raw_value_t v){
+        if(v->kind.tag == KOOPA_RVT_LOAD){
+            return schedLatency["load"];
+        }
+        if(v->kind.tag == KOOPA_RVT_BINARY){
+            auto op = v->kind.data.binary.op;
+            if(op == KOOPA_RBO_MUL){
+                return schedLatency["mul"];
+            }
+            if(op == KOOPA_RBO_DIV || op == KOOPA_RBO_MOD){
+                return schedLatency["div"];
+            }
+        }
+        return 1;
+    };
+    auto memPointer = [](koopa_raw_value_t v) -> koopa_raw_value_t {
+        if(v->kind.tag == KOOPA_RVT_LOAD){
+            return v->kind.data.load.src;
+        }
+        if(v->kind.tag == KOOPA_RVT_STORE){
+            return v->kind.data.store.dest;
+        }
+        return nullptr;
+    };
+
+    vector<SchedNode> nodes(n);
+    int lastCall = -1;
+    for(int k = 0; k < n; k++){
+        koopa_raw_value_t v = insts[k];
+        nodes[k].latency = latency(v);
+        bool isEnd = k == n - 1;
+        for(auto o : operandsOf(v)){
+            if(index.count(o) && index[o] < k){
+                int lat = latency(o);
+                nodes[index[o]].succs.push_back(make_pair(k, isEnd ? max(lat, schedLatency["branch"]) : lat));
+            }
+        }
+        if(isEnd || v->kind.tag == KOOPA_RVT_CALL){
+            for(int p = (isEnd || lastCall < 0 ? 0 : lastCall); p < k; p++){
+                nodes[p].succs.push_back(make_pair(k, 0));
+            }
+            lastCall = k;
+            continue;
+        }
+        if(lastCall >= 0){
+            nodes[lastCall].succs.push_back(make_pair(k, 0));
+        }
+        koopa_raw_value_t ptr = memPointer(v);
+        if(ptr == nullptr){
+            continue;
+        }
+        for(int p = lastCall + 1; p < k; p++){
+            koopa_raw_value_t q = memPointer(insts[p]);
+            if(q == nullptr || (v->kind.tag == KOOPA_RVT_LOAD && insts[p]->kind.tag == KOOPA_RVT_LOAD)){
+                continue;
+            }
+            if(mayAlias(ptr, q)){
+                nodes[p].succs.push_back(make_pair(k, insts[p]->kind.tag == KOOPA_RVT_STORE && v->kind.tag == KOOPA_RVT_LOAD ? 1 : 0));
+            }
+        }
+    }
+    vector<int> order = listSchedule(nodes);
+    for(int k = 0; k < n; k++){
+        bb->insts.buffer[k] = insts[order[k]];
+    }
+}
+
+
+// 标量 alloc 只被直接 load/store 时可以提升到寄存器中
+static bool isPromotable(koopa_raw_value_t alloc){
+    auto base = alloc->ty->data.pointer.base;
+    if(base->tag != KOOPA_RTT_INT32 && base->tag != KOOPA_RTT_POINTER){
+        return false;
+    }
+    for(size_t i = 0; i < alloc->used_by.len; i++){
+        auto user = reinterpret_cast<koopa_raw_value_t>(alloc->used_by.buffer[i]);
+        if(user->kind.tag == KOOPA_RVT_LOAD){
+            continue;
+        }
+        if(user->kind.tag == KOOPA_RVT_STORE && user->kind.data.store.dest == alloc && user->kind.data.store.value != alloc){
+            continue;
+        }
+        return false;
+    }
+    return true;
+}
+
+
+// 叶子函数的寄存器分配。可用的是 t3~t5 以及不用于传参的 a 寄存器（t0~t2、t6 留作临时寄存器）
+// 依次分配：提升的标量变量（参数直接用传入它的 a 寄存器）、跨基本块使用的值、多次使用的全局变量地址，
+// 最后在每个基本块内按活跃区间给只在块内使用的值分配剩下的寄存器。分不到寄存器的仍放在栈上
+static void allocLeafRegs(const koopa_raw_function_t &func, unordered_map<koopa_raw_value_t, int> &globalUses){
+    int paramRegs = min((int)func->params.len, 8);
+    vector<string> pool = {"t3", "t4", "t5"};
+    for(int i = 7; i >= paramRegs; i--){
+        pool.push_back("a" + to_string(i));
+    }
+
+    unordered_map<koopa_raw_value_t, koopa_raw_basic_block_t> instBlock;
+    for(size_t i = 0; i < func->bbs.len; i++){
+        auto bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+        for(size_t j = 0; j < bb->insts.len; j++){
+            instBlock[reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[j])] = bb;
+        }
+    }
+
+    // 提升的标量变量
+    for(size_t i = 0; i < func->bbs.len; i++){
+        auto bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+        for(size_t j = 0; j < bb->insts.len; j++){
+            auto inst = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[j]);
+            if(inst->kind.tag != KOOPA_RVT_ALLOC || !isPromotable(inst)){
+                continue;
+            }
+            string home;
+            for(size_t k = 0; k < inst->used_by.len; k++){ // 保存参数的变量直接沿用参数的寄存器
+                auto user = reinterpret_cast<koopa_raw_value_t>(inst->used_by.buffer[k]);
+                auto v = user->kind.tag == KOOPA_RVT_STORE ? user->kind.data.store.value : nullptr;
+                if(v != nullptr && v->kind.tag == KOOPA_RVT_FUNC_ARG_REF && v->kind.data.func_arg_ref.index < 8){
+                    home = "a" + to_string(v->kind.data.func_arg_ref.index);
+                }
+            }
+            if(home.empty() && !pool.empty()){
+                home = pool.front();
+                pool.erase(pool.begin());
+            }
+            if(!home.empty()){
+                valueHome[inst] = home;
+            }
+        }
+    }
+
+    // 跨基本块使用的值
+    for(size_t i = 0; i < func->bbs.len && !pool.empty(); i++){
+        auto bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+        for(size_t j = 0; j < bb->insts.len && !pool.empty(); j++){
+            auto inst = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[j]);
+            if(inst->kind.tag == KOOPA_RVT_ALLOC || inst->ty->tag == KOOPA_RTT_UNIT){
+                continue;
+            }
+            bool isLocal = true;
+            for(size_t k = 0; k < inst->used_by.len; k++){
+                isLocal = isLocal && instBlock[reinterpret_cast<koopa_raw_value_t>(inst->used_by.buffer[k])] == bb;
+            }
+            if(!isLocal){
+                valueHome[inst] = pool.front();
+                pool.erase(pool.begin());
+            }
+        }
+    }
+
+    // 多次使用的全局变量地址，和非叶子函数一样按使用次数从多到少、同样多时按名字分配，不依赖指针的顺序
+    vector<pair<int, koopa_raw_value_t> > candidates;
+    for(auto &p : globalUses){
+        if(p.second >= 2){
+            candidates.push_back(make_pair(-p.second, p.first));
+        }
+    }
+    sort(candidates.begin(), candidates.end(), [](const pair<int, koopa_raw_value_t> &a, const pair<int, koopa_raw_value_t> &b){
+        return a.first != b.first ? a.first < b.first : strcmp(a.second->name, b.second->name) < 0;
+    });
+    for(auto &c : candidates){
+        if(pool.empty()){
+            break;
+        }
+        globalReg[c.second] = pool.front();
+        pool.erase(pool.begin());
+    }
+
+    // 块内的值：活跃区间到块内最后一次使用为止
+    for(size_t i = 0; i < func->bbs.len; i++){
+        auto bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+        unordered_map<koopa_raw_value_t, int> lastUse;
+        for(size_t j = 0; j < bb->insts.len; j++){
+            for(auto op : operandsOf(reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[j]))){
+                lastUse[op] = j;
+            }
+        }
+        vector<string> freeRegs = pool;
+        vector<pair<int, koopa_raw_value_t> > active;
+        for(size_t j = 0; j < bb->insts.len; j++){
+            auto inst = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[j]);
+            // 操作数在本条指令之后不再使用时，寄存器可以给结果用：各条指令都先读操作数再写结果
+            for(int k = active.size() - 1; k >= 0; k--){
+                if(active[k].first <= (int)j){
+                    freeRegs.push_back(valueHome[active[k].second]);
+                    active.erase(active.begin() + k);
+                }
+            }
+            if(inst->kind.tag == KOOPA_RVT_ALLOC || inst->ty->tag == KOOPA_RTT_UNIT || valueHome.count(inst) || freeRegs.empty()){
+                continue;
+            }
+            valueHome[inst] = freeRegs.back();
+            freeRegs.pop_back();
+            active.push_back(make_pair(lastUse.count(inst) ? lastUse[inst] : (int)j, inst));
+        }
+    }
+}
+
+
+// 输出全局变量的初值。连续的 0 合并成一条 .zero，zeros 记录尚未输出的 0 的字节数
+// 基本块的后继
+static vector<koopa_raw_basic_block_t> successorsOf(koopa_raw_basic_block_t bb){
+    if(bb->insts.len == 0){
+        return {};
+    }
+    auto last = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[bb->insts.len - 1]);
+    if(last->kind.tag == KOOPA_RVT_BRANCH){
+        return {last->kind.data.branch.true_bb, last->kind.data.branch.false_bb};
+    }else if(last->kind.tag == KOOPA_RVT_JUMP){
+        return {last->kind.data.jump.target};
+    }
+    return {};
+}
+
+// 基本块的输出顺序。没有 profile 时保持原来的顺序；
+// 有 profile 时从入口开始，每次把执行次数最多的出边指向的块接在后面，使热路径直接落下去，
+// 后继都已经放好或者从没走过时，从剩下的块中挑执行次数最多的，没执行过的块按原顺序放在最后
+static vector<koopa_raw_basic_block_t> blockLayout(const koopa_raw_function_t &func){
+    vector<koopa_raw_basic_block_t> blocks, layout;
+    for(size_t i = 0; i < func->bbs.len; i++){
+        blocks.push_back(reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]));
+    }
+    string name = func->name;
+    if(!profileCount.count(profileBlockKey(name, blocks[0]->name))){
+        return blocks;
+    }
+    auto count = [&](const string &key) -> int64_t {
+        auto it = profileCount.find(key);
+        return it == profileCount.end() ? 0 : it->second;
+    };
+    unordered_map<koopa_raw_basic_block_t, bool> placed;
+    koopa_raw_basic_block_t cur = blocks[0];
+    while(cur != nullptr){
+        layout.push_back(cur);
+        placed[cur] = true;
+        koopa_raw_basic_block_t best = nullptr;
+        int64_t bestCount = 0;
+        for(auto succ : successorsOf(cur)){
+            // jump 的边没有单独的计数器，次数就是块的次数
+            int64_t c = successorsOf(cur).size() == 1 ? count(profileBlockKey(name, cur->name)) : count(profileEdgeKey(name, cur->name, succ->name));
+            if(!placed[succ] && c > bestCount){
+                best = succ;
+                bestCount = c;
+            }
+        }
+        if(best == nullptr){
+            int64_t hottest = -1;
+            for(auto bb : blocks){
+                if(!placed[bb] && count(profileBlockKey(name, bb->name)) > hottest){
+                    best = bb;
+                    hottest = count(profileBlockKey(name, bb->name));
+                }
+            }
+        }
+        cur = best;
+    }
+    return layout;
 }
 
 
+static void dumpGlobalInit(koopa_raw_value_t init, int &zeros){
+    switch(init->kind.tag){
+        case KOOPA_RVT_INTEGER:
+            if(init->kind.data.integer.value == 0){
+                zeros += 4;
+            }else{
+                if(zeros != 0){
+                    emitDirective(".zero", {to_string(zeros)});
+                    zeros = 0;
+                }
+                emitDirective(".word", {to_string(init->kind.data.integer.value)});
+            }
+            break;
+        case KOOPA_RVT_ZERO_INIT:
+        case KOOPA_RVT_UNDEF:
+            zeros += typeSize(init->ty);
+            break;
+        case KOOPA_RVT_AGGREGATE:
+            for(size_t i = 0; i < init->kind.data.aggregate.elems.len; i++){
+                dumpGlobalInit(reinterpret_cast<koopa_raw_value_t>(init->kind.data.aggregate.elems.buffer[i]), zeros);
+            }
+            break;
+        default:
+            assert(false);
+    }
+}
+
+
+// 访问全局变量。zeroinit 的放进 .bss，其余放进 .data
+static void VisitGlobal(koopa_raw_value_t value){
+    assert(value->kind.tag == KOOPA_RVT_GLOBAL_ALLOC);
+    // -fstream 时全局变量的定义会拼在每个函数前面，只在第一次见到时输出
+    if(!emittedGlobals.insert(value->name).second){
+        return;
+    }
+    auto init = value->kind.data.global_alloc.init;
+    if(init->kind.tag == KOOPA_RVT_ZERO_INIT || init->kind.tag == KOOPA_RVT_UNDEF){
+        emitDirective(".bss");
+    }else{
+        emitDirective(".data");
+    }
+    emitDirective(".align", {"2"});
+    emitLabel(value->name + 1);
+    int zeros = 0;
+    dumpGlobalInit(init, zeros);
+    if(zeros != 0){
+        emitDirective(".zero", {to_string(zeros)});
+    }
+    emitDirective("");
+}
+
 
 // 访问 raw program
 void Visit(const koopa_raw_program_t &program) {
     // 执行一些其他的必要操作
     // ...
-    cout<<"   .text"<<endl;
     // 访问所有全局变量
-    //Visit(program.values);
-    // 访问所有函数
+    for(size_t i = 0; i < program.values.len; i++){
+        VisitGlobal(reinterpret_cast<koopa_raw_value_t>(program.values.buffer[i]));
+    }
+    // 访问所有函数。-fstream 时全局声明单独生成，没有函数定义就不输出 .text
+    for(size_t i = 0; i < program.funcs.len; i++){
+        if(reinterpret_cast<koopa_raw_function_t>(program.funcs.buffer[i])->bbs.len != 0){
+            emitDirective(".text");
+            break;
+        }
+    }
     Visit(program.funcs);
 }
 
@@ -110,55 +1410,338 @@ void Visit(const koopa_raw_slice_t &slice) {
 
 // 访问函数
 void Visit(const koopa_raw_function_t &func) {
-    // 执行一些其他的必要操作
-    cout << "   .globl " << func->name+1 << endl;
-    cout << func->name+1 << ":" << endl;
-    // 访问所有基本块
-    Visit(func->bbs);
+    // 只有声明的函数不需要生成代码
+    if(func->bbs.len == 0){
+        return;
+    }
+    curFuncName = func->name + 1;
+    if(emitStats){
+        statsKoopaFunc(func);
+    }
+    if(scheduleInsts){
+        for(size_t i = 0; i < func->bbs.len; i++){
+            scheduleKoopaBlock(reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]));
+        }
+    }
+
+    stackOffset.clear();
+    valueHome.clear();
+    globalReg.clear();
+    savedRegs.clear();
+    hasCall = false;
+    int outgoing = 0; // 栈底给超过 8 个的调用参数留出的空间
+    unordered_map<koopa_raw_value_t, int> globalUses;
+    for(size_t i = 0; i < func->bbs.len; i++){
+        auto bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+        for(size_t j = 0; j < bb->insts.len; j++){
+            auto inst = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[j]);
+            if(inst->kind.tag == KOOPA_RVT_CALL && !isVecCall(inst)){
+                hasCall = true;
+                outgoing = max(outgoing, 4 * ((int)inst->kind.data.call.args.len - 8));
+            }
+            // 统计每个全局变量作为地址被使用的次数
+            koopa_raw_value_t ptr = nullptr;
+            switch(inst->kind.tag){
+                case KOOPA_RVT_LOAD: ptr = inst->kind.data.load.src; break;
+                case KOOPA_RVT_STORE: ptr = inst->kind.data.store.dest; break;
+                case KOOPA_RVT_GET_ELEM_PTR: ptr = inst->kind.data.get_elem_ptr.src; break;
+                case KOOPA_RVT_GET_PTR: ptr = inst->kind.data.get_ptr.src; break;
+                default: break;
+            }
+            if(ptr != nullptr && ptr->kind.tag == KOOPA_RVT_GLOBAL_ALLOC){
+                globalUses[ptr]++;
+            }
+        }
+    }
+
+    vector<koopa_raw_value_t> cachedGlobals;
+    if(!hasCall){
+        // 叶子函数：值尽量放进 caller-saved 寄存器，不需要保存 ra，地址缓存也用 caller-saved 寄存器
+        allocLeafRegs(func, globalUses);
+        for(auto &p : globalReg){
+            cachedGlobals.push_back(p.first);
+        }
+        sort(cachedGlobals.begin(), cachedGlobals.end(), [](koopa_raw_value_t a, koopa_raw_value_t b){
+            return strcmp(a->name, b->name) < 0;
+        });
+    }else{
+        // 使用不少于两次的全局变量在入口处 la 一次，地址放进 s1~s11，按使用次数从多到少分配
+        vector<pair<int, koopa_raw_value_t> > candidates;
+        for(auto &p : globalUses){
+            if(p.second >= 2){
+                candidates.push_back(make_pair(-p.second, p.first));
+            }
+        }
+        sort(candidates.begin(), candidates.end(), [](const pair<int, koopa_raw_value_t> &a, const pair<int, koopa_raw_value_t> &b){
+            return a.first != b.first ? a.first < b.first : strcmp(a.second->name, b.second->name) < 0;
+        });
+        for(int i = 0; i < (int)candidates.size() && i < 11; i++){
+            string reg = "s" + to_string(i + 1);
+            globalReg[candidates[i].second] = reg;
+            savedRegs.push_back(reg);
+            cachedGlobals.push_back(candidates[i].second);
+        }
+    }
+
+    // 计算栈帧：自底向上依次是超出 8 个的调用参数、alloc 和没有分到寄存器的值、保存的 s 寄存器、ra
+    int offset = outgoing;
+    for(size_t i = 0; i < func->bbs.len; i++){
+        auto bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+        for(size_t j = 0; j < bb->insts.len; j++){
+            auto inst = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[j]);
+            if(valueHome.count(inst)){
+                continue;
+            }
+            if(inst->kind.tag == KOOPA_RVT_ALLOC){
+                stackOffset[inst] = offset;
+                offset += typeSize(inst->ty->data.pointer.base);
+            }else if(inst->ty->tag != KOOPA_RTT_UNIT){
+                stackOffset[inst] = offset;
+                offset += 4;
+            }
+        }
+    }
+    if(hasCall || !savedRegs.empty()){
+        offset += 4; // ra 保存在栈帧顶部，即使不保存也占位，使 s 寄存器的位置固定
+    }
+    offset += 4 * savedRegs.size();
+    frameSize = (offset + 15) / 16 * 16;
+    if(emitStats){
+        FuncStats &st = statsOf(func->name + 1);
+        st.lowered = true;
+        st.frameSize = frameSize;
+        st.spills = 0;
+        for(auto &p : stackOffset){
+            st.spills += p.first->kind.tag != KOOPA_RVT_ALLOC;
+        }
+    }
+
+    emitDirective(".globl", {func->name + 1});
+    emitLabel(func->name + 1);
+    if(frameSize != 0){
+        if(frameSize <= 2048){
+            emit("addi", {"sp", "sp", to_string(-frameSize)});
+        }else{
+            emit("li", {"t0", to_string(-frameSize)});
+            emit("add", {"sp", "sp", "t0"});
+        }
+    }
+    if(hasCall){
+        swSp("ra", frameSize - 4);
+    }
+    for(int i = 0; i < (int)savedRegs.size(); i++){
+        swSp(savedRegs[i], frameSize - 8 - 4 * i);
+    }
+    for(auto g : cachedGlobals){
+        emit("la", {globalReg[g], g->name + 1});
+    }
+    // 按布局顺序访问所有基本块
+    auto layout = blockLayout(func);
+    for(size_t i = 0; i < layout.size(); i++){
+        nextBlock = i + 1 < layout.size() ? layout[i + 1] : nullptr;
+        Visit(layout[i]);
+    }
+    emitDirective("");
 }
 
 // 访问基本块
 void Visit(const koopa_raw_basic_block_t &bb) {
-    // 执行一些其他的必要操作
-    // ...
-    // 访问所有指令
-    Visit(bb->insts);
+    // 入口块不会被跳转到，不需要标号
+    if(string(bb->name) != "%entry"){
+        emitLabel(bbLabel(bb));
+    }
+    // 访问所有指令，尾调用连同后面的 ret 一起处理
+    for(size_t i = 0; i < bb->insts.len; i++){
+        auto inst = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[i]);
+        auto next = i + 1 < bb->insts.len ? reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[i + 1]) : nullptr;
+        if(batchIO && outputKind(inst) != 0){
+            i = dumpBatchedOutput(bb, i) - 1;
+            continue;
+        }
+        if(isTailCall(inst, next)){
+            dumpTailCall(inst);
+            break;
+        }
+        if(isFusedCompare(inst, next)){
+            dumpCompareBranch(inst, next);
+            break;
+        }
+        Visit(inst);
+    }
 }
 
 // 访问指令
 void Visit(const koopa_raw_value_t &value) {
     // 根据指令类型判断后续需要如何访问
     const auto &kind = value->kind;
-    // temp for return 0
-    int32_t int_val = kind.data.integer.value;
-    cout<<"   li "<<"a0 , "<< int_val <<endl;
-    cout<<"   ret"<<endl;
-    return;
-
-    /*
-    要再看koopa了解结构 费劲
     switch (kind.tag) {
-        case KOOPA_RVT_RETURN:
-            // 访问 return 指令
-            Visit(kind.data.ret);
+        case KOOPA_RVT_ALLOC:
+            // 栈帧中已经分配好了
             break;
-        case KOOPA_RVT_INTEGER:
-            // 访问 integer 指令
-            Visit(kind.data.integer);
+        case KOOPA_RVT_LOAD:{
+            auto src = kind.data.load.src;
+            if(src->kind.tag == KOOPA_RVT_ALLOC && valueHome.count(src)){
+                // 提升到寄存器的变量
+                saveResult(value, valueHome[src]);
+                break;
+            }
+            string rd = resultReg(value, "t0");
+            if(src->kind.tag == KOOPA_RVT_ALLOC){
+                lwSp(rd, stackOffset[src]);
+            }else{
+                string reg = addressReg(src, "t0");
+                emit("lw", {rd, "0(" + reg + ")"});
+            }
+            saveResult(value, rd);
+            break;
+        }
+        case KOOPA_RVT_STORE:{
+            auto src = kind.data.store.value;
+            auto dest = kind.data.store.dest;
+            if(src->kind.tag == KOOPA_RVT_ZERO_INIT){
+                // store zeroinit：整个对象清零
+                assert(dest->kind.tag == KOOPA_RVT_ALLOC);
+                clearStack(stackOffset[dest], typeSize(dest->ty->data.pointer.base));
+                break;
+            }
+            string reg = valueReg(src, "t0");
+            if(dest->kind.tag == KOOPA_RVT_ALLOC && valueHome.count(dest)){
+                mv(valueHome[dest], reg);
+            }else if(dest->kind.tag == KOOPA_RVT_ALLOC){
+                swSp(reg, stackOffset[dest]);
+            }else{
+                string base = addressReg(dest, "t1");
+                emit("sw", {reg, "0(" + base + ")"});
+            }
+            break;
+        }
+        case KOOPA_RVT_GET_ELEM_PTR:
+        case KOOPA_RVT_GET_PTR:{
+            // 结果 = 基址 + 下标 * 元素大小
+            bool isElem = kind.tag == KOOPA_RVT_GET_ELEM_PTR;
+            auto src = isElem ? kind.data.get_elem_ptr.src : kind.data.get_ptr.src;
+            auto index = isElem ? kind.data.get_elem_ptr.index : kind.data.get_ptr.index;
+            int size = typeSize(value->ty->data.pointer.base);
+            string base = addressReg(src, "t0");
+            string rd = resultReg(value, "t0");
+            if(index->kind.tag == KOOPA_RVT_INTEGER){
+                int off = index->kind.data.integer.value * size;
+                if(off == 0){
+                    mv(rd, base);
+                }else if(off >= -2048 && off < 2048){
+                    emit("addi", {rd, base, to_string(off)});
+                }else{
+                    emit("li", {"t1", to_string(off)});
+                    emit("add", {rd, base, "t1"});
+                }
+            }else{
+                string idx = valueReg(index, "t1");
+                if((size & (size - 1)) == 0){
+                    int shift = 0;
+                    while((1 << shift) < size){
+                        shift++;
+                    }
+                    emit("slli", {"t1", idx, to_string(shift)});
+                }else{
+                    emit("li", {"t2", to_string(size)});
+                    emit("mul", {"t1", idx, "t2"});
+                }
+                emit("add", {rd, base, "t1"});
+            }
+            saveResult(value, rd);
+            break;
+        }
+        case KOOPA_RVT_BINARY:{
+            if(dumpBinaryImm(value)){
+                break;
+            }
+            string l = valueReg(kind.data.binary.lhs, "t0");
+            string r = valueReg(kind.data.binary.rhs, "t1");
+            string rd = resultReg(value, "t0");
+            vector<string> ops = {rd, l, r};
+            switch(kind.data.binary.op){
+                case KOOPA_RBO_NOT_EQ:
+                    emit("xor", ops);
+                    emit("snez", {rd, rd});
+                    break;
+                case KOOPA_RBO_EQ:
+                    emit("xor", ops);
+                    emit("seqz", {rd, rd});
+                    break;
+                case KOOPA_RBO_GT:
+                    emit("sgt", ops);
+                    break;
+                case KOOPA_RBO_LT:
+                    emit("slt", ops);
+                    break;
+                case KOOPA_RBO_GE:
+                    emit("slt", ops);
+                    emit("seqz", {rd, rd});
+                    break;
+                case KOOPA_RBO_LE:
+                    emit("sgt", ops);
+                    emit("seqz", {rd, rd});
+                    break;
+                case KOOPA_RBO_ADD: emit("add", ops); break;
+                case KOOPA_RBO_SUB: emit("sub", ops); break;
+                case KOOPA_RBO_MUL: emit("mul", ops); break;
+                case KOOPA_RBO_DIV: emit("div", ops); break;
+                case KOOPA_RBO_MOD: emit("rem", ops); break;
+                case KOOPA_RBO_AND: emit("and", ops); break;
+                case KOOPA_RBO_OR:  emit("or", ops); break;
+                case KOOPA_RBO_XOR: emit("xor", ops); break;
+                case KOOPA_RBO_SHL: emit("sll", ops); break;
+                case KOOPA_RBO_SHR: emit("srl", ops); break;
+                case KOOPA_RBO_SAR: emit("sra", ops); break;
+            }
+            saveResult(value, rd);
+            break;
+        }
+        case KOOPA_RVT_BRANCH:{
+            // 后继紧跟在后面时只需要一条条件跳转，落下去的一边不跳
+            string cond = valueReg(kind.data.branch.cond, "t0");
+            if(kind.data.branch.true_bb == nextBlock){
+                emit("beqz", {cond, bbLabel(kind.data.branch.false_bb)});
+            }else{
+                emit("bnez", {cond, bbLabel(kind.data.branch.true_bb)});
+                if(kind.data.branch.false_bb != nextBlock){
+                    emit("j", {bbLabel(kind.data.branch.false_bb)});
+                }
+            }
+            break;
+        }
+        case KOOPA_RVT_JUMP:
+            if(kind.data.jump.target != nextBlock){
+                emit("j", {bbLabel(kind.data.jump.target)});
+            }
+            break;
+        case KOOPA_RVT_CALL:{
+            if(isVecCall(value)){
+                dumpVecKernel(value);
+                break;
+            }
+            // 前 8 个参数放在 a0~a7，其余的依次放在栈底。有调用的函数中值都在栈上，装参数不会互相覆盖
+            auto &args = kind.data.call.args;
+            for(size_t i = 8; i < args.len; i++){
+                swSp(valueReg(reinterpret_cast<koopa_raw_value_t>(args.buffer[i]), "t0"), 4 * (i - 8));
+            }
+            for(size_t i = 0; i < args.len && i < 8; i++){
+                loadValue(reinterpret_cast<koopa_raw_value_t>(args.buffer[i]), "a" + to_string(i));
+            }
+            emit("call", {kind.data.call.callee->name + 1});
+            if(value->ty->tag != KOOPA_RTT_UNIT){
+                saveResult(value, "a0");
+            }
+            break;
+        }
+        case KOOPA_RVT_RETURN:
+            if(kind.data.ret.value != nullptr){
+                loadValue(kind.data.ret.value, "a0");
+            }
+            epilogue();
             break;
         default:
             // 其他类型暂时遇不到
             assert(false);
-    
     }
-    */
 }
-
-// 访问对应类型指令的函数定义略
-// 视需求自行实现
-// ...
-
-
-
-
-
@@ -0,0 +1,262 @@
+#pragma once
+#include <cctype>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ir.hpp"
+
+using namespace std;
+
+// 稀疏条件常量传播（SCCP），-O1 起在优化用的中间表示上进行，-fno-sccp 关闭
+// 每个值在格上是 未定 < 常数 < 不是常数，从入口块出发只沿着可能走到的边访问指令：
+// 条件是常数的 br 只走一边，走不到的块里的 store 不参与合并
+// 只被直接 load/store 的 i32 局部变量当成一个值，等于所有可执行的 store 存入的值的合并；
+// 整个程序都没有写过的 i32 全局变量的值就是它的初值
+// 求解完后把常数代入使用的地方，删掉算出常数的指令和值是常数的变量，br 改成 jump，删掉走不到的块；
+// 剩下的死代码和只有一条 jump 的块留给后面的 dce 和 simplifycfg
+
+
+static bool sccpEnabled = true;
+
+enum SccpState { SCCP_UNDEF, SCCP_CONST, SCCP_OVER };
+struct SccpValue{
+    SccpState state = SCCP_UNDEF;
+    int32_t c = 0;
+};
+
+static SccpValue sccpConst(int32_t c){
+    SccpValue v;
+    v.state = SCCP_CONST;
+    v.c = c;
+    return v;
+}
+static SccpValue sccpOver(){
+    SccpValue v;
+    v.state = SCCP_OVER;
+    return v;
+}
+static SccpValue sccpMeet(SccpValue a, SccpValue b){
+    if(a.state == SCCP_UNDEF){
+        return b;
+    }
+    if(b.state == SCCP_UNDEF){
+        return a;
+    }
+    if(a.state == SCCP_CONST && b.state == SCCP_CONST && a.c == b.c){
+        return a;
+    }
+    return sccpOver();
+}
+static bool operator!=(const SccpValue &a, const SccpValue &b){
+    return a.state != b.state || (a.state == SCCP_CONST && a.c != b.c);
+}
+
+
+// 按 32 位整数计算，除以 0 和溢出的除法留到运行时
+static SccpValue sccpBinary(IrOp op, SccpValue a, SccpValue b){
+    // 乘 0、与 0 的结果总是 0，另一边是什么都可以
+    if((op == IR_MUL || op == IR_AND) && ((a.state == SCCP_CONST && a.c == 0) || (b.state == SCCP_CONST && b.c == 0))){
+        return sccpConst(0);
+    }
+    if(a.state == SCCP_OVER || b.state == SCCP_OVER){
+        return sccpOver();
+    }
+    if(a.state == SCCP_UNDEF || b.state == SCCP_UNDEF){
+        return SccpValue();
+    }
+    int32_t x = a.c, y = b.c;
+    uint32_t ux = x, uy = y;
+    switch(op){
+        case IR_NE: return sccpConst(x != y);
+        case IR_EQ: return sccpConst(x == y);
+        case IR_GT: return sccpConst(x > y);
+        case IR_LT: return sccpConst(x < y);
+        case IR_GE: return sccpConst(x >= y);
+        case IR_LE: return sccpConst(x <= y);
+        case IR_ADD: return sccpConst((int32_t)(ux + uy));
+        case IR_SUB: return sccpConst((int32_t)(ux - uy));
+        case IR_MUL: return sccpConst((int32_t)(ux * uy));
+        case IR_AND: return sccpConst(x & y);
+        case IR_OR: return sccpConst(x | y);
+        case IR_XOR: return sccpConst(x ^ y);
+        case IR_SHL: return sccpConst((int32_t)(ux << (uy & 31)));
+        case IR_SHR: return sccpConst((int32_t)(ux >> (uy & 31)));
+        case IR_SAR: return sccpConst(x >> (uy & 31));
+        default: break; // div、mod
+    }
+    if(y == 0 || (x == INT32_MIN && y == -1)){
+        return sccpOver();
+    }
+    return sccpConst(op == IR_DIV ? x / y : x % y);
+}
+
+
+
+struct SccpSolver{
+    IrFunc &f;
+    const IrCfg &cfg;
+    const IrDefUse &du;
+    vector<int> instBlock;
+    vector<bool> executable, forceOver; // forceOver：条件最后仍是未定的 br，当作两边都可能走
+    vector<SccpValue> value;            // 按编号：临时变量的值，可以当成值的局部变量存入的值的合并
+    vector<bool> isConst;               // 按编号：整个程序中没有写过的 i32 全局变量
+    vector<int32_t> constInit;
+    vector<int> work;
+
+    SccpSolver(IrFunc &f, const IrCfg &cfg, const IrDefUse &du): f(f), cfg(cfg), du(du){}
+};
+
+
+static SccpValue sccpOperand(SccpSolver &s, int a){
+    if(s.f.isLiteral(a)){
+        return sccpConst(s.f.literal(a));
+    }
+    return s.du.def[a] >= 0 ? s.value[a] : sccpOver(); // 参数、全局变量的地址等不是常数
+}
+
+static void sccpMarkBlock(SccpSolver &s, int label){
+    int b = s.cfg.blockOf[label];
+    if(!s.executable[b]){
+        s.executable[b] = true;
+        const vector<int> &insts = s.f.blocks[b].insts;
+        for(int i = insts.size() - 1; i >= 0; i--){ // 倒着压栈，按顺序访问
+            s.work.push_back(insts[i]);
+        }
+    }
+}
+
+// 值变了，把用到它的指令放进工作表；局部变量只有 load 需要重新访问
+static void sccpUpdate(SccpSolver &s, int v, SccpValue m){
+    if(m != s.value[v]){
+        s.value[v] = m;
+        s.work.insert(s.work.end(), s.du.users[v].begin(), s.du.users[v].end());
+    }
+}
+
+static void sccpVisit(SccpSolver &s, int i){
+    IrInst &inst = s.f.insts[i];
+    if(!s.executable[s.instBlock[i]]){
+        return;
+    }
+    if(inst.op == IR_BR){
+        SccpValue c = s.forceOver[i] ? sccpOver() : sccpOperand(s, inst.args[0]);
+        if(c.state == SCCP_CONST){
+            sccpMarkBlock(s, inst.args[c.c != 0 ? 1 : 2]);
+        }else if(c.state == SCCP_OVER){
+            sccpMarkBlock(s, inst.args[1]);
+            sccpMarkBlock(s, inst.args[2]);
+        }
+    }else if(inst.op == IR_JUMP){
+        sccpMarkBlock(s, inst.args[0]);
+    }else if(inst.op == IR_STORE){
+        int var = inst.args[1];
+        if(s.du.scalar[var]){
+            sccpUpdate(s, var, sccpMeet(s.value[var], sccpOperand(s, inst.args[0])));
+        }
+    }else if(s.f.isTemp(inst.dest)){
+        SccpValue v = sccpOver();
+        if(inst.op == IR_LOAD){
+            int var = inst.args[0];
+            if(s.du.scalar[var]){
+                v = s.value[var];
+            }else if(s.isConst[var]){
+                v = sccpConst(s.constInit[var]);
+            }
+        }else if(irIsBinary(inst.op)){
+            v = sccpBinary(inst.op, sccpOperand(s, inst.args[0]), sccpOperand(s, inst.args[1]));
+        }
+        sccpUpdate(s, inst.dest, sccpMeet(s.value[inst.dest], v));
+    }
+}
+
+
+static void sccpIndex(SccpSolver &s, const unordered_map<string, int32_t> &globalConsts){
+    IrFunc &f = s.f;
+    s.instBlock.assign(f.insts.size(), -1);
+    s.executable.assign(f.blocks.size(), false);
+    s.forceOver.assign(f.insts.size(), false);
+    s.value.assign(f.names.size(), SccpValue());
+    s.isConst.assign(f.names.size(), false);
+    s.constInit.assign(f.names.size(), 0);
+    for(int b = 0; b < (int)f.blocks.size(); b++){
+        for(int i : f.blocks[b].insts){
+            s.instBlock[i] = b;
+        }
+    }
+    for(int v = 0; v < (int)f.names.size(); v++){
+        auto it = globalConsts.find(f.names[v]);
+        if(it != globalConsts.end()){
+            s.isConst[v] = true;
+            s.constInit[v] = it->second;
+        }
+    }
+}
+
+static void sccpSolve(SccpSolver &s){
+    sccpMarkBlock(s, s.f.blocks[0].label);
+    while(true){
+        while(!s.work.empty()){
+            int i = s.work.back();
+            s.work.pop_back();
+            sccpVisit(s, i);
+        }
+        // 条件一直是未定的 br（比如依赖没有初始化的变量）两边都要走
+        for(int b = 0; b < (int)s.f.blocks.size(); b++){
+            int i = s.f.blocks[b].insts.back();
+            IrInst &inst = s.f.insts[i];
+            if(inst.op == IR_BR && !s.forceOver[i] && s.executable[b] && sccpOperand(s, inst.args[0]).state == SCCP_UNDEF){
+                s.forceOver[i] = true;
+                s.work.push_back(i);
+            }
+        }
+        if(s.work.empty()){
+            break;
+        }
+    }
+}
+
+// 代入常数，删掉常数的定义和走不到的块
+static void sccpRewrite(SccpSolver &s){
+    IrFunc &f = s.f;
+    auto isConstVar = [&](int v){
+        return s.du.scalar[v] && s.value[v].state == SCCP_CONST;
+    };
+    vector<IrBlock> blocks;
+    for(int b = 0; b < (int)f.blocks.size(); b++){
+        if(!s.executable[b]){
+            for(int i : f.blocks[b].insts){
+                f.insts[i].removed = true;
+            }
+            continue;
+        }
+        for(int i : f.blocks[b].insts){
+            IrInst &inst = f.insts[i];
+            if((f.isTemp(inst.dest) && s.value[inst.dest].state == SCCP_CONST && inst.op != IR_CALL) ||
+               (inst.op == IR_ALLOC && isConstVar(inst.dest)) || (inst.op == IR_STORE && isConstVar(inst.args[1]))){
+                inst.removed = true;
+                continue;
+            }
+            for(int &a : inst.args){
+                if(f.isTemp(a) && s.value[a].state == SCCP_CONST){
+                    a = f.constant(s.value[a].c);
+                }
+            }
+            if(inst.op == IR_BR && f.isLiteral(inst.args[0])){
+                inst.op = IR_JUMP;
+                inst.args = {inst.args[f.literal(inst.args[0]) != 0 ? 1 : 2]};
+            }
+        }
+        blocks.push_back(move(f.blocks[b]));
+    }
+    f.blocks = move(blocks);
+    irSweep(f);
+}
+
+static unsigned sccpPass(IrModule &m, IrFunc &f, IrAnalyses &am){
+    SccpSolver s(f, am.cfg(), am.defUse());
+    sccpIndex(s, m.constGlobals);
+    sccpSolve(s);
+    sccpRewrite(s);
+    return 0;
+}
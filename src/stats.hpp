@@ -0,0 +1,118 @@
+#pragma once
+#include <cassert>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+#include "koopa.h"
+
+using namespace std;
+
+// -emit-stats=文件：按函数统计生成代码的质量，输出 JSON，方便在不同版本的编译器之间比较
+// koopa 部分是块数、临时变量数和各类指令的条数，块数和临时变量数由前端输出函数时记下
+// riscv 部分是指令条数、放在栈上的值的个数、栈帧大小和静态的周期估计，只有 -riscv / -obj 才有
+
+
+static bool emitStats = false;
+
+struct FuncStats{
+    int blocks = 0;
+    int temps = 0;
+    map<string, int> koopaOps; // koopa 指令名到条数
+    bool lowered = false;      // 是否生成了汇编
+    int asmInsts = 0;
+    int spills = 0;            // 没有分到寄存器、放在栈帧里的值
+    int frameSize = 0;
+    int64_t cycles = 0;        // 每条指令执行一次时，顺序发射的周期数
+};
+static map<string, FuncStats> funcStats;
+static vector<string> funcStatsOrder; // 按函数在源程序中出现的顺序输出
+
+static FuncStats& statsOf(const string &name){
+    if(!funcStats.count(name)){
+        funcStatsOrder.push_back(name);
+    }
+    return funcStats[name];
+}
+
+
+static string koopaOpName(koopa_raw_value_t inst){
+    static const char *binary[] = {
+        "ne", "eq", "gt", "lt", "ge", "le", "add", "sub", "mul", "div", "mod", "and", "or", "xor", "shl", "shr", "sar"
+    };
+    switch(inst->kind.tag){
+        case KOOPA_RVT_ALLOC: return "alloc";
+        case KOOPA_RVT_LOAD: return "load";
+        case KOOPA_RVT_STORE: return "store";
+        case KOOPA_RVT_GET_PTR: return "getptr";
+        case KOOPA_RVT_GET_ELEM_PTR: return "getelemptr";
+        case KOOPA_RVT_BINARY: return binary[inst->kind.data.binary.op];
+        case KOOPA_RVT_BRANCH: return "br";
+        case KOOPA_RVT_JUMP: return "jump";
+        case KOOPA_RVT_CALL: return "call";
+        case KOOPA_RVT_RETURN: return "ret";
+        default: return "other";
+    }
+}
+
+static void statsKoopaFunc(koopa_raw_function_t func){
+    FuncStats &st = statsOf(func->name + 1);
+    st.koopaOps.clear();
+    for(size_t i = 0; i < func->bbs.len; i++){
+        auto bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+        for(size_t j = 0; j < bb->insts.len; j++){
+            st.koopaOps[koopaOpName(reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[j]))]++;
+        }
+    }
+}
+
+// 不生成汇编的模式（-koopa、-run）单独统计一遍 raw program 中的指令
+static void statsKoopaProgram(const koopa_raw_program_t &raw){
+    for(size_t i = 0; i < raw.funcs.len; i++){
+        auto func = reinterpret_cast<koopa_raw_function_t>(raw.funcs.buffer[i]);
+        if(func->bbs.len != 0){
+            statsKoopaFunc(func);
+        }
+    }
+}
+
+
+static void writeStats(const string &path){
+    ofstream out(path);
+    out << "{" << endl;
+    out << "  \"functions\": [";
+    for(int i = 0; i < (int)funcStatsOrder.size(); i++){
+        const string &name = funcStatsOrder[i];
+        const FuncStats &st = funcStats[name];
+        auto count = [&](const char *op){
+            auto it = st.koopaOps.find(op);
+            return it == st.koopaOps.end() ? 0 : it->second;
+        };
+        int insts = 0;
+        for(auto &p : st.koopaOps){
+            insts += p.second;
+        }
+        out << (i == 0 ? "\n" : ",\n");
+        out << "    {" << endl;
+        out << "      \"name\": \"" << name << "\"," << endl;
+        out << "      \"koopa\": {\"blocks\": " << st.blocks << ", \"temps\": " << st.temps
+            << ", \"insts\": " << insts << ", \"allocs\": " << count("alloc")
+            << ", \"loads\": " << count("load") << ", \"stores\": " << count("store") << "," << endl;
+        out << "        \"opcodes\": {";
+        bool first = true;
+        for(auto &p : st.koopaOps){
+            out << (first ? "" : ", ") << "\"" << p.first << "\": " << p.second;
+            first = false;
+        }
+        out << "}}";
+        if(st.lowered){
+            out << "," << endl;
+            out << "      \"riscv\": {\"insts\": " << st.asmInsts << ", \"spills\": " << st.spills
+                << ", \"frameSize\": " << st.frameSize << ", \"cycles\": " << st.cycles << "}";
+        }
+        out << endl << "    }";
+    }
+    out << (funcStatsOrder.empty() ? "]" : "\n  ]") << endl;
+    out << "}" << endl;
+}
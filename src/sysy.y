@@ -14,10 +14,16 @@
 // 声明 lexer 函数和错误处理函数
 int yylex();
 void yyerror(std::unique_ptr<BaseAST> &ast, const char *s);
+// 见 lexer.hpp，手写的扫描器给出的出错位置
+std::string lexPosition();
+// 见 main.cpp。-fstream 时每归约出一个函数定义或全局声明就交给它处理并释放，返回 false 时照常放进列表
+bool streamTopLevel(BaseAST *item);
 
 using namespace std;
 
-extern stack<unordered_map<string,entry> > symbolTableStack;
+// 语法分析栈从 YYINITDEPTH 开始按需加倍，bison 默认最多 10000 层。放宽到一百万层，
+// 每层十几个字节，栈最多占十几 MB；再深的输入报错，见 yyerror
+#define YYMAXDEPTH 1000000
 
 %}
 
@@ -25,27 +31,26 @@ extern stack<unordered_map<string,entry> > symbolTableStack;
 %parse-param { std::unique_ptr<BaseAST> &ast }
 
 // yylval 的定义, 我们把它定义成了一个联合体 (union)
-// 因为 token 的值有的是字符串指针, 有的是整数
-// 之前我们在 lexer 中用到的 str_val 和 int_val 就是在这里被定义的
-// 至于为什么要用字符串指针而不直接用 string 或者 unique_ptr<string>?
-// 请自行 STFW 在 union 里写一个带析构函数的类会出现什么情况
+// 因为 token 的值有的是标识符的编号, 有的是整数
+// 之前我们在 lexer 中用到的 sym_val 和 int_val 就是在这里被定义的
+// 标识符不直接传字符串指针: 每个标识符 new 一个 string 太慢, 编号在 lexNames 中查名字, 见 ast.hpp
 %union {
-  std::string *str_val;
+  int sym_val;
   int int_val;
   BaseAST *ast_val;
 }
 
 // lexer 返回的所有 token 种类的声明
-// 注意 IDENT 和 INT_CONST 会返回 token 的值, 分别对应 str_val 和 int_val
+// 注意 IDENT 和 INT_CONST 会返回 token 的值, 分别对应 sym_val 和 int_val
 %token INT RETURN AND OR EQUAL NEQUAL GEQUAL LEQUAL CONST IF ELSE WHILE CONTINUE BREAK VOID
-%token <str_val> IDENT
+%token <sym_val> IDENT
 %token <int_val> INT_CONST
 
 // 非终结符的类型定义
-%type <ast_val> FuncDef FuncType Block Stmt Number UnaryOp Exp UnaryExp PrimaryExp AddExp MulExp RelExp EqExp LAndExp LOrExp
+%type <ast_val> FuncDef FuncHead Block Stmt Number UnaryOp Exp UnaryExp PrimaryExp AddExp MulExp RelExp EqExp LAndExp LOrExp
 %type <ast_val> BlockItem Items Decl ConstDecl ConstDef ConstInitial ConstExp ConstDefines Initial VarDecl VarDef VarDefines
 %type <ast_val> IfStmt Matched_stmt Open_stmt FuncDefines
-%type <str_val> LVal
+%type <ast_val> LVal ArrayDims ConstInitials Initials FuncFParams FuncFParam FuncRParams
 
 %%
 
@@ -62,15 +67,34 @@ CompUnit
   }
   ;
 
+// 函数定义和全局变量/常量声明按出现顺序放在同一个列表中
 FuncDefines 
   : FuncDef{
     auto f = new FuncDefinesAST();
-    f->funcdefList.push_back($1);
+    if(!streamTopLevel($1)){
+      f->funcdefList.push_back($1);
+    }
+    $$ = f;
+  }
+  | Decl{
+    auto f = new FuncDefinesAST();
+    if(!streamTopLevel($1)){
+      f->funcdefList.push_back($1);
+    }
     $$ = f;
   }
   | FuncDefines FuncDef{
     auto f = dynamic_cast<FuncDefinesAST*>($1);
-    f->funcdefList.push_back($2);
+    if(!streamTopLevel($2)){
+      f->funcdefList.push_back($2);
+    }
+    $$ = f;
+  }
+  | FuncDefines Decl{
+    auto f = dynamic_cast<FuncDefinesAST*>($1);
+    if(!streamTopLevel($2)){
+      f->funcdefList.push_back($2);
+    }
     $$ = f;
   }
   ;
@@ -86,28 +110,70 @@ FuncDefines
 // 虽然此处你看不出用 unique_ptr 和手动 delete 的区别, 但当我们定义了 AST 之后
 // 这种写法会省下很多内存管理的负担
 FuncDef
-  : FuncType IDENT '(' ')' Block {
-    auto func_ast = new FuncDefAST();
-    //func_ast->func_type = unique_ptr<BaseAST>($1);
-    func_ast->func_type = ($1);
-    func_ast->ident = *unique_ptr<string>($2);
-    func_ast->block = unique_ptr<BaseAST>($5);
+  : FuncHead ')' Block {
+    auto func_ast = dynamic_cast<FuncDefAST*>($1);
+    func_ast->block = unique_ptr<BaseAST>($3);
+    $$ = func_ast;
+  }
+  | FuncHead FuncFParams ')' Block {
+    auto func_ast = dynamic_cast<FuncDefAST*>($1);
+    func_ast->params = unique_ptr<BaseAST>($2);
+    func_ast->block = unique_ptr<BaseAST>($4);
     $$ = func_ast;
   }
   ;
 
-// 同上, 不再解释
-FuncType
-  : INT {
-    //cout << "FuncType" << endl;
-    //cout << symbolTableStack.size() << endl;
-    auto ft = new FuncTypeAST();
-    $$ = ft;
+// 返回值类型和函数名。int 不能先单独归约成 FuncType,
+// 否则和全局变量声明 INT VarDefines 冲突, 需要看到 '(' 才能区分
+FuncHead
+  : INT IDENT '(' {
+    auto func_ast = new FuncDefAST();
+    func_ast->func_type = new FuncTypeAST();
+    func_ast->ident = lexNames[$2];
+    $$ = func_ast;
   }
-  | VOID {
+  | VOID IDENT '(' {
+    auto func_ast = new FuncDefAST();
     auto ft = new FuncTypeAST();
     ft->type = 1;
-    $$ = ft;
+    func_ast->func_type = ft;
+    func_ast->ident = lexNames[$2];
+    $$ = func_ast;
+  }
+  ;
+
+FuncFParams
+  : FuncFParam{
+    auto p = new FuncFParamsAST();
+    p->paramList.push_back($1);
+    $$ = p;
+  }
+  | FuncFParams ',' FuncFParam{
+    auto ptr = dynamic_cast<FuncFParamsAST*>($1);
+    ptr->paramList.push_back($3);
+    $$ = ptr;
+  }
+  ;
+
+// FuncFParam ::= BType IDENT ["[" "]" {"[" ConstExp "]"}];
+FuncFParam
+  : INT IDENT{
+    auto p = new FuncFParamAST();
+    p->id = lexNames[$2];
+    $$ = p;
+  }
+  | INT IDENT '[' ']'{
+    auto p = new FuncFParamAST();
+    p->id = lexNames[$2];
+    p->isArray = true;
+    $$ = p;
+  }
+  | INT IDENT '[' ']' ArrayDims{
+    auto p = new FuncFParamAST();
+    p->id = lexNames[$2];
+    p->isArray = true;
+    p->dimList = dynamic_cast<ArrayDimsAST*>($5)->dimList;
+    $$ = p;
   }
   ;
 
@@ -191,7 +257,7 @@ ConstDefines
 
 ConstDef 
   : IDENT '=' ConstInitial{
-    string name = *($1);
+    string name = lexNames[$1];
     /*int value = dynamic_cast<ConstInitialAST*>($3)->valueSpread();
     struct entry e;
     e.isConst = true;
@@ -209,14 +275,59 @@ ConstDef
     cd->constInitial = unique_ptr<BaseAST>($3);
     $$ = cd;
   }
+  | IDENT ArrayDims '=' ConstInitial{
+    auto cd = new ConstDefAST();
+    cd->id = lexNames[$1];
+    cd->dimList = dynamic_cast<ArrayDimsAST*>($2)->dimList;
+    cd->constInitial = unique_ptr<BaseAST>($4);
+    $$ = cd;
+  }
+  ;
+
+// 数组各维长度, 用于常量/变量数组定义
+ArrayDims
+  : '[' ConstExp ']'{
+    auto ad = new ArrayDimsAST();
+    ad->dimList.push_back($2);
+    $$ = ad;
+  }
+  | ArrayDims '[' ConstExp ']'{
+    auto ptr = dynamic_cast<ArrayDimsAST*>($1);
+    ptr->dimList.push_back($3);
+    $$ = ptr;
+  }
   ;
 
 ConstInitial
   : ConstExp{
     auto ci = new ConstInitialAST();
+    ci->isList = false;
     ci->constExp = unique_ptr<BaseAST>($1);
     $$ = ci;
   }
+  | '{' '}'{
+    auto ci = new ConstInitialAST();
+    ci->isList = true;
+    $$ = ci;
+  }
+  | '{' ConstInitials '}'{
+    $$ = $2;
+  }
+  ;
+
+// 初始化列表中的各项, 直接收集到一个 isList 的 ConstInitialAST 中
+ConstInitials
+  : ConstInitial{
+    auto ci = new ConstInitialAST();
+    ci->isList = true;
+    ci->initList.push_back($1);
+    $$ = ci;
+  }
+  | ConstInitials ',' ConstInitial{
+    auto ptr = dynamic_cast<ConstInitialAST*>($1);
+    ptr->initList.push_back($3);
+    $$ = ptr;
+  }
   ;
 
 ConstExp 
@@ -252,28 +363,75 @@ VarDef
   : IDENT{
     auto s = new VarDefAST();
     s->isInitial = false;
-    s->id = *($1);
+    s->id = lexNames[$1];
     $$ = s;
   }
   | IDENT '=' Initial{
     auto s = new VarDefAST();
     s->isInitial = true;
-    s->id = *($1);
+    s->id = lexNames[$1];
     s->initial = unique_ptr<BaseAST>($3);
     $$ = s;
   }
+  | IDENT ArrayDims{
+    auto s = new VarDefAST();
+    s->isInitial = false;
+    s->id = lexNames[$1];
+    s->dimList = dynamic_cast<ArrayDimsAST*>($2)->dimList;
+    $$ = s;
+  }
+  | IDENT ArrayDims '=' Initial{
+    auto s = new VarDefAST();
+    s->isInitial = true;
+    s->id = lexNames[$1];
+    s->dimList = dynamic_cast<ArrayDimsAST*>($2)->dimList;
+    s->initial = unique_ptr<BaseAST>($4);
+    $$ = s;
+  }
   ;
 
 Initial
   : Exp{
     auto s = new InitialAST();
+    s->isList = false;
     s->exp = unique_ptr<BaseAST>($1);
     $$ = s;
   }
+  | '{' '}'{
+    auto s = new InitialAST();
+    s->isList = true;
+    $$ = s;
+  }
+  | '{' Initials '}'{
+    $$ = $2;
+  }
+  ;
+
+Initials
+  : Initial{
+    auto s = new InitialAST();
+    s->isList = true;
+    s->initList.push_back($1);
+    $$ = s;
+  }
+  | Initials ',' Initial{
+    auto ptr = dynamic_cast<InitialAST*>($1);
+    ptr->initList.push_back($3);
+    $$ = ptr;
+  }
+  ;
 
+// LVal ::= IDENT {"[" Exp "]"};
 LVal
   : IDENT{
-    $$ = $1;
+    auto l = new LValAST();
+    l->id = lexNames[$1];
+    $$ = l;
+  }
+  | LVal '[' Exp ']'{
+    auto ptr = dynamic_cast<LValAST*>($1);
+    ptr->indexList.push_back($3);
+    $$ = ptr;
   }
   ;
 
@@ -289,7 +447,8 @@ Stmt
     auto s = new StmtAST();
     s->isReturn = false;
     s->condition = 0;
-    s->id = *($1);
+    s->id = dynamic_cast<LValAST*>($1)->id;
+    s->lval = unique_ptr<BaseAST>($1);
     s->exp = unique_ptr<BaseAST>($3);
     $$ = s;
   }
@@ -486,9 +645,28 @@ UnaryExp
   }
   | IDENT '(' ')'{
     auto s = new UnaryExpAST();
-    s->callName = *($1);
+    s->callName = lexNames[$1];
     $$ = s;
   }
+  | IDENT '(' FuncRParams ')'{
+    auto s = new UnaryExpAST();
+    s->callName = lexNames[$1];
+    s->argList = dynamic_cast<FuncRParamsAST*>($3)->expList;
+    $$ = s;
+  }
+  ;
+
+FuncRParams
+  : Exp{
+    auto p = new FuncRParamsAST();
+    p->expList.push_back($1);
+    $$ = p;
+  }
+  | FuncRParams ',' Exp{
+    auto ptr = dynamic_cast<FuncRParamsAST*>($1);
+    ptr->expList.push_back($3);
+    $$ = ptr;
+  }
   ;
 
 PrimaryExp
@@ -510,7 +688,8 @@ PrimaryExp
   | LVal{
     //cout << "primary - LVal" << endl;
     auto s = new PrimaryExpAST();
-    string name = *($1);
+    string name = dynamic_cast<LValAST*>($1)->id;
+    s->lval = unique_ptr<BaseAST>($1);
     /*entry e;
 
     //e = searchSymbolTable(name);
@@ -633,5 +812,10 @@ Open_stmt
 // 定义错误处理函数, 其中第二个参数是错误信息
 // parser 如果发生错误 (例如输入的程序出现了语法错误), 就会调用这个函数
 void yyerror(unique_ptr<BaseAST> &ast, const char *s) {
-  cerr << "error: " << s << endl;
+  // 语法分析栈超过 YYMAXDEPTH 时 bison 给出的是 memory exhausted，说清楚是嵌套太深
+  if(string(s) == "memory exhausted"){
+    cerr << "error: nesting too deep (more than " << YYMAXDEPTH << " levels)" << lexPosition() << endl;
+    return;
+  }
+  cerr << "error: " << s << lexPosition() << endl;
 }
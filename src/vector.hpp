@@ -0,0 +1,59 @@
+#pragma once
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// 向量化（-march=rv32imv，只用于 -riscv / -obj）
+// 前端识别 while(i < N){ a[i] = 表达式; ...; i = i + 1; } 这样的循环，表达式里只有下标为 i 的一维数组元素、
+// 循环中不变的标量和常数。循环前插入一次 koopa 调用 %r = call @__vec_K(数组首地址..., 标量..., i, N)，
+// 把 %r 存回 i，原来的循环照常输出，作为标量的收尾
+// 后端遇到 @__vec_K 时不生成调用，而是按 vecKernels[K] 就地展开成 RVV 的分段循环：
+// 每段用 vsetvli 取得这一段的元素个数，vle32.v 读入、按后缀式计算、vse32.v 写回；返回处理到的下标
+// 数组可能重叠时（有数组参数）先在运行时检查，重叠就直接返回 i，全部交给后面的标量循环
+// 这个头文件也被 parser 包含，表用 inline 变量，保证前端和后端看到同一份
+
+
+inline bool vectorizeLoops = false;
+
+// 后缀式中的一项
+enum VecNodeKind { VEC_LOAD, VEC_SPLAT, VEC_OP };
+struct VecNode{
+    VecNodeKind kind = VEC_OP;
+    int arg = 0;    // VEC_LOAD：数组是第几个参数；VEC_SPLAT：标量是第几个参数
+    string op = ""; // VEC_OP："+"、"-"、"*"、"/"、"%"、"<"、">"、"<="、">="、"=="、"!="，一元的 "neg"、"!"
+};
+
+// 一条 a[i] = 表达式
+struct VecStore{
+    int array = 0;
+    vector<VecNode> expr;
+};
+
+struct VecKernel{
+    int arrays = 0;   // 前 arrays 个参数是数组首地址（*i32）
+    int scalars = 0;  // 之后是标量，最后两个参数是 i 和 N
+    vector<VecStore> stores;
+    vector<pair<int, int> > aliasChecks; // 运行时要检查是否重叠的两个数组
+};
+
+inline vector<VecKernel> vecKernels;
+
+inline string vecKernelName(int k){
+    return "__vec_" + to_string(k);
+}
+
+// 第 from 个以后的向量循环的 koopa 声明
+inline string vecDecls(int from){
+    string decls;
+    for(int k = from; k < (int)vecKernels.size(); k++){
+        decls += "decl @" + vecKernelName(k) + "(";
+        int n = vecKernels[k].arrays + vecKernels[k].scalars + 2;
+        for(int i = 0; i < n; i++){
+            decls += string(i == 0 ? "" : ", ") + (i < vecKernels[k].arrays ? "*i32" : "i32");
+        }
+        decls += "): i32\n";
+    }
+    return decls;
+}
@@ -0,0 +1,42 @@
+#!/usr/bin/env python3
+# 前端速度测试（make bench-frontend）用的大输入：很多个函数，每个有数组、循环、if、调用前面的函数和长的表达式，
+# 注释和空白也有一些，标识符既有反复出现的也有只出现一次的。生成的程序能通过语法分析，不用于执行
+# 用法：tests/bench_input.py 大小（MB） 输出文件
+import sys
+
+
+def function(k):
+    callee = "f%d(a, i)" % (k - 1) if k > 0 else "a[i % 16]"
+    return (
+        "// 第 %d 个函数\n"
+        "int f%d(int a[], int n){\n"
+        "    int sum_%d = 0, i = 0;\n"
+        "    const int lim%d[4] = {%d, 0x%x, 0%o, 4};\n"
+        "    while(i < n && i < lim%d[0]){\n"
+        "        if(a[i] >= %d || !(sum_%d != i)){\n"
+        "            sum_%d = sum_%d + %s * (i - 3) / 7 %% 5;\n"
+        "        }else{\n"
+        "            /* 调整 */ sum_%d = sum_%d - a[(i + 1) %% 16] + lim%d[i %% 4];\n"
+        "        }\n"
+        "        i = i + 1;\n"
+        "    }\n"
+        "    return sum_%d;\n"
+        "}\n"
+    ) % (k, k, k, k, k + 1, k + 2, k + 3, k, k, k, k, k, callee, k, k, k, k)
+
+
+def main():
+    size = float(sys.argv[1]) * 1000000
+    parts, total, k = [], 0, 0
+    while total < size:
+        text = function(k)
+        parts.append(text)
+        total += len(text)
+        k += 1
+    parts.append("int main(){\n    int a[16] = {};\n    return f%d(a, 16);\n}\n" % (k - 1))
+    with open(sys.argv[2], "w") as f:
+        f.write("".join(parts))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,56 @@
+#!/bin/bash
+# 手写的扫描器（-fhand-lexer）、在另一个线程上运行的手写扫描器（-fthread-lexer）和 flex 生成的扫描器，
+# -dump-tokens 输出的 token 序列应该完全相同
+# 输入是 tests/ 下所有的 .sy，以及这里生成的边界情况：超过环形缓冲区的 token 数、注释里的 '\0'、文件末尾没有换行的 // 注释、
+# 很长的块注释（超过 SIMD 一次比较的宽度和 flex 的缓冲区）、没有结束的块注释、代码中的 '\0'、各种整数和运算符
+# 用法：tests/lex.sh [编译器]，默认 build/compiler
+cd "$(dirname "$0")/.."
+COMPILER=${1:-build/compiler}
+TMP=$(mktemp -d)
+trap 'rm -rf $TMP' EXIT
+
+mkdir $TMP/in
+printf 'int a = 1; // x\0y\nint b = 2;\n' > $TMP/in/nul_line_comment.sy
+printf 'int a; // no newline' > $TMP/in/line_comment_at_eof.sy
+printf 'int a;//' > $TMP/in/empty_line_comment_at_eof.sy
+printf 'int a; /* x */' > $TMP/in/block_comment_at_eof.sy
+printf 'int a; /* never closed\nint b;\n' > $TMP/in/unterminated_comment.sy
+printf 'int a; /* \0 */ int b;\0 int c;\n' > $TMP/in/nul_in_code.sy
+printf 'a 0 07 09 0x1F 0X 0xg 00x1 4294967296 2147483648 <= >= == != || && | & ! < > = ;()\n{}[],+-*/%% a_1 _b9 ifx if1 while\n' > $TMP/in/numbers_operators.sy
+python3 - $TMP/in <<'EOF'
+import sys
+d = sys.argv[1]
+# 几十万个字节的块注释，里面有 *、/、换行和 '\0'，但没有 */
+with open(d + "/long_block_comment.sy", "wb") as f:
+    f.write(b"int a; /*" + b"** / *\n\0x" * 40000 + b"***/ int b;\n")
+# 注释结尾落在 16、32 字节边界前后
+with open(d + "/comment_lengths.sy", "wb") as f:
+    for n in range(70):
+        f.write(b"/*" + b"*" * n + b"/ x%d\n" % n)
+        f.write(b"// " + b"c" * n + b"\ny%d\n" % n)
+# 比 -fthread-lexer 的环形缓冲区（2^18 个 token）多，标识符有重复出现的也有新的
+with open(d + "/ring_wrap.sy", "wb") as f:
+    for n in range(60000):
+        f.write(b"v%d = w%d + %d;\n" % (n % 1000, n, n))
+EOF
+
+pass=0
+fail=0
+for sy in tests/*/*.sy $TMP/in/*.sy; do
+    name=${sy#$TMP/in/}
+    if ! $COMPILER -dump-tokens $sy -o $TMP/flex.txt || ! $COMPILER -dump-tokens $sy -o $TMP/hand.txt -fhand-lexer ||
+       ! $COMPILER -dump-tokens $sy -o $TMP/thread.txt -fthread-lexer; then
+        echo "FAIL $name: 扫描失败"
+        fail=$((fail + 1))
+    elif ! cmp -s $TMP/flex.txt $TMP/hand.txt; then
+        echo "FAIL $name: -fhand-lexer 的 token 序列和 flex 不同"
+        fail=$((fail + 1))
+    elif ! cmp -s $TMP/flex.txt $TMP/thread.txt; then
+        echo "FAIL $name: -fthread-lexer 的 token 序列和 flex 不同"
+        fail=$((fail + 1))
+    else
+        pass=$((pass + 1))
+    fi
+done
+echo "lex: pass=$pass fail=$fail"
+[ $fail -eq 0 ]
@@ -0,0 +1,42 @@
+#!/bin/bash
+# -obj 的输出应该和 llvm-mc 汇编 -riscv 的输出（不开启链接器松弛）逐字节相同
+# 用法：tests/obj.sh [编译器]，默认 build/compiler；需要 llvm-mc
+# far.sy 的循环体超过 4KB，覆盖条件分支够不到目标时的改写；tests/vector/ 中的程序加上 -march=rv32imv
+cd "$(dirname "$0")/.."
+COMPILER=${1:-build/compiler}
+TMP=$(mktemp -d)
+trap 'rm -rf $TMP' EXIT
+
+pass=0
+fail=0
+check(){
+    local sy=$1 opt=$2 march=$3 mattr=$4
+    local name="$sy $opt $march"
+    if ! $COMPILER -riscv $sy -o $TMP/a.s $opt $march || ! $COMPILER -obj $sy -o $TMP/b.o $opt $march; then
+        echo "FAIL $name: 编译失败"
+        fail=$((fail + 1))
+        return
+    fi
+    if ! llvm-mc -triple=riscv32 -mattr=$mattr -filetype=obj $TMP/a.s -o $TMP/a.o; then
+        echo "FAIL $name: llvm-mc 汇编失败"
+        fail=$((fail + 1))
+        return
+    fi
+    if cmp -s $TMP/a.o $TMP/b.o; then
+        pass=$((pass + 1))
+    else
+        echo "FAIL $name: 目标文件不同"
+        fail=$((fail + 1))
+    fi
+}
+
+for opt in -O0 -O1 -O2; do
+    for sy in tests/obj/*.sy; do
+        check $sy $opt "" +m,-relax
+    done
+    for sy in tests/vector/*.sy; do
+        check $sy $opt -march=rv32imv +m,+v,-relax
+    done
+done
+echo "obj: pass=$pass fail=$fail"
+[ $fail -eq 0 ]
@@ -0,0 +1,63 @@
+#!/bin/bash
+# 优化的效果：tests/opt/ 中的每个程序按文件开头 // FLAGS: 给的选项编译（没有时用默认的 -O1），
+# 检查 -koopa 的输出中 // CHECK: 的模式都出现，// CHECK-NOT: 的模式都不出现；
+# // ASM: 和 // ASM-NOT: 对 -riscv 的输出做同样的检查。
+# 同样的选项下 -run 和汇编在 tests/rvsim.py 上执行的结果都应该和 .out 相同，.out 的格式见 tests/run.sh
+# 用法：tests/opt.sh [编译器]，默认 build/compiler
+cd "$(dirname "$0")/.."
+COMPILER=${1:-build/compiler}
+TMP=$(mktemp -d)
+trap 'rm -rf $TMP' EXIT
+
+result(){
+    local out=$1 code=$2
+    cat $out
+    if [ -s $out ] && [ "$(tail -c 1 $out)" != "" ]; then
+        echo
+    fi
+    echo $code
+}
+
+pass=0
+fail=0
+for sy in tests/opt/*.sy; do
+    in=/dev/null
+    if [ -f ${sy%.sy}.in ]; then
+        in=${sy%.sy}.in
+    fi
+    flags=$(sed -n 's|^// FLAGS: *||p' $sy)
+    ok=1
+    if ! $COMPILER -koopa $sy -o $TMP/a.koopa $flags || ! $COMPILER -riscv $sy -o $TMP/a.s $flags; then
+        echo "FAIL $sy: 编译失败"
+        fail=$((fail + 1))
+        continue
+    fi
+    while read -r kind pattern; do
+        case $kind in
+            CHECK:|CHECK-NOT:) file=$TMP/a.koopa ;;
+            *) file=$TMP/a.s ;;
+        esac
+        if [[ $kind != *-NOT: ]] && ! grep -qF -- "$pattern" $file; then
+            echo "FAIL $sy: 没有 $pattern"
+            ok=0
+        elif [[ $kind == *-NOT: ]] && grep -qF -- "$pattern" $file; then
+            echo "FAIL $sy: 不应有 $pattern"
+            ok=0
+        fi
+    done < <(sed -n -E 's#^// ((CHECK|ASM)(-NOT)?:) *#\1 #p' $sy)
+    $COMPILER -run $sy -o $TMP/stats $flags < $in > $TMP/out 2> $TMP/err
+    result $TMP/out $? > $TMP/run.out
+    tests/rvsim.py $TMP/a.s $in > $TMP/out 2> $TMP/err
+    result $TMP/out $? > $TMP/sim.out
+    if ! cmp -s $TMP/run.out ${sy%.sy}.out || ! cmp -s $TMP/sim.out ${sy%.sy}.out; then
+        echo "FAIL $sy: 执行结果不同"
+        ok=0
+    fi
+    if [ $ok -eq 1 ]; then
+        pass=$((pass + 1))
+    else
+        fail=$((fail + 1))
+    fi
+done
+echo "opt: pass=$pass fail=$fail"
+[ $fail -eq 0 ]
@@ -0,0 +1,70 @@
+#!/bin/bash
+# -fprofile-generate 和 -fprofile-use：tests/profile/ 中的程序先用 -run 生成 profile，再用它编译，
+# 检查 -koopa 中 // CHECK: 的模式都出现，// CHECK-NOT: 的模式都不出现；
+# -run 和汇编在 tests/rvsim.py 上执行的结果都应该和 .out 相同，.out 的格式见 tests/run.sh
+# 用法：tests/profile.sh [编译器]，默认 build/compiler
+cd "$(dirname "$0")/.."
+COMPILER=$(realpath ${1:-build/compiler})
+TESTS=$(pwd)/tests
+TMP=$(mktemp -d)
+trap 'rm -rf $TMP' EXIT
+
+result(){
+    local out=$1 code=$2
+    cat $out
+    if [ -s $out ] && [ "$(tail -c 1 $out)" != "" ]; then
+        echo
+    fi
+    echo $code
+}
+
+pass=0
+fail=0
+for sy in $TESTS/profile/*.sy; do
+    name=tests/profile/$(basename $sy)
+    in=/dev/null
+    if [ -f ${sy%.sy}.in ]; then
+        in=${sy%.sy}.in
+    fi
+    ok=1
+    # 程序把 profile 写到当前目录的 sysy.profdata
+    rm -f $TMP/sysy.profdata
+    (cd $TMP && $COMPILER -run $sy -o stats -fprofile-generate < $in > /dev/null)
+    if ! grep -q "^sysy-profile" $TMP/sysy.profdata 2> /dev/null; then
+        echo "FAIL $name: 没有生成 profile"
+        fail=$((fail + 1))
+        continue
+    fi
+    for opt in -O0 -O1 -O2; do
+        use="$opt -fprofile-use=$TMP/sysy.profdata"
+        if ! $COMPILER -koopa $sy -o $TMP/a.koopa $use || ! $COMPILER -riscv $sy -o $TMP/a.s $use; then
+            echo "FAIL $name $opt: 编译失败"
+            ok=0
+            continue
+        fi
+        while read -r kind pattern; do
+            if [ "$kind" == "CHECK:" ] && ! grep -qF -- "$pattern" $TMP/a.koopa; then
+                echo "FAIL $name $opt: 没有 $pattern"
+                ok=0
+            elif [ "$kind" == "CHECK-NOT:" ] && grep -qF -- "$pattern" $TMP/a.koopa; then
+                echo "FAIL $name $opt: 不应有 $pattern"
+                ok=0
+            fi
+        done < <(sed -n 's|^// \(CHECK\(-NOT\)\?:\) *|\1 |p' $sy)
+        $COMPILER -run $sy -o $TMP/stats $use < $in > $TMP/out
+        result $TMP/out $? > $TMP/run.out
+        $TESTS/rvsim.py $TMP/a.s $in > $TMP/out
+        result $TMP/out $? > $TMP/sim.out
+        if ! cmp -s $TMP/run.out ${sy%.sy}.out || ! cmp -s $TMP/sim.out ${sy%.sy}.out; then
+            echo "FAIL $name $opt: 执行结果不同"
+            ok=0
+        fi
+    done
+    if [ $ok -eq 1 ]; then
+        pass=$((pass + 1))
+    else
+        fail=$((fail + 1))
+    fi
+done
+echo "profile: pass=$pass fail=$fail"
+[ $fail -eq 0 ]
@@ -0,0 +1,55 @@
+#!/bin/bash
+# tests/run/ 中的程序：-run 解释执行的结果，和 -riscv 生成的汇编在 tests/rvsim.py 上执行的结果，
+# 都应该和 .out 相同。.out 是程序的输出，不以换行结尾时补一个换行，最后一行是返回值；.in 是程序的输入
+# 后面的选项原样传给编译器，make test 用不同的选项各运行一次，结果都应该和不加选项时一样
+# 用法：tests/run.sh [编译器] [选项...]，默认 build/compiler
+cd "$(dirname "$0")/.."
+COMPILER=${1:-build/compiler}
+shift
+FLAGS="$*"
+TMP=$(mktemp -d)
+trap 'rm -rf $TMP' EXIT
+
+# 把输出和返回值拼成 .out 的格式
+result(){
+    local out=$1 code=$2
+    cat $out
+    if [ -s $out ] && [ "$(tail -c 1 $out)" != "" ]; then
+        echo
+    fi
+    echo $code
+}
+
+pass=0
+fail=0
+for sy in tests/run/*.sy; do
+    in=/dev/null
+    if [ -f ${sy%.sy}.in ]; then
+        in=${sy%.sy}.in
+    fi
+    ok=1
+    $COMPILER -run $sy -o $TMP/stats $FLAGS < $in > $TMP/out 2> $TMP/err
+    result $TMP/out $? > $TMP/run.out
+    if ! cmp -s $TMP/run.out ${sy%.sy}.out; then
+        echo "FAIL $sy${FLAGS:+ $FLAGS}: -run 的结果不同"
+        ok=0
+    fi
+    if ! $COMPILER -riscv $sy -o $TMP/a.s $FLAGS 2> $TMP/err; then
+        echo "FAIL $sy${FLAGS:+ $FLAGS}: 编译失败"
+        ok=0
+    else
+        tests/rvsim.py $TMP/a.s $in > $TMP/out 2> $TMP/err
+        result $TMP/out $? > $TMP/sim.out
+        if ! cmp -s $TMP/sim.out ${sy%.sy}.out; then
+            echo "FAIL $sy${FLAGS:+ $FLAGS}: 汇编执行的结果不同"
+            ok=0
+        fi
+    fi
+    if [ $ok -eq 1 ]; then
+        pass=$((pass + 1))
+    else
+        fail=$((fail + 1))
+    fi
+done
+echo "run${FLAGS:+ $FLAGS}: pass=$pass fail=$fail"
+[ $fail -eq 0 ]
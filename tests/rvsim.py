@@ -0,0 +1,312 @@
+#!/usr/bin/env python3
+# 测试用的 RV32IM 汇编解释器，直接执行 -riscv 输出的汇编文本，另外支持向量化生成的几条 RVV 指令
+# SysY 运行时库的函数（putint、getint、-fbatch-io 的 __sysy_putchars 等）由解释器自己实现
+# 用法：tests/rvsim.py 汇编文件 [输入文件]，程序的输出写到标准输出，退出码是 main 的返回值
+import os
+import re
+import sys
+
+M32 = 0xffffffff
+DATA_BASE = 0x10000000
+STACK_TOP = 0x7ffff000
+STACK_SIZE = 64 << 20
+MAX_STEPS = 10 ** 9
+
+ABI = ["zero", "ra", "sp", "gp", "tp", "t0", "t1", "t2", "s0", "s1"] + ["a%d" % i for i in range(8)] + \
+      ["s%d" % i for i in range(2, 12)] + ["t3", "t4", "t5", "t6"]
+REGS = {name: i for i, name in enumerate(ABI)}
+REGS.update({"x%d" % i: i for i in range(32)})
+REGS["fp"] = 8
+
+
+def s32(x):
+    x &= M32
+    return x - (1 << 32) if x & 0x80000000 else x
+
+
+def div(x, y):
+    if y == 0:
+        return -1
+    q = abs(x) // abs(y)
+    return q if (x < 0) == (y < 0) else -q
+
+
+def rem(x, y):
+    return x if y == 0 else x - div(x, y) * y
+
+
+BINARY = {
+    "add": lambda x, y: x + y, "sub": lambda x, y: x - y, "mul": lambda x, y: x * y,
+    "mulh": lambda x, y: (x * y) >> 32, "div": div, "rem": rem,
+    "and": lambda x, y: x & y, "or": lambda x, y: x | y, "xor": lambda x, y: x ^ y,
+    "slt": lambda x, y: int(x < y), "sgt": lambda x, y: int(x > y),
+    "sltu": lambda x, y: int((x & M32) < (y & M32)),
+    "sll": lambda x, y: x << (y & 31), "srl": lambda x, y: (x & M32) >> (y & 31), "sra": lambda x, y: x >> (y & 31),
+}
+IMMEDIATE = {"addi": "add", "andi": "and", "ori": "or", "xori": "xor", "slti": "slt", "sltiu": "sltu",
+             "slli": "sll", "srli": "srl", "srai": "sra"}
+UNARY = {"seqz": lambda x: int(x == 0), "snez": lambda x: int(x != 0), "neg": lambda x: -x, "not": lambda x: ~x,
+         "sltz": lambda x: int(x < 0), "sgtz": lambda x: int(x > 0)}
+BRANCH = {"beq": lambda x, y: x == y, "bne": lambda x, y: x != y, "blt": lambda x, y: x < y,
+          "bge": lambda x, y: x >= y, "bgt": lambda x, y: x > y, "ble": lambda x, y: x <= y,
+          "bltu": lambda x, y: (x & M32) < (y & M32), "bgeu": lambda x, y: (x & M32) >= (y & M32)}
+BRANCH_ZERO = {"beqz": "beq", "bnez": "bne", "bltz": "blt", "bgez": "bge", "blez": "ble", "bgtz": "bgt"}
+VECTOR = {"vadd": BINARY["add"], "vsub": BINARY["sub"], "vrsub": lambda x, y: y - x, "vmul": BINARY["mul"],
+          "vdiv": div, "vrem": rem, "vand": BINARY["and"], "vor": BINARY["or"], "vxor": BINARY["xor"],
+          "vmseq": BRANCH["beq"], "vmsne": BRANCH["bne"], "vmslt": BRANCH["blt"], "vmsle": BRANCH["ble"],
+          "vmsgt": BRANCH["bgt"]}
+
+
+# 汇编文本分成指令列表和数据段，标号分别记下指令下标和数据偏移
+def parse(src):
+    text, labels, data, data_labels = [], {}, bytearray(), {}
+    in_text = True
+    for raw in src.split("\n"):
+        line = raw.split("#")[0].strip()
+        while True:
+            m = re.match(r"^([A-Za-z_.$][\w.$]*):\s*(.*)$", line)
+            if not m:
+                break
+            if in_text:
+                labels[m.group(1)] = len(text)
+            else:
+                data_labels[m.group(1)] = len(data)
+            line = m.group(2).strip()
+        if not line:
+            continue
+        parts = line.split(None, 1)
+        op, rest = parts[0], parts[1] if len(parts) > 1 else ""
+        if op.startswith("."):
+            if op == ".text" or (op == ".section" and ".text" in rest):
+                in_text = True
+            elif op in (".data", ".bss", ".rodata", ".section"):
+                in_text = False
+            elif op == ".word":
+                for w in rest.split(","):
+                    data += (int(w, 0) & M32).to_bytes(4, "little")
+            elif op in (".zero", ".space"):
+                data += bytes(int(rest.split(",")[0], 0))
+            elif op in (".align", ".p2align", ".balign"):
+                n = int(rest.split(",")[0], 0)
+                n = n if op == ".balign" else 1 << n
+                while len(data) % n:
+                    data.append(0)
+            continue
+        text.append((op, [a.strip() for a in rest.split(",")] if rest.strip() else [], raw.strip()))
+    return text, labels, data, data_labels
+
+
+class Sim:
+    def __init__(self, src, inp=""):
+        self.text, self.labels, data, data_labels = parse(src)
+        self.data = bytearray(data) + bytearray(64)
+        self.data_labels = {k: DATA_BASE + v for k, v in data_labels.items()}
+        self.stack = bytearray(STACK_SIZE)
+        self.r = [0] * 32
+        self.r[REGS["sp"]] = STACK_TOP
+        self.out = []
+        self.inp, self.ip = inp, 0
+        self.vl = 0
+        self.vlmax = int(os.environ.get("VLMAX", "4"))
+        self.v = [[0] * 64 for _ in range(32)]
+
+    def mem(self, a):
+        if DATA_BASE <= a < DATA_BASE + len(self.data):
+            return self.data, a - DATA_BASE
+        if STACK_TOP - STACK_SIZE <= a < STACK_TOP:
+            return self.stack, a - (STACK_TOP - STACK_SIZE)
+        raise RuntimeError("bad address %x" % a)
+
+    def lw(self, a):
+        if a % 4:
+            raise RuntimeError("unaligned lw %x" % a)
+        b, o = self.mem(a)
+        return s32(int.from_bytes(b[o:o + 4], "little"))
+
+    def sw(self, a, v):
+        if a % 4:
+            raise RuntimeError("unaligned sw %x" % a)
+        b, o = self.mem(a)
+        b[o:o + 4] = (v & M32).to_bytes(4, "little")
+
+    def reg(self, name):
+        return s32(self.r[REGS[name]])
+
+    def set(self, name, v):
+        if REGS[name]:
+            self.r[REGS[name]] = v & M32
+
+    def addr(self, operand):
+        m = re.match(r"^(-?\w*)\((\w+)\)$", operand)
+        return (self.reg(m.group(2)) + (int(m.group(1), 0) if m.group(1) else 0)) & M32
+
+    def getint(self):
+        m = re.match(r"\s*([-+]?\d+)", self.inp[self.ip:])
+        if not m:
+            return 0
+        self.ip += m.end()
+        return int(m.group(1))
+
+    # 运行时库的函数
+    def runtime(self, name):
+        a = [self.reg("a%d" % i) for i in range(8)]
+        if name == "putint":
+            self.out.append(str(a[0]))
+        elif name == "putch":
+            self.out.append(chr(a[0] & 255))
+        elif name == "getint":
+            self.set("a0", self.getint())
+        elif name == "getch":
+            if self.ip < len(self.inp):
+                self.set("a0", ord(self.inp[self.ip]))
+                self.ip += 1
+            else:
+                self.set("a0", -1)
+        elif name == "getarray":
+            n = self.getint()
+            for i in range(n):
+                self.sw(a[0] + 4 * i, self.getint())
+            self.set("a0", n)
+        elif name == "putarray":
+            self.out.append("%d:%s\n" % (a[0], "".join(" %d" % self.lw(a[1] + 4 * i) for i in range(a[0]))))
+        elif name in ("starttime", "stoptime", "_sysy_starttime", "_sysy_stoptime"):
+            pass
+        elif name in ("__sysy_putchars", "__sysy_putint_chars"):
+            # 字符打包在后面的参数寄存器里，每个寄存器 4 个，低字节在前
+            first = 0
+            if name == "__sysy_putint_chars":
+                self.out.append(str(a[0]))
+                first = 1
+            n, words = a[first], a[first + 1:]
+            self.out.append("".join(chr((words[i // 4] >> (8 * (i % 4))) & 255) for i in range(n)))
+        elif name == "__sysy_putstr":
+            b, o = self.mem(a[0] & M32)
+            self.out.append(b[o:o + a[1]].decode("latin1"))
+        else:
+            raise RuntimeError("unknown function " + name)
+
+    def vector(self, op, a):
+        name, kind = op.split(".", 1)
+        vd = int(a[0][1:])
+        if name == "vmv":
+            if kind == "v.x":
+                x = self.reg(a[1])
+            elif kind == "v.i":
+                x = int(a[1], 0)
+            else:
+                self.v[vd][:self.vl] = self.v[int(a[1][1:])][:self.vl]
+                return
+            self.v[vd][:self.vl] = [x] * self.vl
+            return
+        xs = self.v[int(a[1][1:])]
+        if kind == "vv":
+            ys = self.v[int(a[2][1:])]
+        else:
+            ys = [self.reg(a[2]) if kind == "vx" else int(a[2], 0)] * 64
+        if name == "vmerge":
+            mask = self.v[0]
+            self.v[vd][:self.vl] = [ys[i] if mask[i] else xs[i] for i in range(self.vl)]
+            return
+        if name not in VECTOR:
+            raise RuntimeError("unknown vector instruction " + op)
+        self.v[vd][:self.vl] = [s32(VECTOR[name](xs[i], ys[i])) for i in range(self.vl)]
+
+    def run(self):
+        end = -1
+        pc = self.labels["main"]
+        self.r[REGS["ra"]] = end & M32
+        steps = 0
+
+        def jump(label):
+            if label not in self.labels:
+                raise RuntimeError("unknown label " + label)
+            return self.labels[label]
+
+        def back(reg="ra"):
+            x = self.r[REGS[reg]]
+            return end if x == end & M32 else x
+
+        while pc != end:
+            if pc >= len(self.text):
+                raise RuntimeError("pc out of text")
+            op, a, raw = self.text[pc]
+            pc += 1
+            steps += 1
+            if steps > MAX_STEPS:
+                raise RuntimeError("too many steps")
+            if op == "li":
+                self.set(a[0], int(a[1], 0))
+            elif op in ("la", "lla"):
+                if a[1] not in self.data_labels:
+                    raise RuntimeError("unknown symbol " + a[1])
+                self.set(a[0], self.data_labels[a[1]])
+            elif op == "lui":
+                self.set(a[0], int(a[1], 0) << 12)
+            elif op == "mv":
+                self.set(a[0], self.reg(a[1]))
+            elif op == "lw":
+                self.set(a[0], self.lw(self.addr(a[1])))
+            elif op == "sw":
+                self.sw(self.addr(a[1]), self.reg(a[0]))
+            elif op == "nop":
+                pass
+            elif op in BINARY:
+                self.set(a[0], BINARY[op](self.reg(a[1]), self.reg(a[2])))
+            elif op in IMMEDIATE:
+                imm = int(a[2], 0)
+                if op not in ("slli", "srli", "srai") and not -2048 <= imm < 2048:
+                    raise RuntimeError("immediate out of range: " + raw)
+                self.set(a[0], BINARY[IMMEDIATE[op]](self.reg(a[1]), imm))
+            elif op in UNARY:
+                self.set(a[0], UNARY[op](self.reg(a[1])))
+            elif op in BRANCH:
+                if BRANCH[op](self.reg(a[0]), self.reg(a[1])):
+                    pc = jump(a[2])
+            elif op in BRANCH_ZERO:
+                if BRANCH[BRANCH_ZERO[op]](self.reg(a[0]), 0):
+                    pc = jump(a[1])
+            elif op == "j":
+                pc = jump(a[0])
+            elif op == "jr":
+                pc = back(a[0])
+            elif op == "ret":
+                pc = back()
+            elif op in ("call", "tail"):
+                if a[0] in self.labels:
+                    if op == "call":
+                        self.r[REGS["ra"]] = pc
+                    pc = self.labels[a[0]]
+                else:
+                    self.runtime(a[0])
+                    if op == "tail":
+                        pc = back()
+            elif op.startswith("vsetvli"):
+                self.vl = min(self.reg(a[1]), self.vlmax)
+                self.set(a[0], self.vl)
+            elif op == "vle32.v":
+                base, vd = self.addr(a[1]), int(a[0][1:])
+                self.v[vd][:self.vl] = [self.lw(base + 4 * i) for i in range(self.vl)]
+            elif op == "vse32.v":
+                base, vs = self.addr(a[1]), int(a[0][1:])
+                for i in range(self.vl):
+                    self.sw(base + 4 * i, self.v[vs][i])
+            elif op.startswith("v"):
+                self.vector(op, a)
+            else:
+                raise RuntimeError("unknown instruction: " + raw)
+        return self.reg("a0") & 255
+
+
+def main():
+    src = open(sys.argv[1]).read()
+    inp = open(sys.argv[2]).read() if len(sys.argv) > 2 else ""
+    sim = Sim(src, inp)
+    try:
+        code = sim.run()
+    finally:
+        sys.stdout.write("".join(sim.out))
+    return code
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,124 @@
+#!/usr/bin/env python3
+# 很深和很宽的输入：几万层括号、语句块、if、else if 链，几万项的和
+# 每种形状生成两个大小（后一个是前一个的 4 倍），检查 -koopa 能编译、-run 的返回值正确，
+# 时间和峰值内存随大小线性增长：4 倍的输入用的时间和内存不超过 8 倍（平方增长是 16 倍），
+# 并且每个大小上平均每层（每项）的时间和内存不超过 BUDGET 中这种形状的上限；
+# 超过 YYMAXDEPTH 的嵌套应该报错退出，而不是崩溃
+# 用法：tests/scale.py [编译器]，默认 build/compiler
+import os
+import sys
+import tempfile
+
+SIZES = (25000, 100000)
+RATIO = 8
+
+
+def parens(n):
+    return "int main(){ return " + "(" * n + "7" + ")" * n + "; }\n", 7
+
+
+def wide_sum(n):
+    return "int main(){ int x = 1; return " + " + ".join(["x"] * n) + "; }\n", n % 256
+
+
+def right_sum(n):
+    return "int main(){ int x = 1; return " + "x + (" * (n - 1) + "x" + ")" * (n - 1) + "; }\n", n % 256
+
+
+def blocks(n):
+    return "int main(){ int x = 1; " + "{ " * n + "x = x + 1;" + " }" * n + " return x; }\n", 2
+
+
+def ifs(n):
+    return "int main(){ int x = 1, r = 0; " + "if(x){ " * n + "r = 5;" + " }" * n + " return r; }\n", 5
+
+
+def else_ifs(n):
+    chain = " else ".join("if(x == %d) r = %d;" % (i, i % 256) for i in range(n))
+    return "int main(){ int x = %d, r = 0; %s return r; }\n" % (n - 1, chain), (n - 1) % 256
+
+
+SHAPES = [parens, wide_sum, right_sum, blocks, ifs, else_ifs]
+
+# 每种形状平均每层的峰值内存（KB）和时间（微秒）的上限，内存留一半左右的余量，时间留出慢机器的余量
+BUDGET = {
+    "parens": (2, 10),
+    "wide_sum": (2, 20),
+    "right_sum": (3, 30),
+    "blocks": (1.5, 10),
+    "ifs": (4, 40),
+    "else_ifs": (8, 100),
+}
+
+# 比 sysy.y 中的 YYMAXDEPTH 更深的括号
+TOO_DEEP = 1200000
+
+
+# 运行编译器，返回退出码、用时（秒）和峰值内存（KB）
+def run(args):
+    pid = os.fork()
+    if pid == 0:
+        fd = os.open(os.devnull, os.O_RDWR)
+        os.dup2(fd, 0)
+        os.dup2(fd, 1)
+        os.dup2(fd, 2)
+        os.execv(args[0], args)
+    _, status, usage = os.wait4(pid, 0)
+    return os.waitstatus_to_exitcode(status), usage.ru_utime + usage.ru_stime, usage.ru_maxrss
+
+
+def main():
+    compiler = os.path.abspath(sys.argv[1] if len(sys.argv) > 1 else os.path.join(os.path.dirname(__file__), "..", "build", "compiler"))
+    tmp = tempfile.mkdtemp()
+    src, out = os.path.join(tmp, "a.sy"), os.path.join(tmp, "a.out")
+    failed = 0
+    for shape in SHAPES:
+        measured = []
+        for n in SIZES:
+            text, expect = shape(n)
+            with open(src, "w") as f:
+                f.write(text)
+            code, seconds, rss = run([compiler, "-koopa", src, "-o", out])
+            if code != 0:
+                print("FAIL %s n=%d: -koopa exit %d" % (shape.__name__, n, code))
+                failed += 1
+                break
+            code = run([compiler, "-run", src, "-o", out])[0]
+            if code != expect:
+                print("FAIL %s n=%d: -run returned %d, expected %d" % (shape.__name__, n, code, expect))
+                failed += 1
+                break
+            kb, us = BUDGET[shape.__name__]
+            print("%-10s n=%-7d %7.3fs %8.1fMB %6.2fKB/n %6.2fus/n" % (shape.__name__, n, seconds, rss / 1024, rss / n, seconds * 1e6 / n))
+            if rss > kb * n:
+                print("FAIL %s n=%d: %.2fKB per level, budget %gKB" % (shape.__name__, n, rss / n, kb))
+                failed += 1
+            if seconds > us * n / 1e6:
+                print("FAIL %s n=%d: %.2fus per level, budget %gus" % (shape.__name__, n, seconds * 1e6 / n, us))
+                failed += 1
+            measured.append((seconds, rss))
+        if len(measured) == 2:
+            (t0, m0), (t1, m1) = measured
+            # 太快的时间只有计时的误差，不算比例
+            if t1 > 0.05 and t1 > RATIO * max(t0, 0.01):
+                print("FAIL %s: time grew %.1fx" % (shape.__name__, t1 / max(t0, 0.01)))
+                failed += 1
+            if m1 > RATIO * m0:
+                print("FAIL %s: memory grew %.1fx" % (shape.__name__, m1 / m0))
+                failed += 1
+    with open(src, "w") as f:
+        f.write(parens(TOO_DEEP)[0])
+    code = run([compiler, "-koopa", src, "-o", out])[0]
+    if code != 1:
+        print("FAIL parens n=%d: -koopa exit %d, expected a nesting error" % (TOO_DEEP, code))
+        failed += 1
+    os.remove(src)
+    if os.path.exists(out):
+        os.remove(out)
+    os.rmdir(tmp)
+    print("scale: %s" % ("fail=%d" % failed if failed else "ok"))
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,124 @@
+#!/usr/bin/env python3
+# -emit-stats 输出的 JSON：tests/run/ 中的每个程序在各种模式下生成统计，检查
+# 顶层只有 functions，函数按源程序中定义的顺序出现，每个函数的 koopa 部分的字段齐全，
+# 各类指令的条数和同样选项下 -koopa 输出的文本一致，riscv 部分只在 -riscv、-obj 时出现
+# 用法：tests/stats.py [编译器]，默认 build/compiler
+import glob
+import json
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+MODES = [["-koopa"], ["-run"], ["-riscv"], ["-obj"], ["-koopa", "-fstream"], ["-riscv", "-fstream"], ["-riscv", "-O2"]]
+KOOPA_KEYS = {"blocks", "temps", "insts", "allocs", "loads", "stores", "opcodes"}
+RISCV_KEYS = {"insts", "spills", "frameSize", "cycles"}
+BINARY = {"ne", "eq", "gt", "lt", "ge", "le", "add", "sub", "mul", "div", "mod", "and", "or", "xor", "shl", "shr", "sar"}
+
+
+# 源程序中定义的函数，按出现的顺序
+def defined_functions(text):
+    return re.findall(r"^\s*(?:int|void)\s+(\w+)\s*\(", text, re.M)
+
+
+# koopa 文本中每个函数的各类指令的条数
+def koopa_opcodes(text):
+    funcs, cur = {}, None
+    for line in text.split("\n"):
+        m = re.match(r"^fun @(\w+)\(", line)
+        if m:
+            cur = funcs.setdefault(m.group(1), {})
+        elif line.startswith("}"):
+            cur = None
+        elif cur is not None and line.startswith("   "):
+            words = line.split()
+            op = words[2] if len(words) > 2 and words[1] == "=" else words[0]
+            if op not in BINARY and op not in ("alloc", "load", "store", "getptr", "getelemptr", "br", "jump", "call", "ret"):
+                op = "other"
+            cur[op] = cur.get(op, 0) + 1
+    return funcs
+
+
+def check(sy, mode, tmp):
+    errors = []
+    stats, out = os.path.join(tmp, "stats.json"), os.path.join(tmp, "out")
+    inp = b""
+    if os.path.exists(sy[:-3] + ".in"):
+        with open(sy[:-3] + ".in", "rb") as f:
+            inp = f.read()
+    subprocess.run([COMPILER, mode[0], sy, "-o", out, "-emit-stats=" + stats] + mode[1:],
+                   input=inp, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    try:
+        with open(stats) as f:
+            data = json.load(f)
+    except (OSError, ValueError) as e:
+        return ["不是合法的 JSON: %s" % e]
+    finally:
+        if os.path.exists(stats):
+            os.remove(stats)
+    if set(data) != {"functions"}:
+        errors.append("顶层的键是 %s" % sorted(data))
+        return errors
+    funcs = data["functions"]
+    names = [f.get("name") for f in funcs]
+    with open(sy) as f:
+        expect = defined_functions(f.read())
+    if names != expect:
+        errors.append("函数是 %s，应该是 %s" % (names, expect))
+
+    # 同样的选项输出 koopa，逐个函数比较指令条数
+    koopa = os.path.join(tmp, "a.koopa")
+    subprocess.run([COMPILER, "-koopa", sy, "-o", koopa] + mode[1:], stderr=subprocess.DEVNULL)
+    with open(koopa) as f:
+        opcodes = koopa_opcodes(f.read())
+    lowered = mode[0] in ("-riscv", "-obj")
+    for func in funcs:
+        name = func.get("name")
+        k = func.get("koopa", {})
+        if set(func) != {"name", "koopa"} | ({"riscv"} if lowered else set()):
+            errors.append("%s 的键是 %s" % (name, sorted(func)))
+            continue
+        if set(k) != KOOPA_KEYS or not all(isinstance(k[key], int) and k[key] >= 0 for key in KOOPA_KEYS - {"opcodes"}):
+            errors.append("%s 的 koopa 部分是 %s" % (name, k))
+            continue
+        ops = k["opcodes"]
+        if k["blocks"] < 1 or k["insts"] != sum(ops.values()):
+            errors.append("%s: blocks %d，insts %d，opcodes 合计 %d" % (name, k["blocks"], k["insts"], sum(ops.values())))
+        if (k["allocs"], k["loads"], k["stores"]) != (ops.get("alloc", 0), ops.get("load", 0), ops.get("store", 0)):
+            errors.append("%s: allocs、loads、stores 和 opcodes 不一致" % name)
+        if ops != opcodes.get(name):
+            errors.append("%s: opcodes %s，-koopa 中是 %s" % (name, ops, opcodes.get(name)))
+        if lowered:
+            r = func["riscv"]
+            if set(r) != RISCV_KEYS or not all(isinstance(v, int) and v >= 0 for v in r.values()):
+                errors.append("%s 的 riscv 部分是 %s" % (name, r))
+            elif r["insts"] < 1 or r["cycles"] < r["insts"] or r["frameSize"] % 4 != 0:
+                errors.append("%s: riscv 部分的数值不对 %s" % (name, r))
+    return errors
+
+
+def main():
+    tmp = tempfile.mkdtemp()
+    failed = passed = 0
+    for sy in sorted(glob.glob(os.path.join(ROOT, "tests", "run", "*.sy"))):
+        for mode in MODES:
+            errors = check(sy, mode, tmp)
+            for e in errors:
+                print("FAIL %s %s: %s" % (os.path.relpath(sy, ROOT), " ".join(mode), e))
+            if errors:
+                failed += 1
+            else:
+                passed += 1
+    for name in os.listdir(tmp):
+        os.remove(os.path.join(tmp, name))
+    os.rmdir(tmp)
+    print("stats: pass=%d fail=%d" % (passed, failed))
+    return 1 if failed else 0
+
+
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+COMPILER = os.path.abspath(sys.argv[1] if len(sys.argv) > 1 else os.path.join(ROOT, "build", "compiler"))
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,79 @@
+#!/usr/bin/env python3
+# 运行时库 runtime/sylib.c：和 tests/sylib/driver.c 一起用本机的 C 编译器（$CC，默认 cc）编译，检查
+# 各种输出函数（包括 -fbatch-io 合成的 __sysy_putchars、__sysy_putint_chars）写出的内容和 exit 时的刷新，
+# 读入之前先刷新输出：提示出现之前不给输入，等不到提示就失败，
+# 以及超过缓冲区大小的输入和输出
+# 用法：tests/sylib.py [编译器]，参数只是为了和其他测试一致，不使用
+import os
+import select
+import subprocess
+import sys
+import tempfile
+
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+
+
+# 从管道读，直到读到 expect 或者超时
+def read_until(f, expect, seconds):
+    got = b""
+    while not got.endswith(expect):
+        ready, _, _ = select.select([f], [], [], seconds)
+        if not ready:
+            break
+        chunk = os.read(f.fileno(), 4096)
+        if not chunk:
+            break
+        got += chunk
+    return got
+
+
+def main():
+    tmp = tempfile.mkdtemp()
+    exe = os.path.join(tmp, "driver")
+    cc = os.environ.get("CC", "cc")
+    subprocess.run([cc, "-O2", "-o", exe, os.path.join(ROOT, "runtime", "sylib.c"), os.path.join(ROOT, "tests", "sylib", "driver.c")], check=True)
+    failed = passed = 0
+
+    def report(name, ok, detail):
+        nonlocal failed, passed
+        if ok:
+            passed += 1
+        else:
+            failed += 1
+            print("FAIL %s: %s" % (name, detail))
+
+    # exit 也要把缓冲区里的输出写出去
+    p = subprocess.run([exe, "output"], stdout=subprocess.PIPE)
+    expect = b"0 -2147483648\nHi!\nabcdefghijklmnopqrstuvwxyz-12,\n99\n3: 7 -8 2147483647\n"
+    report("output", p.stdout == expect and p.returncode == 3, "%r, exit %d" % (p.stdout, p.returncode))
+
+    # 提示在读入之前就要出现，否则这里一直等不到
+    p = subprocess.Popen([exe, "prompt"], stdin=subprocess.PIPE, stdout=subprocess.PIPE)
+    got = read_until(p.stdout, b"n? ", 5)
+    if got == b"n? ":
+        p.stdin.write(b"12\n")
+        p.stdin.close()
+        got += p.stdout.read()
+    else:
+        p.kill()
+        p.stdin.close()
+    p.wait()
+    p.stdout.close()
+    report("prompt", got == b"n? 144\n", "%r" % got)
+
+    # 输入和输出都超过 64KB 的缓冲区
+    nums = list(range(-20000, 20000, 3))
+    text = "".join(chr(ord("a") + i % 26) for i in range(200000))
+    data = ("%d\n%s\n%s" % (len(nums), " ".join(map(str, nums)), text)).encode()
+    p = subprocess.run([exe, "echo"], input=data, stdout=subprocess.PIPE)
+    expect = ("".join("%d " % x for x in nums) + text).encode()
+    report("echo", p.stdout == expect, "%d bytes, expected %d" % (len(p.stdout), len(expect)))
+
+    os.remove(exe)
+    os.rmdir(tmp)
+    print("sylib: pass=%d fail=%d" % (passed, failed))
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,66 @@
+// 直接调用 runtime/sylib.c 的函数，由 tests/sylib.py 编译运行
+// 参数 output：各种输出函数，包括 -fbatch-io 用的 __sysy_putchars、__sysy_putint_chars，最后用 exit 退出
+// 参数 prompt：先输出提示再读入，提示要在读入之前出现在标准输出上
+// 参数 echo：读入整数和字符，原样输出，输出超过缓冲区的大小
+#include <stdlib.h>
+#include <string.h>
+
+int getint(void);
+int getch(void);
+int getarray(int a[]);
+void putint(int x);
+void putch(int c);
+void putarray(int n, int a[]);
+void __sysy_putchars(int n, int w0, int w1, int w2, int w3, int w4, int w5, int w6);
+void __sysy_putint_chars(int x, int n, int w0, int w1, int w2, int w3, int w4, int w5);
+
+// 每个 int 按小端装 4 个字符
+static int pack(const char *s){
+    int w = 0;
+    for(int i = 0; i < 4 && s[i]; i++){
+        w |= (unsigned char)s[i] << (8 * i);
+    }
+    return w;
+}
+
+int main(int argc, char *argv[]){
+    if(argc < 2){
+        return 2;
+    }
+    if(strcmp(argv[1], "output") == 0){
+        int a[3] = {7, -8, 2147483647};
+        putint(0);
+        putch(' ');
+        putint(-2147483647 - 1);
+        putch('\n');
+        __sysy_putchars(4, pack("Hi!\n"), 0, 0, 0, 0, 0, 0);
+        __sysy_putchars(26, pack("abcd"), pack("efgh"), pack("ijkl"), pack("mnop"), pack("qrst"), pack("uvwx"), pack("yz"));
+        __sysy_putint_chars(-12, 2, pack(",\n"), 0, 0, 0, 0, 0);
+        __sysy_putint_chars(99, 0, 0, 0, 0, 0, 0, 0);
+        putch('\n');
+        putarray(3, a);
+        exit(3);
+    }
+    if(strcmp(argv[1], "prompt") == 0){
+        __sysy_putchars(3, pack("n? "), 0, 0, 0, 0, 0, 0);
+        int n = getint();
+        putint(n * n);
+        putch('\n');
+        return 0;
+    }
+    if(strcmp(argv[1], "echo") == 0){
+        int n = getint();
+        for(int i = 0; i < n; i++){
+            putint(getint());
+            putch(' ');
+        }
+        getch();
+        int c = getch();
+        while(c >= 0){
+            putch(c);
+            c = getch();
+        }
+        return 0;
+    }
+    return 2;
+}
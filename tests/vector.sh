@@ -0,0 +1,41 @@
+#!/bin/bash
+# 向量化的识别和生成的汇编：tests/vector/ 中每个程序加上 -march=rv32imv 生成汇编，
+# 检查文件开头 // CHECK: 的模式都出现，// CHECK-NOT: 的模式都不出现；不加时不能有向量指令
+# 用法：tests/vector.sh [编译器]，默认 build/compiler
+cd "$(dirname "$0")/.."
+COMPILER=${1:-build/compiler}
+TMP=$(mktemp -d)
+trap 'rm -rf $TMP' EXIT
+
+pass=0
+fail=0
+for sy in tests/vector/*.sy; do
+    ok=1
+    for opt in -O0 -O1 -O2; do
+        if ! $COMPILER -riscv $sy -o $TMP/v.s $opt -march=rv32imv || ! $COMPILER -riscv $sy -o $TMP/s.s $opt; then
+            echo "FAIL $sy $opt: 编译失败"
+            ok=0
+            continue
+        fi
+        while read -r kind pattern; do
+            if [ "$kind" == "CHECK:" ] && ! grep -qF -- "$pattern" $TMP/v.s; then
+                echo "FAIL $sy $opt: 没有 $pattern"
+                ok=0
+            elif [ "$kind" == "CHECK-NOT:" ] && grep -qF -- "$pattern" $TMP/v.s; then
+                echo "FAIL $sy $opt: 不应有 $pattern"
+                ok=0
+            fi
+        done < <(sed -n 's|^// \(CHECK\(-NOT\)\?:\) *|\1 |p' $sy)
+        if grep -q "vsetvli" $TMP/s.s; then
+            echo "FAIL $sy $opt: 没有 -march=rv32imv 时生成了向量指令"
+            ok=0
+        fi
+    done
+    if [ $ok -eq 1 ]; then
+        pass=$((pass + 1))
+    else
+        fail=$((fail + 1))
+    fi
+done
+echo "vector: pass=$pass fail=$fail"
+[ $fail -eq 0 ]